@@ -48,18 +48,19 @@ public:
 	{
 		if (sd.m_IMUFrames.size() == 0) throw MLIB_EXCEPTION("no imu data found");
 
+		const SensorData::IMUFrameAlignment imu = sd.alignIMUFrames(SensorData::IMU_NEAREST);
 		vec3f v(0.0f, 0.0f, 0.0f);
 		for (size_t i = 0; i < sd.m_frames.size(); i++) {
-			const SensorData::IMUFrame& f = sd.findClosestIMUFrame(i);
+			const vec3d& acceleration = imu.m_acceleration[i];
 			
 			if (sd.m_frames[i].getCameraToWorld()(0, 0) == -std::numeric_limits<float>::infinity()) continue;
 
-			if (f.acceleration == vec3d::origin) {
+			if (acceleration == vec3d::origin) {
 				std::cout << "invalid IMU acceleration data entry at " << i << "-th frame" << std::endl;
 				continue;
 			}
 
-			vec3f cameraUp = -vec3f((float)f.acceleration.x, (float)f.acceleration.y, (float)f.acceleration.z).getNormalized();
+			vec3f cameraUp = -vec3f((float)acceleration.x, (float)acceleration.y, (float)acceleration.z).getNormalized();
 			const mat4f& t = sd.m_frames[i].getCameraToWorld();
 			const vec3f worldUp = (t.getRotation() * cameraUp).getNormalized();
 			v += worldUp;
@@ -83,17 +84,18 @@ public:
 	{
 		if (sd.m_IMUFrames.size() == 0) throw MLIB_EXCEPTION("no imu data found");
 
+		const SensorData::IMUFrameAlignment imu = sd.alignIMUFrames(SensorData::IMU_NEAREST);
 		vec3f v(0.0f, 0.0f, 0.0f);
 		for (size_t i = 0; i < sd.m_frames.size(); i++) {
-			const SensorData::IMUFrame& f = sd.findClosestIMUFrame(i);
+			const vec3d& gravity = imu.m_gravity[i];
 			if (sd.m_frames[i].getCameraToWorld()(0, 0) == -std::numeric_limits<float>::infinity()) continue;
 
-			if (f.gravity == vec3d::origin) {
+			if (gravity == vec3d::origin) {
 				std::cout << "invalid IMU gravity data entry at " << i << "-th frame" << std::endl;
 				continue;
 			}
 
-			vec3f cameraUp = vec3f((float)f.gravity.x, (float)f.gravity.y, (float)f.gravity.z).getNormalized();
+			vec3f cameraUp = vec3f((float)gravity.x, (float)gravity.y, (float)gravity.z).getNormalized();
 
 			cameraUp = vec3f(cameraUp.y, cameraUp.x, cameraUp.z);
 
@@ -125,7 +127,8 @@ public:
 		return trajectory;
 	}
 
-	static void removeInvalidIMUFrames(SensorData& sd) {
+	//! returns the number of removed IMU frames
+	static unsigned int removeInvalidIMUFrames(SensorData& sd) {
 		const bool checkTimeStamp = true;	//at the moment only remove invalid time frames
 		const bool checkGravity = false;
 		const bool checkAccel = false;
@@ -149,6 +152,44 @@ public:
 		if (removedInvalidFrames > 0) {
 			std::cout << "removed " << removedInvalidFrames << " invalid IMUFrames" << std::endl;
 		}
+		return removedInvalidFrames;
+	}
+
+	//! writes the poses of sd (loaded from sensFile) back to sensFile: patched in place if only the poses changed,
+	//! otherwise (e.g., IMU frames were removed) the whole file is written to a temporary copy that replaces sensFile;
+	//! the copy gets the frame index (trailer or sidecar file) and the preview of the original, the preview is recomputed from the new frames
+	static void savePoses(SensorData& sd, const std::string& sensFile, bool onlyPosesChanged) {
+		if (onlyPosesChanged) {
+			const std::vector<SensorData::FramePose> poses = sd.getFramePoses();
+			sd.free();	//releases the mapping of sensFile
+			SensorData::writeFramePoses(sensFile, poses);
+		}
+		else {
+			UINT64 fileSizeBytes = 0;
+			{
+				std::ifstream in(sensFile, std::ios::binary | std::ios::ate);
+				if (!in.is_open()) throw MLIB_EXCEPTION("could not open file " + sensFile);
+				fileSizeBytes = (UINT64)in.tellg();
+			}
+			const bool hadIndexTrailer = fileSizeBytes > SensorData::loadFrameIndex(sensFile).m_dataSizeBytes;
+			const bool hadSidecarIndex = util::fileExists(SensorData::getFrameIndexSidecarFilename(sensFile));
+			SensorData preview;
+			const bool hadPreview = SensorData::loadPreview(sensFile, preview);
+			SensorData::PreviewOptions previewOptions;
+			if (hadPreview) {
+				previewOptions.colorDownsampleFactor = std::max(sd.m_colorWidth / preview.m_colorWidth, 1u);
+				previewOptions.depthDownsampleFactor = std::max(sd.m_depthWidth / preview.m_depthWidth, 1u);
+				preview.free();
+			}
+
+			const std::string tmpFile = sensFile + ".tmp";
+			sd.saveToFile(tmpFile, hadIndexTrailer);
+			sd.free();
+			util::deleteFile(sensFile);
+			util::moveFile(tmpFile, sensFile);
+			if (hadPreview) SensorData::writePreviews(sensFile, previewOptions);	//also writes the index trailer
+			else if (hadSidecarIndex) SensorData::writeFrameIndex(sensFile, true);
+		}
 	}
 
 	static void alignScan(const std::string& path, bool forceRealign = false) {
@@ -181,8 +222,10 @@ public:
 
 		mat4f transform = mat4f::identity();
 
-		SensorData sd(sensFile);
-		removeInvalidIMUFrames(sd);
+		SensorData::recoverFramePoses(sensFile);	//an interrupted pose update must not be the starting point
+		SensorData sd;
+		sd.loadFromFileMapped(sensFile);	//only the poses are written back
+		const bool onlyPosesChanged = removeInvalidIMUFrames(sd) == 0;
 
 		if (sd.m_frames.size() == 0) throw MLIB_EXCEPTION("no frames found in the sensor file");
 
@@ -301,7 +344,7 @@ public:
 
 
 			sd.applyTransform(transform);
-			sd.saveToFile(sensFile);
+			savePoses(sd, sensFile, onlyPosesChanged);
 			pf.aligned = true;	//it's now aligned
 			pf.saveToFile(processedFile);
 		}
@@ -344,9 +387,10 @@ public:
 
 		const mat4f transform = readTransformFromAln(alnFile);
 
-		SensorData sd(sensFile);
+		SensorData::recoverFramePoses(sensFile);	//an interrupted pose update must not be the starting point
+		SensorData sd;
+		sd.loadFromFileMapped(sensFile);	//only the poses are written back
 		if (sd.m_frames.size() == 0) throw MLIB_EXCEPTION("no frames found in the sensor file");
-		sd.applyTransform(transform);
 
 		{ //save out transformed
 			for (const std::string& plyFile : plyFiles) {
@@ -355,7 +399,7 @@ public:
 				MeshIOf::saveToFile(dir.getPath() + "/" + plyFile, mesh);
 			}
 			sd.applyTransform(transform);
-			sd.saveToFile(sensFile);
+			savePoses(sd, sensFile, true);
 			pf.aligned = true;	//it's now aligned
 			pf.saveToFile(processedFile);
 		}
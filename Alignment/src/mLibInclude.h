@@ -8,6 +8,7 @@
 #include <mLibCore.h>
 #include <mLibLodePNG.h>
 #include <mLibCGAL.h>
+#include "../../SensReader/c++/src/sensorDataMLib.h"	//loadFromFileMapped, writeFramePoses
 #include <mLibDepthCamera.h>
 #include <mLibFreeImage.h>
 
@@ -312,6 +312,7 @@ void process(FilterData& filterData, std::string path, std::string scanNetPath,
 
 	Directory dir(labelPath);
 	const auto& files = dir.getFiles(); unsigned int _idx = 0;
+	SensorData::FrameBufferPool frameBuffers(sd);
 	for (const auto& f : files) {
 		const unsigned int frameIdx = util::convertTo<unsigned int>(util::removeExtensions(f));
 		if (sd.m_frames[frameIdx].getCameraToWorld()[0] == -std::numeric_limits<float>::infinity()) {
@@ -323,11 +324,9 @@ void process(FilterData& filterData, std::string path, std::string scanNetPath,
 		}
 		DepthImage32 depth; ColorImageR32 intensity;
 		{
-			unsigned short* depthData = sd.decompressDepthAlloc(frameIdx);
-			vec3uc* colorData = sd.decompressColorAlloc(frameIdx);
-			convertToFloat(depthData, sd.m_depthWidth, sd.m_depthHeight, depth);
-			convertToGrayscale(colorData, sd.m_colorWidth, sd.m_colorHeight, intensity); //could also move to gpu
-			std::free(depthData); std::free(colorData);
+			frameBuffers.decompress(sd, sd.m_frames[frameIdx]);
+			convertToFloat(frameBuffers.getDepth(), sd.m_depthWidth, sd.m_depthHeight, depth);
+			convertToGrayscale(frameBuffers.getColor(), sd.m_colorWidth, sd.m_colorHeight, intensity); //could also move to gpu
 		}
 		MLIB_CUDA_SAFE_CALL(cudaMemcpy(filterData.d_depth, depth.getData(), sizeof(float)*depth.getNumPixels(), cudaMemcpyHostToDevice));
 		MLIB_CUDA_SAFE_CALL(cudaMemcpy(filterData.d_intensity, intensity.getData(), sizeof(float)*intensity.getNumPixels(), cudaMemcpyHostToDevice));
@@ -13,6 +13,7 @@
 //
 
 #include "mLibCore.h"
+#include "../../SensReader/c++/src/sensorDataMLib.h"
 #include "mLibDepthCamera.h"
 //#include "mLibD3D11.h"
 //#include "mLibD3D11Font.h"
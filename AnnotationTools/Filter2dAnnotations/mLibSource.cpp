@@ -1,5 +1,6 @@
 
 //#include "stdafx.h"
+#include "mLibInclude.h"
 
 #include "mLibCore.cpp"
 //#include "mLibD3D11.cpp"
@@ -1,5 +1,6 @@
 #pragma once
 #include "json.h"
+#include "../../Segmentator/segsIO.h"
 
 
 struct SegmentationParams {
@@ -50,12 +51,33 @@ public:
 		m_params = other.m_params;
 	}
 
+	//! loads a .segs.json or .segs.bin file (see Segmentator/segsIO.h)
 	void loadFromFile(const std::string& filename)
 	{
 		if (!ml::util::fileExists(filename)) throw MLIB_EXCEPTION("[parse] failed to open file " + filename);
 		clear();
 
-		// Parse JSON document
+		segs::SegsData data;
+		const bool binary = segs::isSegsBinary(filename);
+		if (binary && !segs::readSegsBinary(filename, data)) throw MLIB_EXCEPTION("[parse] invalid binary segmentation " + filename);
+		if (binary || segs::readSegsJSON(filename, data)) {
+			m_sceneName = data.sceneId;
+			m_segmentIds.swap(data.segIndices);
+			const auto param = [&](const char* name) { return data.params.count(name) ? (float)data.params[name] : 0.0f; };
+			m_params.kThresh = data.kThresh;
+			m_params.segMinVerts = data.segMinVerts;
+			m_params.minPoints = (unsigned int)param("minPoints");
+			m_params.maxPoints = (unsigned int)param("maxPoints");
+			m_params.thinThresh = param("thinThresh");
+			m_params.flatThresh = param("flatThresh");
+			m_params.minLength = param("minLength");
+			m_params.maxLength = param("maxLength");
+			if (data.segIds.empty()) segs::computeSegmentTable(m_segmentIds, data.segIds, data.vertOffsets, data.vertIds);
+			setSegmentTable(data.segIds, data.vertOffsets, data.vertIds);
+			return;
+		}
+
+		// not in the layout written by segmentator/saveToFile: parse JSON document
 		rapidjson::Document d;
 		if (!json::parseRapidJSONDocument(filename, &d)) {
 			std::cerr << "Parse error reading " << filename << std::endl
@@ -94,16 +116,22 @@ public:
 		ofs << "{" << std::endl;
 		ofs << key("params"); m_params.toJSON(ofs); ofs << "," << std::endl;
 		ofs << key("sceneId"); ofs << "\"" << m_sceneName << "\"," << std::endl;
-		ofs << key("segIndices"); ofs << "[";
-		for (unsigned int i = 0; i < m_segmentIds.size(); i++) {
-			ofs << m_segmentIds[i];
-			if (i + 1 < m_segmentIds.size()) ofs << ",";
-		}
-		ofs << "]" << std::endl;
+		ofs << key("segIndices");
+		std::string segIndices;
+		segs::appendJSONArray(segIndices, m_segmentIds);
+		ofs.write(segIndices.data(), segIndices.size());
+		ofs << std::endl;
 		ofs << "}" << std::endl;
 		ofs.close();
 	}
 
+	//! saves as .segs.bin (kThresh and segMinVerts are the only params stored); withSegmentTable also stores the vertices per segment
+	void saveToBinaryFile(const std::string& filename, bool withSegmentTable = false) const
+	{
+		if (!segs::writeSegsBinary(filename, m_sceneName, m_params.kThresh, m_params.segMinVerts, m_segmentIds, withSegmentTable))
+			throw MLIB_EXCEPTION("failed to write file " + filename);
+	}
+
 	const std::vector<unsigned int>& getSegmentIdsPerVertex() const { return m_segmentIds; }
 	size_t getNumSegments() const { return m_segIdsToVertIds.size(); }
 	const std::unordered_map<unsigned int, std::vector<unsigned int>>& getSegmentIdToVertIdMap() const { return m_segIdsToVertIds; }
@@ -147,6 +175,15 @@ public:
 	}
 
 private:
+	//! fills m_segIdsToVertIds from a segment table (one insert per segment instead of per vertex)
+	void setSegmentTable(const std::vector<unsigned int>& segIds, const std::vector<unsigned int>& vertOffsets, const std::vector<unsigned int>& vertIds) {
+		m_segIdsToVertIds.clear();
+		m_segIdsToVertIds.reserve(segIds.size());
+		for (size_t s = 0; s < segIds.size(); s++) {
+			m_segIdsToVertIds[segIds[s]] = std::vector<unsigned int>(vertIds.begin() + vertOffsets[s], vertIds.begin() + vertOffsets[s + 1]);
+		}
+	}
+
 	void clear() {
 		m_segmentIds.clear();
 		m_sceneName = "";
@@ -1,4 +1,6 @@
 
 #include "stdafx.h"
 
-#include "aligner.h"
\ No newline at end of file
+#ifdef CALIBRATE_D3D11
+#include "aligner.h"
+#endif
\ No newline at end of file
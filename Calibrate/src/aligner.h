@@ -2,6 +2,7 @@
 #pragma once
 
 #include "mLibInclude.h"
+#include "alignerCPU.h"
 
 class Aligner {
 public:
@@ -81,35 +82,9 @@ public:
 		return res;		
 	}
 
-	//projects a depth image into color space (debug version with aliasing)
-	static DepthImage32 depthToColorDebug(const DepthImage32& input, const mat4f& depthIntrinsic, const mat4f& depthExtrinsic, const mat4f& colorIntrinsic, unsigned int colorWidth, unsigned int colorHeight) {
-
-		mat4f depthIntrinsicInv = depthIntrinsic.getInverse();
-
-		float scalarWidth = (float)(input.getWidth()-1) / (float)(colorWidth-1);
-		float scalarHeight = (float)(input.getHeight()-1) / (float)(colorHeight-1);
-
-		DepthImage32 res(input.getWidth(), input.getHeight());
-		res.setInvalidValue(input.getInvalidValue());
-		res.setPixels(input.getInvalidValue());
-
-		for (auto& o : input) {
-			float d = o.value;
-			if (d != res.getInvalidValue()) {
-				vec3f p = depthIntrinsicInv*vec3f((float)o.x*d, (float)o.y*d, d);	//back-project to camera space
-				p = depthExtrinsic * p;												//project to color frame
-				vec3f colorCoord = colorIntrinsic * p;								//project to color image space
-				colorCoord.x /= colorCoord.z;	colorCoord.y /= colorCoord.z;
-				vec2i colorCoordi = math::round(colorCoord);	//use that to get color values
-				colorCoordi.x = math::round(colorCoord.x * scalarWidth);
-				colorCoordi.y = math::round(colorCoord.y * scalarHeight);
-
-				if (colorCoordi.x >= 0 && colorCoordi.x < (int)res.getWidth() && colorCoordi.y >= 0 && colorCoordi.y < (int)res.getHeight()) {
-					res(colorCoordi.x, colorCoordi.y) = colorCoord.z;
-				}
-			}
-		}
-		return res;
+	//projects a depth image into color space (point version: one output pixel per input pixel, nearest depth wins; see AlignerCPU::depthToColorSplat)
+	static DepthImage32 depthToColorDebug(const DepthImage32& input, const mat4f& depthIntrinsic, const mat4f& depthExtrinsic, const mat4f& colorIntrinsic, unsigned int colorWidth, unsigned int colorHeight, bool fillHoles = false) {
+		return AlignerCPU::depthToColorSplat(input, depthIntrinsic, depthExtrinsic, colorIntrinsic, colorWidth, colorHeight, fillHoles);
 	}
 private:
 #define DEPTH_WORLD_MIN 0.1f
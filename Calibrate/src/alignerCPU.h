@@ -0,0 +1,377 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ALIGNER_CPU_SSE2
+#endif
+
+//same constants as Aligner
+static const float ALIGNER_CPU_DEPTH_MIN = 0.1f;
+static const float ALIGNER_CPU_DEPTH_MAX = 10.0f;
+static const float ALIGNER_CPU_DEPTH_THRESH_OFFSET = 0.01f;	//discontinuity offset in meter
+static const float ALIGNER_CPU_DEPTH_THRESH_LIN = 0.05f;	//additional discontinuity threshold per meter
+
+//! CPU version of Aligner::depthToColor for machines without a GPU (same geometry as shaders/aligner.hlsl):
+//! every 2x2 block of valid, continuous depth values becomes a quad that is projected into the color camera and
+//! rasterized with a z-buffer into an image of the input's size. depthToColorSplat is the cheaper point version (one output
+//! pixel per input pixel, nearest depth wins, optional hole filling) that replaces the old last-writer-wins debug projection.
+//! Per-pixel rays and transforms are precomputed by init, both projections are const and can be called from several threads
+//! at once; the results do not depend on the number of threads.
+class AlignerCPU
+{
+public:
+	AlignerCPU() {
+		m_width = 0;
+		m_height = 0;
+	}
+	AlignerCPU(unsigned int width, unsigned int height, const mat4f& depthIntrinsic, const mat4f& depthExtrinsic, const mat4f& colorIntrinsic, unsigned int colorWidth, unsigned int colorHeight) {
+		init(width, height, depthIntrinsic, depthExtrinsic, colorIntrinsic, colorWidth, colorHeight);
+	}
+
+	void init(unsigned int width, unsigned int height, const mat4f& depthIntrinsic, const mat4f& depthExtrinsic, const mat4f& colorIntrinsic, unsigned int colorWidth, unsigned int colorHeight) {
+		m_width = width;
+		m_height = height;
+
+		//camera space position of a pixel with depth d: d * ray (the intrinsic inverse applied to (x*d, y*d, d, d))
+		const mat4f intrinsicInverse = depthIntrinsic.getInverse();
+		const size_t numPixels = (size_t)width * height;
+		m_rayX.resize(numPixels);
+		m_rayY.resize(numPixels);
+		m_rayZ.resize(numPixels);
+		for (unsigned int y = 0; y < height; y++) {
+			for (unsigned int x = 0; x < width; x++) {
+				const size_t idx = (size_t)y * width + x;
+				m_rayX[idx] = intrinsicInverse(0, 0) * x + intrinsicInverse(0, 1) * y + intrinsicInverse(0, 2) + intrinsicInverse(0, 3);
+				m_rayY[idx] = intrinsicInverse(1, 0) * x + intrinsicInverse(1, 1) * y + intrinsicInverse(1, 2) + intrinsicInverse(1, 3);
+				m_rayZ[idx] = intrinsicInverse(2, 0) * x + intrinsicInverse(2, 1) * y + intrinsicInverse(2, 2) + intrinsicInverse(2, 3);
+			}
+		}
+		for (unsigned int r = 0; r < 4; r++) {
+			for (unsigned int c = 0; c < 4; c++) {
+				m_extrinsic[r * 4 + c] = depthExtrinsic(r, c);
+				m_colorIntrinsic[r * 4 + c] = colorIntrinsic(r, c);
+			}
+		}
+
+		//color image coordinates -> raster of the output (the viewport has the size of the input, the projection is normalized by the color size)
+		m_raster.scaleX = (float)width / (float)(colorWidth - 1);
+		m_raster.scaleY = (float)height / (float)(colorHeight - 1);
+		m_raster.minX = 0.0f;	m_raster.maxX = (float)width;
+		m_raster.minY = 0.0f;	m_raster.maxY = (float)height;
+		//color pixel -> output pixel, rounded to the nearest center (maps corner pixels onto corner pixels)
+		m_splat.scaleX = (float)(width - 1) / (float)(colorWidth - 1);
+		m_splat.scaleY = (float)(height - 1) / (float)(colorHeight - 1);
+		m_splat.minX = -0.5f;	m_splat.maxX = (float)width - 0.5f;
+		m_splat.minY = -0.5f;	m_splat.maxY = (float)height - 0.5f;
+	}
+
+	unsigned int getWidth() const {
+		return m_width;
+	}
+	unsigned int getHeight() const {
+		return m_height;
+	}
+
+	//! projects the depth image (of size getWidth() x getHeight()) into the color camera
+	DepthImage32 depthToColor(const DepthImage32& input) const {
+		if (input.getWidth() != m_width || input.getHeight() != m_height) throw MLIB_EXCEPTION("depth image dimensions do not match the aligner");
+		const int width = (int)m_width;
+		const int height = (int)m_height;
+		const size_t numPixels = (size_t)width * height;
+		const float* depth = input.getData();
+
+		std::vector<float> vx(numPixels), vy(numPixels), vz(numPixels);
+		std::vector<unsigned char> valid(numPixels);
+#pragma omp parallel for
+		for (int y = 0; y < height; y++) {
+			projectRow(depth, (size_t)y * width, (size_t)(y + 1) * width, m_raster, vx.data(), vy.data(), vz.data(), valid.data());
+		}
+
+		//vertical extent of the quads of each row, so that every band of output rows only visits the rows that reach it
+		std::vector<float> rowMinY(height, 0.0f), rowMaxY(height, -1.0f);
+		for (int y = 0; y + 1 < height; y++) {
+			float minY = (float)height, maxY = 0.0f;
+			for (size_t i = (size_t)y * width; i < (size_t)(y + 2) * width; i++) {
+				if (valid[i]) {
+					minY = std::min(minY, vy[i]);
+					maxY = std::max(maxY, vy[i]);
+				}
+			}
+			rowMinY[y] = minY;
+			rowMaxY[y] = maxY;
+		}
+
+		DepthImage32 res(m_width, m_height);
+		res.setInvalidValue(input.getInvalidValue());
+		float* zBuffer = res.getData();
+		std::fill(zBuffer, zBuffer + numPixels, ALIGNER_CPU_DEPTH_MAX);	//far plane, as the cleared depth buffer
+
+		//each band of output rows is rasterized by one thread, in the same order for any number of threads
+		const int bandHeight = 16;
+		const int numBands = (height + bandHeight - 1) / bandHeight;
+#pragma omp parallel for schedule(dynamic)
+		for (int band = 0; band < numBands; band++) {
+			const int y0 = band * bandHeight;
+			const int y1 = std::min(y0 + bandHeight, height);
+			for (int y = 0; y + 1 < height; y++) {
+				if (rowMaxY[y] < (float)y0 || rowMinY[y] > (float)y1) continue;
+				for (int x = 0; x + 1 < width; x++) {
+					rasterizeQuad(depth, vx.data(), vy.data(), vz.data(), valid.data(), y * width + x, zBuffer, y0, y1);
+				}
+			}
+		}
+
+		for (size_t i = 0; i < numPixels; i++) {
+			if (zBuffer[i] >= ALIGNER_CPU_DEPTH_MAX) zBuffer[i] = res.getInvalidValue();
+		}
+		return res;
+	}
+
+	//! same interface as Aligner::depthToColor (computes the rays for this call only)
+	static DepthImage32 depthToColor(const DepthImage32& input, const mat4f& depthIntrinsic, const mat4f& depthExtrinsic, const mat4f& colorIntrinsic, unsigned int colorWidth, unsigned int colorHeight) {
+		AlignerCPU aligner(input.getWidth(), input.getHeight(), depthIntrinsic, depthExtrinsic, colorIntrinsic, colorWidth, colorHeight);
+		return aligner.depthToColor(input);
+	}
+
+	//! projects every valid depth pixel to the nearest output pixel; where several land on the same pixel the closest one is kept.
+	//! fillHoles closes the one pixel cracks that forward projection leaves in continuous surfaces (see fillHoles below)
+	DepthImage32 depthToColorSplat(const DepthImage32& input, bool fillHoles = false) const {
+		if (input.getWidth() != m_width || input.getHeight() != m_height) throw MLIB_EXCEPTION("depth image dimensions do not match the aligner");
+		const int width = (int)m_width;
+		const int height = (int)m_height;
+		const size_t numPixels = (size_t)width * height;
+		const float* depth = input.getData();
+
+		//target pixel of every input pixel (-1 if it does not project into the image), and the range of target rows of every input row
+		std::vector<float> vx(numPixels), vy(numPixels), vz(numPixels);
+		std::vector<unsigned char> valid(numPixels);
+		std::vector<int> target(numPixels);
+		std::vector<int> rowMinY(height), rowMaxY(height);
+#pragma omp parallel for
+		for (int y = 0; y < height; y++) {
+			const size_t begin = (size_t)y * width, end = (size_t)(y + 1) * width;
+			projectRow(depth, begin, end, m_splat, vx.data(), vy.data(), vz.data(), valid.data());
+			int minY = height, maxY = -1;
+			for (size_t i = begin; i < end; i++) {
+				target[i] = -1;
+				if (!valid[i]) continue;
+				const int tx = (int)std::floor(vx[i] + 0.5f);
+				const int ty = (int)std::floor(vy[i] + 0.5f);
+				if (tx < 0 || tx >= width || ty < 0 || ty >= height) continue;
+				target[i] = ty * width + tx;
+				minY = std::min(minY, ty);
+				maxY = std::max(maxY, ty);
+			}
+			rowMinY[y] = minY;
+			rowMaxY[y] = maxY;
+		}
+
+		DepthImage32 res(m_width, m_height);
+		res.setInvalidValue(input.getInvalidValue());
+		float* zBuffer = res.getData();
+		std::fill(zBuffer, zBuffer + numPixels, ALIGNER_CPU_DEPTH_MAX);
+
+		//min-depth z-buffer, one band of output rows per thread (no two threads write the same pixel, no atomics needed)
+		const int bandHeight = 16;
+		const int numBands = (height + bandHeight - 1) / bandHeight;
+#pragma omp parallel for schedule(dynamic)
+		for (int band = 0; band < numBands; band++) {
+			const int begin = band * bandHeight * width;
+			const int end = std::min((band + 1) * bandHeight, height) * width;
+			for (int y = 0; y < height; y++) {
+				if (rowMaxY[y] < band * bandHeight || rowMinY[y] >= (band + 1) * bandHeight) continue;
+				for (size_t i = (size_t)y * width; i < (size_t)(y + 1) * width; i++) {
+					const int t = target[i];
+					if (t >= begin && t < end && vz[i] < zBuffer[t]) zBuffer[t] = vz[i];
+				}
+			}
+		}
+
+		for (size_t i = 0; i < numPixels; i++) {
+			if (zBuffer[i] >= ALIGNER_CPU_DEPTH_MAX) zBuffer[i] = res.getInvalidValue();
+		}
+		if (fillHoles) AlignerCPU::fillHoles(res);
+		return res;
+	}
+
+	//! same interface as Aligner::depthToColorDebug (computes the rays for this call only)
+	static DepthImage32 depthToColorSplat(const DepthImage32& input, const mat4f& depthIntrinsic, const mat4f& depthExtrinsic, const mat4f& colorIntrinsic, unsigned int colorWidth, unsigned int colorHeight, bool fillHoles = false) {
+		AlignerCPU aligner(input.getWidth(), input.getHeight(), depthIntrinsic, depthExtrinsic, colorIntrinsic, colorWidth, colorHeight);
+		return aligner.depthToColorSplat(input, fillHoles);
+	}
+
+	//! fills invalid pixels that have at least 4 valid 8-neighbors with their mean, provided those neighbors are continuous
+	//! (same threshold as the quads of depthToColor), so cracks are closed but depth discontinuities are not bridged
+	static void fillHoles(DepthImage32& image) {
+		const DepthImage32 src = image;
+		const int width = (int)image.getWidth();
+		const int height = (int)image.getHeight();
+		const float invalid = image.getInvalidValue();
+		const float* in = src.getData();
+		float* out = image.getData();
+#pragma omp parallel for
+		for (int y = 1; y < height - 1; y++) {
+			for (int x = 1; x < width - 1; x++) {
+				const size_t idx = (size_t)y * width + x;
+				if (in[idx] != invalid && in[idx] >= ALIGNER_CPU_DEPTH_MIN) continue;
+				unsigned int count = 0;
+				float sum = 0.0f, dmin = ALIGNER_CPU_DEPTH_MAX, dmax = 0.0f;
+				for (int dy = -1; dy <= 1; dy++) {
+					for (int dx = -1; dx <= 1; dx++) {
+						const float d = in[idx + (ptrdiff_t)dy * width + dx];
+						if (d == invalid || !(d >= ALIGNER_CPU_DEPTH_MIN)) continue;
+						count++;
+						sum += d;
+						dmin = std::min(dmin, d);
+						dmax = std::max(dmax, d);
+					}
+				}
+				if (count >= 4 && dmax - dmin <= ALIGNER_CPU_DEPTH_THRESH_OFFSET + ALIGNER_CPU_DEPTH_THRESH_LIN * 0.5f * (dmax + dmin)) {
+					out[idx] = sum / (float)count;
+				}
+			}
+		}
+	}
+
+private:
+	//maps color image coordinates to the output and bounds the accepted positions
+	struct Raster {
+		float scaleX, scaleY;
+		float minX, maxX;
+		float minY, maxY;
+	};
+
+	//raster position (vx, vy) and camera depth (vz) in the color camera of the pixels begin..end;
+	//valid: depth > ALIGNER_CPU_DEPTH_MIN and inside the view volume (quads with an invalid corner are skipped)
+	void projectRow(const float* depth, size_t begin, size_t end, const Raster& raster, float* vx, float* vy, float* vz, unsigned char* valid) const {
+		const float* E = m_extrinsic;
+		const float* K = m_colorIntrinsic;
+		size_t i = begin;
+#ifdef ALIGNER_CPU_SSE2
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 minZ = _mm_set1_ps(ALIGNER_CPU_DEPTH_MIN);
+		const __m128 maxZ = _mm_set1_ps(ALIGNER_CPU_DEPTH_MAX);
+		const __m128 minX = _mm_set1_ps(raster.minX);
+		const __m128 maxX = _mm_set1_ps(raster.maxX);
+		const __m128 minY = _mm_set1_ps(raster.minY);
+		const __m128 maxY = _mm_set1_ps(raster.maxY);
+		const __m128 scaleX = _mm_set1_ps(raster.scaleX);
+		const __m128 scaleY = _mm_set1_ps(raster.scaleY);
+#define ALIGNER_CPU_ROW(M, r, x, y, z) _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(M[4 * r + 0]), x), _mm_mul_ps(_mm_set1_ps(M[4 * r + 1]), y)), \
+	_mm_add_ps(_mm_mul_ps(_mm_set1_ps(M[4 * r + 2]), z), _mm_set1_ps(M[4 * r + 3])))
+		for (; i + 4 <= end; i += 4) {
+			const __m128 d = _mm_loadu_ps(depth + i);
+			const __m128 px = _mm_mul_ps(d, _mm_loadu_ps(&m_rayX[i]));
+			const __m128 py = _mm_mul_ps(d, _mm_loadu_ps(&m_rayY[i]));
+			const __m128 pz = _mm_mul_ps(d, _mm_loadu_ps(&m_rayZ[i]));
+			const __m128 invW = _mm_div_ps(one, ALIGNER_CPU_ROW(E, 3, px, py, pz));
+			const __m128 qx = _mm_mul_ps(ALIGNER_CPU_ROW(E, 0, px, py, pz), invW);
+			const __m128 qy = _mm_mul_ps(ALIGNER_CPU_ROW(E, 1, px, py, pz), invW);
+			const __m128 qz = _mm_mul_ps(ALIGNER_CPU_ROW(E, 2, px, py, pz), invW);
+			const __m128 cz = ALIGNER_CPU_ROW(K, 2, qx, qy, qz);
+			const __m128 sx = _mm_mul_ps(_mm_div_ps(ALIGNER_CPU_ROW(K, 0, qx, qy, qz), cz), scaleX);
+			const __m128 sy = _mm_mul_ps(_mm_div_ps(ALIGNER_CPU_ROW(K, 1, qx, qy, qz), cz), scaleY);
+			_mm_storeu_ps(vx + i, sx);
+			_mm_storeu_ps(vy + i, sy);
+			_mm_storeu_ps(vz + i, cz);
+			//comparisons with NaN are false, so invalid input never passes
+			__m128 ok = _mm_and_ps(_mm_cmpgt_ps(d, minZ), _mm_and_ps(_mm_cmpge_ps(cz, minZ), _mm_cmple_ps(cz, maxZ)));
+			ok = _mm_and_ps(ok, _mm_and_ps(_mm_cmpge_ps(sx, minX), _mm_cmple_ps(sx, maxX)));
+			ok = _mm_and_ps(ok, _mm_and_ps(_mm_cmpge_ps(sy, minY), _mm_cmple_ps(sy, maxY)));
+			const int mask = _mm_movemask_ps(ok);
+			for (int k = 0; k < 4; k++) valid[i + k] = (mask >> k) & 1;
+		}
+#undef ALIGNER_CPU_ROW
+#endif
+		for (; i < end; i++) {
+			const float d = depth[i];
+			const float px = d * m_rayX[i], py = d * m_rayY[i], pz = d * m_rayZ[i];
+			//same association as the SSE2 path
+			const float invW = 1.0f / ((E[12] * px + E[13] * py) + (E[14] * pz + E[15]));
+			const float qx = ((E[0] * px + E[1] * py) + (E[2] * pz + E[3])) * invW;
+			const float qy = ((E[4] * px + E[5] * py) + (E[6] * pz + E[7])) * invW;
+			const float qz = ((E[8] * px + E[9] * py) + (E[10] * pz + E[11])) * invW;
+			const float cz = (K[8] * qx + K[9] * qy) + (K[10] * qz + K[11]);
+			const float sx = ((K[0] * qx + K[1] * qy) + (K[2] * qz + K[3])) / cz * raster.scaleX;
+			const float sy = ((K[4] * qx + K[5] * qy) + (K[6] * qz + K[7])) / cz * raster.scaleY;
+			vx[i] = sx;
+			vy[i] = sy;
+			vz[i] = cz;
+			valid[i] = d > ALIGNER_CPU_DEPTH_MIN && cz >= ALIGNER_CPU_DEPTH_MIN && cz <= ALIGNER_CPU_DEPTH_MAX &&
+				sx >= raster.minX && sx <= raster.maxX && sy >= raster.minY && sy <= raster.maxY;
+		}
+	}
+
+	//the quad with top-left corner idx as the triangle strip of the geometry shader, rows y0..y1-1 of the output only
+	void rasterizeQuad(const float* depth, const float* vx, const float* vy, const float* vz, const unsigned char* valid, int idx, float* zBuffer, int y0, int y1) const {
+		const int i0 = idx + (int)m_width, i1 = idx, i2 = idx + (int)m_width + 1, i3 = idx + 1;
+		if (!(valid[i0] & valid[i1] & valid[i2] & valid[i3])) return;
+
+		const float d0 = depth[i0], d1 = depth[i1], d2 = depth[i2], d3 = depth[i3];
+		const float dmax = std::max(std::max(d0, d1), std::max(d2, d3));
+		const float dmin = std::min(std::min(d0, d1), std::min(d2, d3));
+		const float d = 0.5f * (dmax + dmin);
+		if (dmax - dmin > ALIGNER_CPU_DEPTH_THRESH_OFFSET + ALIGNER_CPU_DEPTH_THRESH_LIN * d) return;
+
+		rasterizeTriangle(vx, vy, vz, i0, i1, i2, zBuffer, y0, y1);
+		rasterizeTriangle(vx, vy, vz, i1, i3, i2, zBuffer, y0, y1);
+	}
+
+	//z-buffered triangle with pixel centers at +0.5 and the top-left fill rule (pixels on an edge shared by two triangles are covered once)
+	void rasterizeTriangle(const float* vx, const float* vy, const float* vz, int a, int b, int c, float* zBuffer, int y0, int y1) const {
+		float ax = vx[a], ay = vy[a], bx = vx[b], by = vy[b], cx = vx[c], cy = vy[c];
+		float az = vz[a], bz = vz[b], cz = vz[c];
+		float area = (bx - ax) * (cy - ay) - (by - ay) * (cx - ax);
+		if (area == 0.0f) return;
+		if (area < 0.0f) {
+			std::swap(bx, cx);	std::swap(by, cy);	std::swap(bz, cz);
+			area = -area;
+		}
+
+		const int minX = std::max((int)std::ceil(std::min(ax, std::min(bx, cx)) - 0.5f), 0);
+		const int maxX = std::min((int)std::floor(std::max(ax, std::max(bx, cx)) - 0.5f), (int)m_width - 1);
+		const int minY = std::max((int)std::ceil(std::min(ay, std::min(by, cy)) - 0.5f), y0);
+		const int maxY = std::min((int)std::floor(std::max(ay, std::max(by, cy)) - 0.5f), y1 - 1);
+		if (minX > maxX || minY > maxY) return;
+
+		//edge e is opposite to vertex e; top edges are horizontal with the interior below, left edges go up (y points down)
+		const float ex[3] = { cx - bx, ax - cx, bx - ax };
+		const float ey[3] = { cy - by, ay - cy, by - ay };
+		const float ox[3] = { bx, cx, ax };
+		const float oy[3] = { by, cy, ay };
+		bool topLeft[3];
+		for (int e = 0; e < 3; e++) topLeft[e] = ey[e] < 0.0f || (ey[e] == 0.0f && ex[e] > 0.0f);
+
+		const float invArea = 1.0f / area;
+		for (int y = minY; y <= maxY; y++) {
+			const float py = (float)y + 0.5f;
+			float* zRow = zBuffer + (size_t)y * m_width;
+			for (int x = minX; x <= maxX; x++) {
+				const float px = (float)x + 0.5f;
+				float w[3];
+				bool inside = true;
+				for (int e = 0; e < 3; e++) {
+					w[e] = ex[e] * (py - oy[e]) - ey[e] * (px - ox[e]);
+					inside = inside && (w[e] > 0.0f || (w[e] == 0.0f && topLeft[e]));
+				}
+				if (!inside) continue;
+				const float z = (w[0] * az + w[1] * bz + w[2] * cz) * invArea;
+				if (z < zRow[x]) zRow[x] = z;
+			}
+		}
+	}
+
+	unsigned int m_width;
+	unsigned int m_height;
+	std::vector<float> m_rayX;
+	std::vector<float> m_rayY;
+	std::vector<float> m_rayZ;
+	float m_extrinsic[16];		//row-major
+	float m_colorIntrinsic[16];	//row-major
+	Raster m_raster;	//depthToColor
+	Raster m_splat;		//depthToColorSplat
+};
@@ -2,8 +2,12 @@
 
 #include "stdafx.h"
 #include "grid3d.h"
+#include "undistortMap.h"
+#include "alignerCPU.h"
 
+#ifdef CALIBRATE_D3D11
 #include "aligner.h"
+#endif
 
 #include "omp.h"
 
@@ -46,6 +50,12 @@ public:
 		parameterFile.readParameter("k5_depth", depth_dist_coeff[4]);
 
 		parameterFile.readParameter("depthToColorExtrinsics", depth_extrinsic);
+
+		if (color_width > 0 && color_height > 0) color_undistort.init(color_width, color_height, color_intrinsic, color_dist_coeff);
+		if (depth_width > 0 && depth_height > 0) depth_undistort.init(depth_width, depth_height, depth_intrinsic, depth_dist_coeff);
+		if (depth_width > 0 && depth_height > 0 && color_width > 0 && color_height > 0) {
+			depth_to_color.init(depth_width, depth_height, depth_intrinsic, depth_extrinsic, color_intrinsic, color_width, color_height);
+		}
 	}
 
 	unsigned int color_width, color_height;
@@ -58,9 +68,17 @@ public:
 	mat4f depth_extrinsic;	//depth-to-color map;
 	float depth_dist_coeff[5];
 
+	//undistortion tables for the image sizes above (built once, shared by all frames)
+	UndistortMap color_undistort;
+	UndistortMap depth_undistort;
+	//depth-to-color alignment without a GPU (used when the D3D11 path is not compiled in)
+	AlignerCPU depth_to_color;
+
 private:
 	void reset()
 	{
+		color_width = color_height = 0;
+		depth_width = depth_height = 0;
 		color_extrinsic.setIdentity();
 		color_intrinsic.setIdentity();
 		memset(color_dist_coeff, 0, sizeof(float) * 5);
@@ -76,15 +94,25 @@ class Calibration
 {
 public:
 	Calibration() {
+#ifdef CALIBRATE_D3D11
 		m_graphics = new D3D11GraphicsDevice();
 		m_graphics->initWithoutWindow();
+#endif
+		m_interpolation = UndistortMap::NEAREST;
 	}
 	~Calibration() {
+#ifdef CALIBRATE_D3D11
 		SAFE_DELETE(m_graphics);
+#endif
+	}
+
+	//! resampling used to undistort color and depth (NEAREST by default)
+	void setInterpolation(UndistortMap::Interpolation interpolation) {
+		m_interpolation = interpolation;
 	}
 
 
-	void Calibration::calibrateScan(const std::string& inSensFilename, const std::string &outSensFilename, const std::string& parametersFilename, const std::string& undistortTableFilename)
+	void calibrateScan(const std::string& inSensFilename, const std::string &outSensFilename, const std::string& parametersFilename, const std::string& undistortTableFilename)
 	{
 		if (!util::fileExists(inSensFilename)) {
 			if (util::fileExists(outSensFilename)) {
@@ -103,43 +131,148 @@ public:
 
 		// Read in parameters
 		Calib cd(parametersFilename);
+		bool alreadyAligned = false;
 
-		// Read in sens file
-		std::cout << "loading .sens file " << inSensFilename << "... ";
-		SensorData sd(inSensFilename);
-		std::cout << "done!" << std::endl;
-
-		if (sd.m_calibrationDepth.m_extrinsic == mat4f::identity()) {
+		// Stream the frames from the input to a temporary file (the input may be the output file)
+		const std::string tmpSensFilename = outSensFilename + ".tmp";
+		{
+			const unsigned int numThreads = (unsigned int)std::max(omp_get_max_threads(), 1);
+			SensorDataStreamReader reader(inSensFilename, 2 * numThreads);
+			if (reader.getHeader().m_calibrationDepth.m_extrinsic == mat4f::identity()) {
+				std::cout << "color and depth is already aligned -- cannot further calibrate .sens file -> exiting" << std::endl;
+				alreadyAligned = true;
+			}
+			else {
+				std::cout << "calibrating .sens file " << inSensFilename << " -> " << outSensFilename << std::endl;
+				calibrateScan(reader, tmpSensFilename, cd, undistortTable, numThreads);
+			}
+		}
+		if (alreadyAligned) {
 			if (inSensFilename != outSensFilename) util::moveFile(inSensFilename, outSensFilename);
-			std::cout << "color and depth is already aligned -- cannot further calibrate .sens file -> exiting" << std::endl;
 			return;
 		}
 
-		calibrateScan(sd, cd, undistortTable);
+		if (inSensFilename != outSensFilename) util::deleteFile(inSensFilename);
+		if (util::fileExists(outSensFilename)) util::deleteFile(outSensFilename);
+		util::moveFile(tmpSensFilename, outSensFilename);
+		std::cout << "done!" << std::endl;
+	}
 
-		// Updating .sens file meta data
-		sd.m_sensorName = sd.m_sensorName + " (calibrated)";
-		sd.m_calibrationColor.m_extrinsic.setIdentity();
-		sd.m_calibrationColor.m_intrinsic = cd.color_intrinsic;
-		sd.m_calibrationDepth.m_extrinsic.setIdentity();
-		sd.m_calibrationDepth.m_intrinsic = sd.m_calibrationColor.m_intrinsic;
+	//! calibrates all frames of sd in memory and updates its meta data (intrinsics, extrinsics, sensor name)
+	void calibrateScan(SensorData& sd, const Calib& cd, const Grid3D& undistortTable) {
+		const UndistortMap* colorUndistort = nullptr;
+		UndistortMap colorMap;
+		checkScan(sd, cd, colorMap, colorUndistort);
 
-		sd.m_calibrationDepth.m_intrinsic(0, 0) *= (float)sd.m_depthWidth / (float)sd.m_colorWidth;
-		sd.m_calibrationDepth.m_intrinsic(1, 1) *= (float)sd.m_depthHeight / (float)sd.m_colorHeight;
-		sd.m_calibrationDepth.m_intrinsic(0, 2) *= (float)(sd.m_depthWidth - 1) / (float)(sd.m_colorWidth - 1);
-		sd.m_calibrationDepth.m_intrinsic(1, 2) *= (float)(sd.m_depthHeight - 1) / (float)(sd.m_colorHeight - 1);
+		SensorData::FrameBufferPool buffers(sd, omp_get_max_threads());
+#pragma omp parallel for
+		for (int i = 0; i < (int)sd.m_frames.size(); i ++) {
+			auto& f = sd.m_frames[i];
+			if (omp_get_thread_num() == 0) {
+				std::cout << "\rcalibrateScan frame [ " << i*omp_get_num_threads() << " | " << sd.m_frames.size() << " ] ";
+			}
 
+			vec3uc* color = buffers.getColor(omp_get_thread_num());
+			unsigned short* depth = buffers.getDepth(omp_get_thread_num());
+			sd.decompressColorInto(f, color);
+			sd.decompressDepthInto(f, depth);
+			std::vector<vec3uc> undistortedColor((size_t)sd.m_colorWidth * sd.m_colorHeight);
+			calibrateFrame(sd, cd, undistortTable, *colorUndistort, color, undistortedColor.data(), depth);
+			sd.replaceColor(f, undistortedColor.data());
+			sd.replaceDepth(f, depth);
+		}
+		std::cout << std::endl;
 
-		// write sens file
-		std::cout << "saving .sens file " << outSensFilename << "... ";
-		sd.saveToFile(outSensFilename);
-		if (inSensFilename != outSensFilename) util::deleteFile(inSensFilename);
-		std::cout << "done!" << std::endl;
+		setCalibratedMetaData(sd, cd);
+	}
+
+	//! calibrates the frames of reader and writes them to outSensFilename without holding the scan in memory:
+	//! the reader prefetches a bounded window of frames, numThreads workers calibrate them, and LiveSensorDataWriter
+	//! recompresses and writes them in frame order as they finish (the output is removed if anything fails)
+	void calibrateScan(SensorDataStreamReader& reader, const std::string& outSensFilename, const Calib& cd, const Grid3D& undistortTable, unsigned int numThreads) {
+		SensorData header = reader.getHeader();
+		const UndistortMap* colorUndistort = nullptr;
+		UndistortMap colorMap;
+		checkScan(header, cd, colorMap, colorUndistort);
+		setCalibratedMetaData(header, cd);
+		const size_t numFrames = reader.getNumFrames();
+		const size_t colorPixels = (size_t)header.m_colorWidth * header.m_colorHeight;
+		const size_t depthPixels = (size_t)header.m_depthWidth * header.m_depthHeight;
+
+		numThreads = std::max(numThreads, 1u);
+		SensorData::LiveSensorDataWriter writer(&header, outSensFilename, true, 2 * numThreads, numThreads);
+
+		std::mutex mutex;
+		std::exception_ptr exception;
+		std::vector<std::thread> workers;
+		for (unsigned int t = 0; t < numThreads; t++) {
+			workers.push_back(std::thread([&] {
+				omp_set_num_threads(1);	//the workers are the parallelism; no nested teams in the per-frame kernels
+				std::vector<vec3uc> color(colorPixels);
+				SensorData::RGBDFrame f;
+				while (true) {
+					vec3uc* undistortedColor = nullptr;
+					unsigned short* depth = nullptr;
+					try {
+						UINT64 frameIdx;
+						{
+							std::lock_guard<std::mutex> lock(mutex);
+							if (exception || !reader.readNext(f)) break;
+							frameIdx = reader.getNumFramesRead() - 1;
+							if (frameIdx % 10 == 0) std::cout << "\rcalibrateScan frame [ " << frameIdx << " | " << numFrames << " ] ";
+						}
+						undistortedColor = (vec3uc*)std::malloc(sizeof(vec3uc) * colorPixels);
+						depth = (unsigned short*)std::malloc(sizeof(unsigned short) * depthPixels);
+						if (!undistortedColor || !depth) throw MLIB_EXCEPTION("out of memory");
+						header.decompressColorInto(f, color.data());
+						header.decompressDepthInto(f, depth);
+						calibrateFrame(header, cd, undistortTable, *colorUndistort, color.data(), undistortedColor, depth);
+
+						vec3uc* colorFrame = undistortedColor;
+						unsigned short* depthFrame = depth;
+						undistortedColor = nullptr;	depth = nullptr;	//owned by the writer from here on
+						writer.writeFrameAndFree(frameIdx, colorFrame, depthFrame, f.getCameraToWorld(), f.getTimeStampColor(), f.getTimeStampDepth());
+					}
+					catch (...) {
+						std::free(undistortedColor);
+						std::free(depth);
+						{
+							std::lock_guard<std::mutex> lock(mutex);
+							if (!exception) exception = std::current_exception();
+						}
+						writer.abort(std::current_exception());	//releases workers waiting for a frame that will never arrive
+						break;
+					}
+				}
+				f.free();
+			}));
+		}
+		for (auto& t : workers) t.join();
+		std::cout << std::endl;
+
+		if (!exception) {
+			try {
+				if (!reader.getIMUFrames(header.m_IMUFrames)) throw MLIB_EXCEPTION("not all frames were read");
+				writer.close();
+			}
+			catch (...) {
+				exception = std::current_exception();
+			}
+		}
+		if (exception) {
+			try {
+				writer.close();
+			}
+			catch (...) {}
+			std::remove(outSensFilename.c_str());
+			std::rethrow_exception(exception);
+		}
 	}
 
 private:
 
 	DepthImage32 depthToColor(const DepthImage32& input, const Calib& cb) {
+#ifdef CALIBRATE_D3D11
 		DepthImage32 res;
 #pragma omp critical
 		{
@@ -147,165 +280,91 @@ private:
 			res = aligner.depthToColor(input, cb.depth_intrinsic, cb.depth_extrinsic, cb.color_intrinsic, cb.color_width, cb.color_height);
 		}
 		return res;
-	}
-
-	//projects a depth image into color space
-	DepthImage32 depthToColorDebug(const DepthImage32& input, const Calib& cb) {
-
-		mat4f depthIntrinsicInv = cb.depth_intrinsic.getInverse();
-		const mat4f& extrinsic = cb.depth_extrinsic;
-		const mat4f& colorIntrinsic = cb.color_intrinsic;
-
-		float scalarWidth = (float)(input.getWidth()-1) / (float)(cb.color_width-1);
-		float scalarHeight = (float)(input.getHeight()-1) / (float)(cb.color_height-1);
-
-		DepthImage32 res(input.getWidth(), input.getHeight());
-		res.setInvalidValue(input.getInvalidValue());
-		res.setPixels(input.getInvalidValue());
-
-		for (auto& o : input) {
-			float d = o.value;
-			if (d != res.getInvalidValue()) {
-				vec3f p = depthIntrinsicInv*vec3f((float)o.x*d, (float)o.y*d, d);	//back-project to camera space
-				p = extrinsic * p;													//project to color frame
-				vec3f colorCoord = colorIntrinsic * p;								//project to color image space
-				colorCoord.x /= colorCoord.z;	colorCoord.y /= colorCoord.z;
-				vec2i colorCoordi = math::round(colorCoord);	//use that to get color values
-				colorCoordi.x = math::round(colorCoord.x * scalarWidth);
-				colorCoordi.y = math::round(colorCoord.y * scalarHeight);
-
-				if (colorCoordi.x >= 0 && colorCoordi.x < (int)res.getWidth() && colorCoordi.y >= 0 && colorCoordi.y < (int)res.getHeight()) {
-					res(colorCoordi.x, colorCoordi.y) = colorCoord.z;
-				}
-			}
+#else
+		if (input.getWidth() == cb.depth_to_color.getWidth() && input.getHeight() == cb.depth_to_color.getHeight()) {
+			return cb.depth_to_color.depthToColor(input);
 		}
-		return res;
+		return AlignerCPU::depthToColor(input, cb.depth_intrinsic, cb.depth_extrinsic, cb.color_intrinsic, cb.color_width, cb.color_height);
+#endif
 	}
 
-	template <typename T> BaseImage<T> undistort(const BaseImage<T>& src, const mat4f& intrinsic, const float coeff[5])
-	{
-		BaseImage<T> res(src.getWidth(), src.getHeight());
-		res.setInvalidValue(src.getInvalidValue());
-		res.setPixels(res.getInvalidValue());
-
-		for (unsigned int y = 0; y < src.getHeight(); y++)	{
-			for (unsigned int x = 0; x < src.getWidth(); x++)	{
-				vec2f nic_loc;
-				vec2f sample_loc;
-
-				//Normalized image coords
-				nic_loc.x = (x - intrinsic(0, 2)) / intrinsic(0, 0);
-				nic_loc.y = (y - intrinsic(1, 2)) / intrinsic(1, 1);
-
-				float r2 = nic_loc.x * nic_loc.x + nic_loc.y * nic_loc.y;
-
-				// Radial distortion
-				sample_loc.x = nic_loc.x * (1.0f + r2 * coeff[0] + r2*r2 * coeff[1] + r2*r2*r2 * coeff[4]);
-				sample_loc.y = nic_loc.y * (1.0f + r2 * coeff[0] + r2*r2 * coeff[1] + r2*r2*r2 * coeff[4]);
-
-				// Tangential distortion
-				sample_loc.x += 2.0f * coeff[2] * nic_loc.x * nic_loc.y + coeff[3] * (r2 + 2.0f * nic_loc.x * nic_loc.x);
-				sample_loc.y += coeff[2] * (r2 + 2.0f * nic_loc.y * nic_loc.y) + 2.0f * coeff[3] * nic_loc.x * nic_loc.y;
-
-				// Move back to the image space
-				sample_loc.x = sample_loc.x * intrinsic(0, 0) + intrinsic(0, 2);
-				sample_loc.y = sample_loc.y * intrinsic(1, 1) + intrinsic(1, 2);
-
-				//TODO CONTINUE HERE
-				vec2i sample_loc_i = math::round(sample_loc);
-				if (src.isValidCoordinate(sample_loc_i)) {
-					res(x, y) = src(sample_loc_i);
-				}
-			}
+	//projects a depth image into color space (point version, nearest depth wins; see AlignerCPU::depthToColorSplat)
+	DepthImage32 depthToColorDebug(const DepthImage32& input, const Calib& cb, bool fillHoles = false) {
+		if (input.getWidth() == cb.depth_to_color.getWidth() && input.getHeight() == cb.depth_to_color.getHeight()) {
+			return cb.depth_to_color.depthToColorSplat(input, fillHoles);
 		}
-		return res;
+		return AlignerCPU::depthToColorSplat(input, cb.depth_intrinsic, cb.depth_extrinsic, cb.color_intrinsic, cb.color_width, cb.color_height, fillHoles);
 	}
 
 
-	void undistortDistance(unsigned short * depthData, const SensorData &sd, const Grid3D& undistortTable) {
-
-		// Prepare storage
-		// Useful vars
-		int w = sd.m_depthWidth;
-		int h = sd.m_depthHeight;
-		int nSlices = undistortTable.ZRes();
-		float xBin = (float)(w / undistortTable.XRes());
-		float yBin = (float)(h / undistortTable.YRes());
-		float zBin = undistortTable.ZRes() / undistortTable.MaxDist();
-		float depthShift = sd.m_depthShift;
-
-		for (int j = 0; j < h; ++j)
-		{
-			for (int i = 0; i < w; ++i)
-			{
-				float depth = depthData[j * w + i] / depthShift;
-				float zIdx = std::min((float)depth * zBin, (float)nSlices - 1.0f);
-
-				float multiplier = 1.0f / undistortTable.GetValue((float)i / xBin, (float)j / yBin,	zIdx);
-				float newDepth = depth * multiplier;
-				depthData[j*w + i] = (unsigned short)(newDepth * depthShift);
+	//! checks that the scan matches the calibration; colorUndistort points to the calibration's color map, or to colorMap rebuilt for the scan's color size
+	static void checkScan(const SensorData& sd, const Calib& cd, UndistortMap& colorMap, const UndistortMap*& colorUndistort) {
+		if (cd.depth_width != sd.m_depthWidth || cd.depth_height != sd.m_depthHeight) throw MLIB_EXCEPTION("image dimensions do not match with calibration");
 
-			}
+		colorUndistort = &cd.color_undistort;
+		if (colorUndistort->getWidth() != sd.m_colorWidth || colorUndistort->getHeight() != sd.m_colorHeight) {
+			colorMap.init(sd.m_colorWidth, sd.m_colorHeight, cd.color_intrinsic, cd.color_dist_coeff);
+			colorUndistort = &colorMap;
 		}
 	}
 
+	//! the calibrated frames are undistorted and the depth is aligned with the color
+	static void setCalibratedMetaData(SensorData& sd, const Calib& cd) {
+		sd.m_sensorName = sd.m_sensorName + " (calibrated)";
+		sd.m_calibrationColor.m_extrinsic.setIdentity();
+		sd.m_calibrationColor.m_intrinsic = cd.color_intrinsic;
+		sd.m_calibrationDepth.m_extrinsic.setIdentity();
+		sd.m_calibrationDepth.m_intrinsic = sd.m_calibrationColor.m_intrinsic;
 
-	void calibrateScan(SensorData& sd, const Calib& cd, const Grid3D& undistortTable) {
-		if (cd.depth_width != sd.m_depthWidth || cd.depth_height != sd.m_depthHeight) throw MLIB_EXCEPTION("image dimensions do not match with calibration");
-
-#pragma omp parallel for
-		for (int i = 0; i < (int)sd.m_frames.size(); i ++) {
-			auto& f = sd.m_frames[i];
-			if (omp_get_thread_num() == 0) {
-				std::cout << "\rcalibrateScan frame [ " << i*omp_get_num_threads() << " | " << sd.m_frames.size() << " ] ";
-			}
-
-			// apply un-distortion to color
-			vec3uc* color = sd.decompressColorAlloc(f);
-			ColorImageR8G8B8 c(sd.m_colorWidth, sd.m_colorHeight, color);
-			c.setInvalidValue(vec3uc(0, 0, 0));
-			c = undistort(c, cd.color_intrinsic, cd.color_dist_coeff);
-			std::free(color);
-			sd.replaceColor(f, c.getData());
-
-
-			unsigned short* depth = sd.decompressDepthAlloc(f);			
-			undistortDistance(depth, sd, undistortTable);	// apply un-distortion based on distance
-			DepthImage32 d(sd.m_depthWidth, sd.m_depthHeight);
-			d.setInvalidValue(0.0f);
-			for (auto& v : d) {
-				unsigned int idx = v.y*sd.m_depthWidth + v.x;
-				v.value = (float)depth[idx] / sd.m_depthShift;
-			}
+		sd.m_calibrationDepth.m_intrinsic(0, 0) *= (float)sd.m_depthWidth / (float)sd.m_colorWidth;
+		sd.m_calibrationDepth.m_intrinsic(1, 1) *= (float)sd.m_depthHeight / (float)sd.m_colorHeight;
+		sd.m_calibrationDepth.m_intrinsic(0, 2) *= (float)(sd.m_depthWidth - 1) / (float)(sd.m_colorWidth - 1);
+		sd.m_calibrationDepth.m_intrinsic(1, 2) *= (float)(sd.m_depthHeight - 1) / (float)(sd.m_colorHeight - 1);
+	}
 
-			// apply barell un-distortion to depth
-			d = (DepthImage32)Calibration::undistort(d, cd.depth_intrinsic, cd.depth_dist_coeff);
-			// align depth to color			
-			d = Calibration::depthToColor(d, cd);	
+	//! calibrates one decompressed frame: color is undistorted into undistortedColor, depth (raw, sd.m_depthShift units) is undistorted and aligned to color in place
+	void calibrateFrame(const SensorData& sd, const Calib& cd, const Grid3D& undistortTable, const UndistortMap& colorUndistort,
+		const vec3uc* color, vec3uc* undistortedColor, unsigned short* depth) {
 
-			// invalidate depth where we have no color
-			float scalarWidth = (float)(d.getWidth()-1) / (float)(sd.m_colorWidth-1);
-			float scalarHeight = (float)(d.getHeight()-1) / (float)(sd.m_colorHeight-1);
+		// apply un-distortion to color
+		colorUndistort.apply(color, undistortedColor, vec3uc(0, 0, 0), m_interpolation);
 
-			for (auto& v : d) {
-				int x = math::round(v.x / scalarWidth);
-				int y = math::round(v.y / scalarHeight);
-				if (c(x,y) == vec3uc(0, 0, 0)) {
-					v.value = d.getInvalidValue();
-				}
-			}
+		undistortTable.UndistortDepth(depth, sd.m_depthWidth, sd.m_depthHeight, sd.m_depthShift);	// apply un-distortion based on distance
+		DepthImage32 distorted(sd.m_depthWidth, sd.m_depthHeight);
+		distorted.setInvalidValue(0.0f);
+		for (auto& v : distorted) {
+			unsigned int idx = v.y*sd.m_depthWidth + v.x;
+			v.value = (float)depth[idx] / sd.m_depthShift;
+		}
 
-			// convert back to u16
-			for (auto& v : d) {
-				unsigned int idx = v.y*(size_t)sd.m_depthWidth + v.x;
-				depth[idx] = math::round(v.value * sd.m_depthShift);
+		// apply barell un-distortion to depth
+		DepthImage32 d(sd.m_depthWidth, sd.m_depthHeight);
+		d.setInvalidValue(0.0f);
+		cd.depth_undistort.apply(distorted.getData(), d.getData(), d.getInvalidValue(), m_interpolation);
+		// align depth to color
+		d = Calibration::depthToColor(d, cd);
+
+		// invalidate depth where we have no color
+		float scalarWidth = (float)(d.getWidth()-1) / (float)(sd.m_colorWidth-1);
+		float scalarHeight = (float)(d.getHeight()-1) / (float)(sd.m_colorHeight-1);
+
+		for (auto& v : d) {
+			int x = math::round(v.x / scalarWidth);
+			int y = math::round(v.y / scalarHeight);
+			if (undistortedColor[y*(size_t)sd.m_colorWidth + x] == vec3uc(0, 0, 0)) {
+				v.value = d.getInvalidValue();
 			}
-			sd.replaceDepth(f, depth);
+		}
 
-			std::free(depth);
+		// convert back to u16
+		for (auto& v : d) {
+			unsigned int idx = v.y*(size_t)sd.m_depthWidth + v.x;
+			depth[idx] = math::round(v.value * sd.m_depthShift);
 		}
-		std::cout << std::endl;
 	}
 
+#ifdef CALIBRATE_D3D11
 	D3D11GraphicsDevice* m_graphics;
+#endif
+	UndistortMap::Interpolation m_interpolation;
 };
\ No newline at end of file
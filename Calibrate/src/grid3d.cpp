@@ -1,6 +1,14 @@
 #include "stdafx.h"
 #include "grid3d.h"
 
+#include <vector>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define GRID3D_SSE2
+#endif
+
 Grid3D::
 Grid3D()
 {
@@ -150,6 +158,179 @@ GetValue(float x, float y, float z) const
 	return value;
 }
 
+namespace
+{
+	// Interpolation cells along x or y of the grid for each pixel column or row of a depth image
+	struct AxisCells
+	{
+		std::vector<int> offset1;		// element offset of the lower cell
+		std::vector<int> offset2;		// element offset of the upper cell (equal to offset1 at the border)
+		std::vector<float> weight;		// weight of the upper cell
+	};
+
+	void ComputeAxisCells(int numPixels, int res, int stride, AxisCells &cells)
+	{
+		// same binning as Calibration::undistortDistance (integer pixels per cell)
+		const float bin = (float)std::max(numPixels / res, 1);
+		cells.offset1.resize(numPixels);
+		cells.offset2.resize(numPixels);
+		cells.weight.resize(numPixels);
+		for (int i = 0; i < numPixels; ++i)
+		{
+			const float x = (float)i / bin;
+			int x1 = (int) x;
+			float dx = x - x1;
+			if (x1 >= res - 1)
+			{
+				x1 = res - 1;
+				dx = 0.0f;
+			}
+			const int x2 = x1 + 1 < res ? x1 + 1 : x1;
+			cells.offset1[i] = x1 * stride;
+			cells.offset2[i] = x2 * stride;
+			cells.weight[i] = dx;
+		}
+	}
+
+	// Trilinear value for one pixel; zScale converts depth to the z index
+	inline float LookupDepthDivisor(const float *data, const AxisCells &cols, int col, int y1, int y2, float dy,
+		int zRes, int sliceSize, float zScale, float depth)
+	{
+		const float z = std::min(std::max(depth * zScale, 0.0f), (float)(zRes - 1));
+		const int z1 = (int) z;
+		const float dz = z - z1;
+		const int o1 = z1 * sliceSize;
+		const int o2 = z1 + 1 < zRes ? o1 + sliceSize : o1;
+		const int x1 = cols.offset1[col], x2 = cols.offset2[col];
+		const float dx = cols.weight[col];
+
+		const float v1 = (1.0f - dy) * ((1.0f - dx) * data[o1 + y1 + x1] + dx * data[o1 + y1 + x2])
+			+ dy * ((1.0f - dx) * data[o1 + y2 + x1] + dx * data[o1 + y2 + x2]);
+		const float v2 = (1.0f - dy) * ((1.0f - dx) * data[o2 + y1 + x1] + dx * data[o2 + y1 + x2])
+			+ dy * ((1.0f - dx) * data[o2 + y2 + x1] + dx * data[o2 + y2 + x2]);
+		return (1.0f - dz) * v1 + dz * v2;
+	}
+
+#ifdef GRID3D_SSE2
+	// LookupDepthDivisor for the four pixels col..col+3 of a row: scattered grid loads, vectorized interpolation
+	inline __m128 LookupDepthDivisor4(const float *data, const AxisCells &cols, int col, int y1, int y2, float dy,
+		int zRes, int sliceSize, __m128 zScale, __m128 depth)
+	{
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 z = _mm_min_ps(_mm_max_ps(_mm_mul_ps(depth, zScale), _mm_setzero_ps()), _mm_set1_ps((float)(zRes - 1)));
+		const __m128i z1 = _mm_cvttps_epi32(z);
+		const __m128 dz = _mm_sub_ps(z, _mm_cvtepi32_ps(z1));
+
+		int slice[4];
+		_mm_storeu_si128((__m128i*)slice, z1);
+		float c[8][4];
+		for (int k = 0; k < 4; ++k)
+		{
+			const int o1 = slice[k] * sliceSize;
+			const int o2 = slice[k] + 1 < zRes ? o1 + sliceSize : o1;
+			const int x1 = cols.offset1[col + k], x2 = cols.offset2[col + k];
+			c[0][k] = data[o1 + y1 + x1];
+			c[1][k] = data[o1 + y1 + x2];
+			c[2][k] = data[o1 + y2 + x1];
+			c[3][k] = data[o1 + y2 + x2];
+			c[4][k] = data[o2 + y1 + x1];
+			c[5][k] = data[o2 + y1 + x2];
+			c[6][k] = data[o2 + y2 + x1];
+			c[7][k] = data[o2 + y2 + x2];
+		}
+
+		const __m128 dx = _mm_loadu_ps(&cols.weight[col]);
+		const __m128 dx0 = _mm_sub_ps(one, dx);
+		const __m128 dy1 = _mm_set1_ps(dy);
+		const __m128 dy0 = _mm_set1_ps(1.0f - dy);
+		__m128 v[2];
+		for (int k = 0; k < 2; ++k)
+		{
+			const __m128 top = _mm_add_ps(_mm_mul_ps(dx0, _mm_loadu_ps(c[4 * k + 0])), _mm_mul_ps(dx, _mm_loadu_ps(c[4 * k + 1])));
+			const __m128 bottom = _mm_add_ps(_mm_mul_ps(dx0, _mm_loadu_ps(c[4 * k + 2])), _mm_mul_ps(dx, _mm_loadu_ps(c[4 * k + 3])));
+			v[k] = _mm_add_ps(_mm_mul_ps(dy0, top), _mm_mul_ps(dy1, bottom));
+		}
+		return _mm_add_ps(_mm_mul_ps(_mm_sub_ps(one, dz), v[0]), _mm_mul_ps(dz, v[1]));
+	}
+#endif
+}
+
+void Grid3D::
+UndistortDepth(unsigned short * depth, int width, int height, float depthShift) const
+{
+	AxisCells cols, rows;
+	ComputeAxisCells(width, m_xRes, 1, cols);
+	ComputeAxisCells(height, m_yRes, m_xRes, rows);
+	const int sliceSize = m_xRes * m_yRes;
+	// raw values are divided directly, so depthShift only enters the z index
+	const float zScale = (float)m_zRes / m_maxDist / depthShift;
+
+	for (int j = 0; j < height; ++j)
+	{
+		unsigned short *row = depth + (size_t)j * width;
+		const int y1 = rows.offset1[j], y2 = rows.offset2[j];
+		const float dy = rows.weight[j];
+		int i = 0;
+#ifdef GRID3D_SSE2
+		const __m128 zScale4 = _mm_set1_ps(zScale);
+		const __m128 maxDepth = _mm_set1_ps(65535.0f);
+		const __m128i bias32 = _mm_set1_epi32(32768);
+		const __m128i bias16 = _mm_set1_epi16((short)0x8000);
+		for (; i + 4 <= width; i += 4)
+		{
+			const __m128i raw = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)(row + i)), _mm_setzero_si128());
+			const __m128 d = _mm_cvtepi32_ps(raw);
+			const __m128 divisor = LookupDepthDivisor4(m_data, cols, i, y1, y2, dy, m_zRes, sliceSize, zScale4, d);
+			// max(x, 0) also maps NaN (0 / 0) to 0
+			const __m128 res = _mm_min_ps(_mm_max_ps(_mm_div_ps(d, divisor), _mm_setzero_ps()), maxDepth);
+			__m128i r = _mm_sub_epi32(_mm_cvttps_epi32(res), bias32);	// unsigned 16-bit pack via the signed one
+			r = _mm_xor_si128(_mm_packs_epi32(r, r), bias16);
+			_mm_storel_epi64((__m128i*)(row + i), r);
+		}
+#endif
+		for (; i < width; ++i)
+		{
+			const float d = (float)row[i];
+			const float res = d / LookupDepthDivisor(m_data, cols, i, y1, y2, dy, m_zRes, sliceSize, zScale, d);
+			row[i] = res > 0.0f ? (unsigned short)std::min(res, 65535.0f) : 0;
+		}
+	}
+}
+
+void Grid3D::
+UndistortDepth(float * depth, int width, int height) const
+{
+	AxisCells cols, rows;
+	ComputeAxisCells(width, m_xRes, 1, cols);
+	ComputeAxisCells(height, m_yRes, m_xRes, rows);
+	const int sliceSize = m_xRes * m_yRes;
+	const float zScale = (float)m_zRes / m_maxDist;
+
+	for (int j = 0; j < height; ++j)
+	{
+		float *row = depth + (size_t)j * width;
+		const int y1 = rows.offset1[j], y2 = rows.offset2[j];
+		const float dy = rows.weight[j];
+		int i = 0;
+#ifdef GRID3D_SSE2
+		const __m128 zScale4 = _mm_set1_ps(zScale);
+		for (; i + 4 <= width; i += 4)
+		{
+			const __m128 d = _mm_loadu_ps(row + i);
+			const __m128 divisor = LookupDepthDivisor4(m_data, cols, i, y1, y2, dy, m_zRes, sliceSize, zScale4, d);
+			// keep invalid (0) depths at 0
+			const __m128 valid = _mm_cmpneq_ps(d, _mm_setzero_ps());
+			_mm_storeu_ps(row + i, _mm_and_ps(valid, _mm_div_ps(d, divisor)));
+		}
+#endif
+		for (; i < width; ++i)
+		{
+			const float d = row[i];
+			if (d != 0.0f) row[i] = d / LookupDepthDivisor(m_data, cols, i, y1, y2, dy, m_zRes, sliceSize, zScale, d);
+		}
+	}
+}
+
 void Grid3D::
 SetValue(int i, float val)
 {
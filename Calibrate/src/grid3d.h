@@ -20,6 +20,12 @@ public:
 	float GetValue(int i) const;
 	float GetValue(int x, int y, int z) const;
 	float GetValue(float x, float y, float z) const;
+
+	// Depth distortion correction of a whole width x height depth image, in place: each depth d is divided by
+	// GetValue(x / (width / XRes()), y / (height / YRes()), d * ZRes() / MaxDist()) (the z index is clamped to the last slice).
+	// The unsigned short version takes raw values in units of 1/depthShift; invalid (0) depths stay 0.
+	void UndistortDepth(unsigned short * depth, int width, int height, float depthShift) const;
+	void UndistortDepth(float * depth, int width, int height) const;
 	void SetValue(int i, float val);
 	void SetValue(int x, int y, int z, float val);
 
@@ -5,10 +5,18 @@
 #include "mLibCore.h"
 #include "mLibLodePNG.h"
 
+//the GPU aligner needs D3D11; everywhere else (or with CALIBRATE_CPU_ONLY) depth is aligned by AlignerCPU
+#if defined(_WIN32) && !defined(CALIBRATE_CPU_ONLY)
+#define CALIBRATE_D3D11
+#endif
+
+#ifdef CALIBRATE_D3D11
 #include "mLibD3D11.h"
 #include "mLibD3D11Font.h"
+#endif
 
 #include "mLibFreeImage.h"
+#include "../../SensReader/c++/src/sensorDataMLib.h"
 #include "mLibDepthCamera.h"
 
 #include "mLibZLib.h"
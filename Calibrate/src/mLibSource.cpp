@@ -2,7 +2,9 @@
 #include "stdafx.h"
 
 #include "mLibCore.cpp"
+#ifdef CALIBRATE_D3D11
 #include "mLibD3D11.cpp"
+#endif
 #include "mLibLodePNG.cpp"
 #include "mLibDepthCamera.cpp"
 #include "mLibZLib.cpp"
\ No newline at end of file
@@ -3,7 +3,6 @@
 
 #include "main.h"
 #include "calibration.h"
-#include "aligner.h"
 
 std::string getCalibrationNameFromMap(const std::string& deviceCalibrationMapCsv, std::string scanDirectory) {
 	if (!util::directoryExists(scanDirectory)) throw MLIB_EXCEPTION(scanDirectory + " does not exist!");
@@ -44,7 +43,8 @@ std::string getCalibrationNameFromMap(const std::string& deviceCalibrationMapCsv
 int main(int argc, char* argv[])
 {
 	try {
-		if (argc == 5) { //converts a specific scan given by the command line arguments ( input_sens_file, output_sens_file, device_calibration_map, device_calibration_directory )
+		const bool bilinear = argc == 6 && std::string(argv[5]) == "--bilinear";
+		if (argc == 5 || bilinear) { //converts a specific scan given by the command line arguments ( input_sens_file, output_sens_file, device_calibration_map, device_calibration_directory [--bilinear] )
 			const std::string inputSensFilename(argv[1]);
 			const std::string outputSensFilename(argv[2]);
 			const std::string deviceCalibrationMapFile(argv[3]);
@@ -54,6 +54,7 @@ int main(int argc, char* argv[])
 			const std::string calibrationName = getCalibrationNameFromMap(deviceCalibrationMapFile, util::directoryFromPath(inputSensFilename));
 			if (!calibrationName.empty()) {
 				Calibration cb;
+				if (bilinear) cb.setInterpolation(UndistortMap::BILINEAR);
 				cb.calibrateScan(inputSensFilename, outputSensFilename,
 					deviceCalibrationDir + calibrationName + ".txt", deviceCalibrationDir + calibrationName + ".lut");
 			}
@@ -65,12 +66,20 @@ int main(int argc, char* argv[])
 	}
 	catch (const std::exception& e)
 	{
+#ifdef _WIN32
 		MessageBoxA(NULL, e.what(), "Exception caught", MB_ICONERROR);
+#else
+		std::cerr << "Exception caught: " << e.what() << std::endl;
+#endif
 		exit(EXIT_FAILURE);
 	}
 	catch (...)
 	{
+#ifdef _WIN32
 		MessageBoxA(NULL, "UNKNOWN EXCEPTION", "Exception caught", MB_ICONERROR);
+#else
+		std::cerr << "Exception caught: UNKNOWN EXCEPTION" << std::endl;
+#endif
 		exit(EXIT_FAILURE);
 	}
 
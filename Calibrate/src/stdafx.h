@@ -6,11 +6,15 @@
 #pragma once
 
 #include <stdio.h>
+#ifdef _WIN32
 #include <tchar.h>
+#endif
 
 // TODO: reference additional headers your program requires here
 
+#ifdef _WIN32
 #include "WinSock2.h"
 #include "windows.h"
+#endif
 
 #include "mLibInclude.h"
\ No newline at end of file
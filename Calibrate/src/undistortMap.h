@@ -0,0 +1,240 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define UNDISTORT_MAP_SSE2
+#endif
+
+//! Precomputed undistortion lookup for one set of intrinsics / distortion coefficients (k1, k2, p1, p2, k3).
+//! For every target pixel it stores where the radial and tangential distortion model samples the source image,
+//! so undistorting a frame is a table-driven gather instead of evaluating the polynomial per pixel.
+class UndistortMap
+{
+public:
+	enum Interpolation {
+		NEAREST = 0,	//same result as evaluating the model per pixel and rounding
+		BILINEAR = 1	//blends color (vec3uc/vec4uc) and float depth; other types (e.g., labels) stay nearest
+	};
+
+	UndistortMap() {
+		m_width = 0;
+		m_height = 0;
+	}
+	UndistortMap(unsigned int width, unsigned int height, const mat4f& intrinsic, const float coeff[5]) {
+		init(width, height, intrinsic, coeff);
+	}
+
+	void init(unsigned int width, unsigned int height, const mat4f& intrinsic, const float coeff[5]) {
+		m_width = width;
+		m_height = height;
+		const size_t numPixels = (size_t)width * height;
+		m_nearest.resize(numPixels);
+		m_bilinear.resize(numPixels);
+		m_weightX.resize(numPixels);
+		m_weightY.resize(numPixels);
+		m_fixedWeightX.resize(numPixels);
+		m_fixedWeightY.resize(numPixels);
+
+		for (unsigned int y = 0; y < height; y++) {
+			for (unsigned int x = 0; x < width; x++) {
+				vec2f nic_loc;
+				vec2f sample_loc;
+
+				//Normalized image coords
+				nic_loc.x = (x - intrinsic(0, 2)) / intrinsic(0, 0);
+				nic_loc.y = (y - intrinsic(1, 2)) / intrinsic(1, 1);
+
+				float r2 = nic_loc.x * nic_loc.x + nic_loc.y * nic_loc.y;
+
+				// Radial distortion
+				sample_loc.x = nic_loc.x * (1.0f + r2 * coeff[0] + r2*r2 * coeff[1] + r2*r2*r2 * coeff[4]);
+				sample_loc.y = nic_loc.y * (1.0f + r2 * coeff[0] + r2*r2 * coeff[1] + r2*r2*r2 * coeff[4]);
+
+				// Tangential distortion
+				sample_loc.x += 2.0f * coeff[2] * nic_loc.x * nic_loc.y + coeff[3] * (r2 + 2.0f * nic_loc.x * nic_loc.x);
+				sample_loc.y += coeff[2] * (r2 + 2.0f * nic_loc.y * nic_loc.y) + 2.0f * coeff[3] * nic_loc.x * nic_loc.y;
+
+				// Move back to the image space
+				sample_loc.x = sample_loc.x * intrinsic(0, 0) + intrinsic(0, 2);
+				sample_loc.y = sample_loc.y * intrinsic(1, 1) + intrinsic(1, 2);
+
+				const size_t idx = (size_t)y * width + x;
+				vec2i sample_loc_i = math::round(sample_loc);
+				if (sample_loc_i.x >= 0 && sample_loc_i.x < (int)width && sample_loc_i.y >= 0 && sample_loc_i.y < (int)height) {
+					m_nearest[idx] = sample_loc_i.y * (int)width + sample_loc_i.x;
+				}
+				else {
+					m_nearest[idx] = -1;
+				}
+
+				//top-left of the 2x2 footprint; samples within half a pixel of the border fall back to nearest
+				m_bilinear[idx] = -1;
+				m_weightX[idx] = 0.0f;
+				m_weightY[idx] = 0.0f;
+				if (width > 1 && height > 1 &&
+					sample_loc.x >= 0.0f && sample_loc.x <= (float)(width - 1) && sample_loc.y >= 0.0f && sample_loc.y <= (float)(height - 1)) {
+					const int x0 = std::min((int)sample_loc.x, (int)width - 2);
+					const int y0 = std::min((int)sample_loc.y, (int)height - 2);
+					m_bilinear[idx] = y0 * (int)width + x0;
+					m_weightX[idx] = sample_loc.x - (float)x0;
+					m_weightY[idx] = sample_loc.y - (float)y0;
+				}
+				m_fixedWeightX[idx] = (unsigned short)(m_weightX[idx] * 256.0f + 0.5f);
+				m_fixedWeightY[idx] = (unsigned short)(m_weightY[idx] * 256.0f + 0.5f);
+			}
+		}
+	}
+
+	unsigned int getWidth() const {
+		return m_width;
+	}
+	unsigned int getHeight() const {
+		return m_height;
+	}
+	bool isInitialized() const {
+		return m_width > 0 && m_height > 0;
+	}
+
+	//! undistorts src into dst (both getWidth() x getHeight(), must not overlap); pixels that sample outside src are set to invalid
+	template<typename T>
+	void apply(const T* src, T* dst, const T& invalid, Interpolation interpolation = NEAREST) const {
+		const int height = (int)m_height;
+#pragma omp parallel for
+		for (int y = 0; y < height; y++) {
+			const size_t begin = (size_t)y * m_width;
+			if (interpolation == BILINEAR) applyBilinearRow(src, dst, invalid, begin, begin + m_width);
+			else applyNearestRow(src, dst, invalid, begin, begin + m_width);
+		}
+	}
+
+	template<typename T>
+	BaseImage<T> apply(const BaseImage<T>& src, Interpolation interpolation = NEAREST) const {
+		if (src.getWidth() != m_width || src.getHeight() != m_height) throw MLIB_EXCEPTION("image dimensions do not match the undistortion map");
+		BaseImage<T> res(m_width, m_height);
+		res.setInvalidValue(src.getInvalidValue());
+		apply(src.getData(), res.getData(), src.getInvalidValue(), interpolation);
+		return res;
+	}
+
+private:
+	template<typename T>
+	void applyNearestRow(const T* src, T* dst, const T& invalid, size_t begin, size_t end) const {
+		const int* nearest = m_nearest.data();
+		for (size_t i = begin; i < end; i++) {
+			const int s = nearest[i];
+			dst[i] = s >= 0 ? src[s] : invalid;
+		}
+	}
+
+	//types without a meaningful blend (labels, raw depth) are resampled nearest
+	template<typename T>
+	void applyBilinearRow(const T* src, T* dst, const T& invalid, size_t begin, size_t end) const {
+		applyNearestRow(src, dst, invalid, begin, end);
+	}
+
+	//up to four 8-bit channels packed into a 32-bit word
+	template<unsigned int numChannels>
+	static unsigned int loadPacked(const unsigned char* p) {
+		unsigned int v = p[0] | (p[1] << 8) | (p[2] << 16);
+		if (numChannels == 4) v |= (unsigned int)p[3] << 24;
+		return v;
+	}
+
+	//blends channels 0,2 and 1,3 as two 16-bit lanes each (weights in 1/256, so no lane overflows)
+	static unsigned int lerpPacked(unsigned int a, unsigned int b, unsigned int w) {
+		const unsigned int evenA = a & 0x00ff00ff, oddA = (a >> 8) & 0x00ff00ff;
+		const unsigned int evenB = b & 0x00ff00ff, oddB = (b >> 8) & 0x00ff00ff;
+		const unsigned int even = ((evenA * (256 - w) + evenB * w + 0x00800080) >> 8) & 0x00ff00ff;
+		const unsigned int odd = (oddA * (256 - w) + oddB * w + 0x00800080) & 0xff00ff00;
+		return even | odd;
+	}
+
+	template<unsigned int numChannels, typename V>
+	void blendColorRow(const V* src, V* dst, const V& invalid, size_t begin, size_t end) const {
+		const int* nearest = m_nearest.data();
+		const int* bilinear = m_bilinear.data();
+		const size_t w = m_width;
+		for (size_t i = begin; i < end; i++) {
+			const int b = bilinear[i];
+			if (b < 0) {
+				dst[i] = nearest[i] >= 0 ? src[nearest[i]] : invalid;
+				continue;
+			}
+			const unsigned int wx = m_fixedWeightX[i];
+			const unsigned int top = lerpPacked(loadPacked<numChannels>((const unsigned char*)&src[b]), loadPacked<numChannels>((const unsigned char*)&src[b + 1]), wx);
+			const unsigned int bottom = lerpPacked(loadPacked<numChannels>((const unsigned char*)&src[b + w]), loadPacked<numChannels>((const unsigned char*)&src[b + w + 1]), wx);
+			const unsigned int v = lerpPacked(top, bottom, m_fixedWeightY[i]);
+			unsigned char* out = (unsigned char*)&dst[i];
+			for (unsigned int c = 0; c < numChannels; c++) out[c] = (unsigned char)(v >> (8 * c));
+		}
+	}
+
+	void applyBilinearRow(const vec3uc* src, vec3uc* dst, const vec3uc& invalid, size_t begin, size_t end) const {
+		blendColorRow<3>(src, dst, invalid, begin, end);
+	}
+	void applyBilinearRow(const vec4uc* src, vec4uc* dst, const vec4uc& invalid, size_t begin, size_t end) const {
+		blendColorRow<4>(src, dst, invalid, begin, end);
+	}
+
+	//depth: blends only if all four taps are valid, otherwise keeps the nearest sample (no mixing across depth edges)
+	float blendDepth(const float* src, float invalid, size_t i) const {
+		const int b = m_bilinear[i];
+		const int n = m_nearest[i];
+		if (b < 0) return n >= 0 ? src[n] : invalid;
+		const size_t w = m_width;
+		const float d00 = src[b], d10 = src[b + 1], d01 = src[b + w], d11 = src[b + w + 1];
+		if (d00 == invalid || d10 == invalid || d01 == invalid || d11 == invalid) return src[n];
+		const float fx = m_weightX[i], fy = m_weightY[i];
+		const float top = d00 + (d10 - d00) * fx;
+		const float bottom = d01 + (d11 - d01) * fx;
+		return top + (bottom - top) * fy;
+	}
+
+	void applyBilinearRow(const float* src, float* dst, const float& invalid, size_t begin, size_t end) const {
+		size_t i = begin;
+#ifdef UNDISTORT_MAP_SSE2
+		const int* bilinear = m_bilinear.data();
+		const int* nearest = m_nearest.data();
+		const size_t w = m_width;
+		const __m128 invalid4 = _mm_set1_ps(invalid);
+		for (; i + 4 <= end; i += 4) {
+			const int b0 = bilinear[i], b1 = bilinear[i + 1], b2 = bilinear[i + 2], b3 = bilinear[i + 3];
+			if ((b0 | b1 | b2 | b3) < 0) {
+				for (size_t k = i; k < i + 4; k++) dst[k] = blendDepth(src, invalid, k);
+				continue;
+			}
+			const __m128 d00 = _mm_setr_ps(src[b0], src[b1], src[b2], src[b3]);
+			const __m128 d10 = _mm_setr_ps(src[b0 + 1], src[b1 + 1], src[b2 + 1], src[b3 + 1]);
+			const __m128 d01 = _mm_setr_ps(src[b0 + w], src[b1 + w], src[b2 + w], src[b3 + w]);
+			const __m128 d11 = _mm_setr_ps(src[b0 + w + 1], src[b1 + w + 1], src[b2 + w + 1], src[b3 + w + 1]);
+			const __m128 fx = _mm_loadu_ps(&m_weightX[i]);
+			const __m128 fy = _mm_loadu_ps(&m_weightY[i]);
+			const __m128 top = _mm_add_ps(d00, _mm_mul_ps(_mm_sub_ps(d10, d00), fx));
+			const __m128 bottom = _mm_add_ps(d01, _mm_mul_ps(_mm_sub_ps(d11, d01), fx));
+			const __m128 blend = _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), fy));
+			const __m128 hasInvalid = _mm_or_ps(_mm_or_ps(_mm_cmpeq_ps(d00, invalid4), _mm_cmpeq_ps(d10, invalid4)),
+				_mm_or_ps(_mm_cmpeq_ps(d01, invalid4), _mm_cmpeq_ps(d11, invalid4)));
+			if (_mm_movemask_ps(hasInvalid) == 0) {
+				_mm_storeu_ps(&dst[i], blend);
+			}
+			else {
+				const __m128 nearest4 = _mm_setr_ps(src[nearest[i]], src[nearest[i + 1]], src[nearest[i + 2]], src[nearest[i + 3]]);
+				_mm_storeu_ps(&dst[i], _mm_or_ps(_mm_and_ps(hasInvalid, nearest4), _mm_andnot_ps(hasInvalid, blend)));
+			}
+		}
+#endif
+		for (; i < end; i++) dst[i] = blendDepth(src, invalid, i);
+	}
+
+	unsigned int m_width;
+	unsigned int m_height;
+	std::vector<int> m_nearest;		//source pixel index, -1 if outside the source
+	std::vector<int> m_bilinear;	//top-left source pixel of the bilinear footprint, -1 if not fully inside
+	std::vector<float> m_weightX;
+	std::vector<float> m_weightY;
+	std::vector<unsigned short> m_fixedWeightX;	//weights in 1/256 for 8-bit color
+	std::vector<unsigned short> m_fixedWeightY;
+};
@@ -13,9 +13,99 @@ UINT64 timeToUINT64(double d) {
 }
 
 
-void convertToSens(const std::string& baseFilename, ml::SensorData& sens)
+//! compressed depth frame and color file name handed from the reader to the decode workers
+struct RawFrame {
+	unsigned int frameIdx;
+	std::vector<char> depthCompressed;
+	std::string colorFile;
+};
+
+//! bounded blocking queue between the reader and the decode workers (keeps the memory usage independent of the scan length)
+class RawFrameQueue {
+public:
+	RawFrameQueue(size_t capacity) : m_capacity(capacity), m_bClosed(false) {}
+
+	//! blocks while the queue is full; returns false if the queue was closed
+	bool push(RawFrame& f) {
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_condFree.wait(lock, [&] { return m_frames.size() < m_capacity || m_bClosed; });
+		if (m_bClosed) return false;
+		m_frames.push_back(std::move(f));
+		m_condReady.notify_one();
+		return true;
+	}
+
+	//! blocks while the queue is empty; returns false once the queue is closed and drained
+	bool pop(RawFrame& f) {
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_condReady.wait(lock, [&] { return !m_frames.empty() || m_bClosed; });
+		if (m_frames.empty()) return false;
+		f = std::move(m_frames.front());
+		m_frames.pop_front();
+		m_condFree.notify_one();
+		return true;
+	}
+
+	//! no more frames are pushed (if drop, the queued frames are discarded as well)
+	void close(bool drop = false) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_bClosed = true;
+		if (drop) m_frames.clear();
+		m_condReady.notify_all();
+		m_condFree.notify_all();
+	}
+
+private:
+	size_t m_capacity;
+	bool m_bClosed;
+	std::list<RawFrame> m_frames;
+	std::mutex m_mutex;
+	std::condition_variable m_condReady;
+	std::condition_variable m_condFree;
+};
+
+
+//! the depth time stamps are stored after the depth frames; they are read upfront (by seeking over the frames) so that frames can be streamed out
+std::vector<UINT64> readDepthTimeStamps(std::ifstream& inDepth, unsigned int numDepthFrames)
 {
-	sens.free();
+	for (unsigned int i = 0; i < numDepthFrames; i++) {
+		uint32_t byteSize;
+		inDepth.read((char*)&byteSize, sizeof(uint32_t));
+		inDepth.seekg(byteSize, std::ios::cur);
+	}
+	std::vector<UINT64> timeStamps(numDepthFrames);
+	for (unsigned int i = 0; i < numDepthFrames; i++) {
+		double timeStampDouble;
+		inDepth.read((char*)&timeStampDouble, sizeof(double));
+		timeStamps[i] = timeToUINT64(timeStampDouble);
+	}
+	if (!inDepth.good()) throw MLIB_EXCEPTION("depth file is truncated");
+	inDepth.seekg(0);
+	return timeStamps;
+}
+
+//! decodes a depth frame into depth (in mm, invalid values set to 0)
+void decodeDepth(const RawFrame& f, unsigned short* depth, unsigned int numPixels)
+{
+	uplinksimple::decode((unsigned char*)f.depthCompressed.data(), (unsigned int)f.depthCompressed.size(), numPixels, depth);
+	uplinksimple::shift2depth(depth, numPixels);
+
+	//check for invalid values
+	const unsigned short maxDepth = uplinksimple::shift2depth(0xffff);
+	for (unsigned int i = 0; i < numPixels; i++) {
+		if (depth[i] >= maxDepth) {
+			depth[i] = 0;
+		}
+	}
+}
+
+
+//! converts a ScannerApp capture to a .sens file; the frames are streamed through a pipeline:
+//! reader (compressed depth + color file names) -> decode workers (depth and color png) -> LiveSensorDataWriter (compression on its own threads, writes in frame order)
+//! returns the number of frames written
+unsigned int convertToSens(const std::string& baseFilename, const std::string& outSensFilename)
+{
+	ml::SensorData sens;	//header and IMU frames only; the RGBD frames go directly to the file
 
 	const std::string srcFileMeta = ml::util::removeExtensions(baseFilename) + ".txt";
 	const std::string srcFileDepth = ml::util::removeExtensions(baseFilename) + ".depth";
@@ -68,73 +158,7 @@ void convertToSens(const std::string& baseFilename, ml::SensorData& sens)
 		MLIB_WARNING("frame counts are different:numColorImages(" + std::to_string(numColorFrames) + ") meta.numDepthImages(" + std::to_string(meta.numDepthFrames) + ") meta.numColorImages(" + std::to_string(meta.numColorFrames) + ")");
 	}
 
-	unsigned int frame = 0;
-	ml::SensorData::StringCounter scColor(tmpDir + "/" + baseNameColor, "color.png", 6);	scColor.getNext();
-
-	while (frame < numFrames) {
-		assert(inDepth.good());
-
-		//ml::Timer t;
-		uint32_t byteSize;
-		inDepth.read((char*)&byteSize, sizeof(uint32_t));
-		char* depthCompressed = new char[byteSize];
-		inDepth.read((char*)depthCompressed, byteSize);
-
-		const unsigned int depthWidth = meta.depthWidth;
-		const unsigned int depthHeight = meta.depthHeight;
-
-		unsigned short* depth = (unsigned short*)std::malloc(depthWidth*depthHeight * 2);
-
-		uplinksimple::decode((unsigned char*)depthCompressed, (unsigned int)byteSize, depthWidth*depthHeight, depth);
-		uplinksimple::shift2depth(depth, depthWidth*depthHeight);
-
-		//check for invalid values
-		for (unsigned int i = 0; i < depthWidth*depthHeight; i++) {
-			if (depth[i] >= uplinksimple::shift2depth(0xffff)) {
-				depth[i] = 0;
-			}
-		} 
-
-		SAFE_DELETE(depthCompressed);
-
-		std::string colorFile = scColor.getNext();
-		ml::ColorImageR8G8B8 cImage;
-		ml::FreeImageWrapper::loadImage(colorFile, cImage);
-		
-		sens.addFrame(cImage.getData(), depth);
-
-		std::free(depth);
-		std::cout << "\rframe " << frame << ": read " << byteSize << " [bytes] ";
-		frame++;
-
-		//std::cout << t.getElapsedTimeMS() << " [ms]" << std::endl << std::endl;
-	}
-
-	//read the rest of the depth frames
-	for (; frame < meta.numDepthFrames; frame++) {
-		assert(inDepth.good());
-		uint32_t byteSize;
-		inDepth.read((char*)&byteSize, sizeof(uint32_t));
-		char* depthCompressed = new char[byteSize];
-		inDepth.read((char*)depthCompressed, byteSize);
-		SAFE_DELETE_ARRAY(depthCompressed);
-	}
-
-
-	for (unsigned int i = 0; i < meta.numDepthFrames; i++) {
-		//TODO read time stamps here
-		double timeStampDouble;
-		inDepth.read((char*)&timeStampDouble, sizeof(double));
-		UINT64 timeStamp = timeToUINT64(timeStampDouble);
-		 
-		if (i < (unsigned int)sens.m_frames.size()) {
-			sens.m_frames[i].setTimeStampColor(timeStamp);
-			sens.m_frames[i].setTimeStampDepth(timeStamp);
-		}
-
-		//std::cout << timeStamp << std::endl;
-		//std::cout << std::setprecision(20) << timeStampDouble << std::endl;
-	}
+	std::vector<UINT64> timeStamps = readDepthTimeStamps(inDepth, meta.numDepthFrames);
 
 
 	std::ifstream inIMU(srcFileIMU, std::ios::binary);
@@ -158,24 +182,100 @@ void convertToSens(const std::string& baseFilename, ml::SensorData& sens)
 	}
 	inIMU.close();
 
-	std::cout << std::endl; 
-
-	//for (size_t i = 0; i < sens.m_frames.size(); i++) {
-	//	const ml::SensorData::IMUFrame& f = sens.findClosestIMUFrame(i);
-	//	std::cout << "frame time: " << sens.m_frames[i].getTimeStampColor() << "\t imu time: " << f.timeStamp << std::endl;
-	//}
-	 
-	for (size_t i = 0; i < sens.m_frames.size(); i++) {
-		const ml::mat4f& t = sens.m_frames[i].getCameraToWorld();
-		const ml::mat4f id = ml::mat4f::identity();
-		for (unsigned int i = 0; i < 16; i++) {
-			if (t[i] != id[i]) throw MLIB_EXCEPTION("matrix needs to be the identity");
+
+	const unsigned int numThreads = std::max(1u, std::thread::hardware_concurrency());
+	const unsigned int depthWidth = meta.depthWidth;
+	const unsigned int depthHeight = meta.depthHeight;
+	const unsigned int colorWidth = meta.colorWidth;
+	const unsigned int colorHeight = meta.colorHeight;
+
+	//the writer compresses on numThreads threads; at most cacheSize decoded frames are held in memory
+	ml::SensorData::LiveSensorDataWriter writer(&sens, outSensFilename, true, 4 * numThreads, numThreads);
+	RawFrameQueue queue(2 * numThreads);
+
+	std::mutex mutex;
+	std::exception_ptr exception;
+	const auto setException = [&](std::exception_ptr e) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!exception) exception = e;
+		}
+		queue.close(true);
+		writer.abort(e);	//workers waiting for a frame that will never arrive
+	};
+
+	//decode workers: depth (uplinksimple) and color (png); buffers are handed over to (and freed by) the writer
+	std::vector<std::thread> workers;
+	for (unsigned int t = 0; t < numThreads; t++) {
+		workers.push_back(std::thread([&] {
+			RawFrame f;
+			while (queue.pop(f)) {
+				unsigned short* depth = nullptr;
+				unsigned char* color = nullptr;
+				try {
+					depth = (unsigned short*)std::malloc(sizeof(unsigned short)*depthWidth*depthHeight);
+					if (!depth) throw MLIB_EXCEPTION("out of memory");
+					decodeDepth(f, depth, depthWidth*depthHeight);
+
+					int width, height;
+					color = stb::stbi_load(f.colorFile.c_str(), &width, &height, NULL, 3);
+					if (!color) throw MLIB_EXCEPTION("could not load " + f.colorFile);
+					if (width != (int)colorWidth || height != (int)colorHeight) throw MLIB_EXCEPTION("unexpected image size of " + f.colorFile);
+
+					const UINT64 timeStamp = timeStamps[f.frameIdx];
+					ml::vec3uc* colorFrame = (ml::vec3uc*)color;
+					unsigned short* depthFrame = depth;
+					color = nullptr;	depth = nullptr;	//owned by the writer from here on
+					writer.writeFrameAndFree(f.frameIdx, colorFrame, depthFrame, ml::mat4f::identity(), timeStamp, timeStamp);
+				}
+				catch (...) {
+					std::free(depth);
+					std::free(color);
+					setException(std::current_exception());
+				}
+			}
+		}));
+	}
+
+	//reader: compressed depth frames in file order
+	ml::SensorData::StringCounter scColor(tmpDir + "/" + baseNameColor, "color.png", 6);	scColor.getNext();
+	for (unsigned int frame = 0; frame < numFrames; frame++) {
+		RawFrame f;
+		f.frameIdx = frame;
+		uint32_t byteSize;
+		inDepth.read((char*)&byteSize, sizeof(uint32_t));
+		f.depthCompressed.resize(byteSize);
+		inDepth.read(f.depthCompressed.data(), byteSize);
+		if (!inDepth.good()) {
+			setException(std::make_exception_ptr(MLIB_EXCEPTION("depth file is truncated")));
+			break;
 		}
-		
-		//std::cout << sens.m_frames[i].getCameraToWorld() << std::endl;
+		f.colorFile = scColor.getNext();
+		if (!queue.push(f)) break;
+		std::cout << "\rframe " << frame << ": read " << byteSize << " [bytes] ";
 	}
+	queue.close();
+	for (auto& t : workers) t.join();
+	std::cout << std::endl;
 
 	ml::util::deleteDirectory(tmpDir);
+	if (!exception) {
+		try {
+			writer.close();
+		}
+		catch (...) {
+			exception = std::current_exception();
+		}
+	}
+	if (exception) {
+		try {
+			writer.close();
+		}
+		catch (...) {}
+		std::remove(outSensFilename.c_str());	//don't leave a partial file behind (it would be skipped next time)
+		std::rethrow_exception(exception);
+	}
+	return numFrames;
 }
 
 void processStagingFolder(std::string stagingFolder, const std::string& outSensFilename, bool forceOverwrite = false)
@@ -196,10 +296,8 @@ void processStagingFolder(std::string stagingFolder, const std::string& outSensF
 		return;
 	}
 
-	ml::SensorData sd;
-	convertToSens(baseFile, sd);
-	sd.saveToFile(outSensFilename);
-	std::cout << sd << std::endl;
+	const unsigned int numFrames = convertToSens(baseFile, outSensFilename);
+	std::cout << "wrote " << numFrames << " frames to " << outSensFilename << std::endl;
 
 }
 
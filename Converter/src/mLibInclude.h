@@ -8,5 +8,8 @@
 #include "mLibLodePNG.h"
 //#include "mLibZLib.h"
 #include "mLibFreeImage.h"	//This has to come after OpenMesh otherwise there is a crash
+#include "../../SensReader/c++/src/sensorDataMLib.h"	//LiveSensorDataWriter with worker threads and writeFrameAndFree
 #include "mLibDepthCamera.h"
+#include "../../ScannerApp/depth2pgm/uplinksimple_image-codecs.h"	//uplinksimple::decode (table-driven) for the raw .depth frames
+#include "../../ScannerApp/depth2pgm/uplinksimple_shift2depth.h"
  
\ No newline at end of file
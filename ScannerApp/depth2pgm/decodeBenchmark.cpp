@@ -0,0 +1,96 @@
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "uplinksimple_image-codecs.h"
+
+// Compares uplinksimple::decode against the reference decoder uplinksimple::decode_bitwise:
+// checks that both produce the same output and reports the throughput of each.
+//
+// Usage: decodeBenchmark [path/to/file.depth numDepthFrames]
+// (without a .depth file, synthetic frames are encoded with uplinksimple::encode)
+
+typedef std::vector<uint8_t> Frame;
+
+std::vector<Frame> readFrames(const std::string& depthFile, size_t numDepthFrames) {
+  std::vector<Frame> frames;
+  std::ifstream inDepth(depthFile, std::ios::binary);
+  for (size_t i = 0; i < numDepthFrames && inDepth.good(); i++) {
+    uint32_t byteSize = 0;
+    inDepth.read((char*)&byteSize, sizeof(uint32_t));
+    if (!inDepth.good()) break;
+    Frame frame(byteSize);
+    inDepth.read((char*)frame.data(), byteSize);
+    frames.push_back(frame);
+  }
+  return frames;
+}
+
+// smooth surfaces with sensor noise and holes (shift values as produced by the sensor)
+std::vector<Frame> makeFrames(size_t numDepthFrames, size_t depthWidth, size_t depthHeight) {
+  std::vector<Frame> frames;
+  std::mt19937 rng(0);
+  std::normal_distribution<float> noise(0.0f, 0.6f);
+  std::vector<uint16_t> shift(depthWidth * depthHeight);
+  Frame buffer(depthWidth * depthHeight * 4);
+  for (size_t f = 0; f < numDepthFrames; f++) {
+    for (size_t y = 0; y < depthHeight; y++) {
+      for (size_t x = 0; x < depthWidth; x++) {
+        float s = 900.0f + 60.0f * std::sin((x + 4 * f) / 70.0f) + 40.0f * std::cos(y / 90.0f) + (x > 300 && x < 380 ? 150.0f : 0.0f);
+        bool hole = x < 10 || ((x / 24 + y / 24 + f) % 19 == 0);
+        shift[y * depthWidth + x] = hole ? 2047 : (uint16_t)(s + noise(rng));
+      }
+    }
+    uint32_t byteSize = uplinksimple::encode(shift.data(), (int)shift.size(), buffer.data(), (uint32_t)buffer.size());
+    frames.push_back(Frame(buffer.begin(), buffer.begin() + byteSize));
+  }
+  return frames;
+}
+
+template<class DecodeFunc>
+double benchmark(const std::vector<Frame>& frames, size_t numPixels, std::vector<uint16_t>& output, DecodeFunc decode, int numRepetitions) {
+  auto start = std::chrono::high_resolution_clock::now();
+  for (int r = 0; r < numRepetitions; r++) {
+    for (size_t i = 0; i < frames.size(); i++) {
+      decode(frames[i].data(), (unsigned int)frames[i].size(), (int)numPixels, output.data() + i * numPixels);
+    }
+  }
+  return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count() / numRepetitions;
+}
+
+int main(int argc, char* argv[]) {
+  const size_t depthWidth = 640, depthHeight = 480, numPixels = depthWidth * depthHeight;
+  std::vector<Frame> frames;
+  if (argc >= 2) {
+    frames = readFrames(argv[1], argc >= 3 ? std::atoi(argv[2]) : 100);
+  } else {
+    frames = makeFrames(100, depthWidth, depthHeight);
+  }
+  if (frames.empty()) {
+    std::cerr << "no depth frames" << std::endl;
+    return 1;
+  }
+
+  size_t compressedBytes = 0;
+  for (const auto& f : frames) compressedBytes += f.size();
+  std::cout << frames.size() << " frames, " << compressedBytes / frames.size() << " bytes/frame (compressed)" << std::endl;
+
+  std::vector<uint16_t> reference(frames.size() * numPixels), output(frames.size() * numPixels);
+  const int numRepetitions = 5;
+  double timeReference = benchmark(frames, numPixels, reference, uplinksimple::decode_bitwise, numRepetitions);
+  double timeDecode = benchmark(frames, numPixels, output, uplinksimple::decode, numRepetitions);
+
+  if (reference != output) {
+    std::cerr << "ERROR: decode and decode_bitwise differ" << std::endl;
+    return 1;
+  }
+
+  const double mpix = (double)frames.size() * numPixels / 1e6;
+  std::cout << "decode_bitwise: " << 1000.0 * timeReference / frames.size() << " ms/frame, " << mpix / timeReference << " MPixel/s" << std::endl;
+  std::cout << "decode:         " << 1000.0 * timeDecode / frames.size() << " ms/frame, " << mpix / timeDecode << " MPixel/s" << std::endl;
+  std::cout << "speedup:        " << timeReference / timeDecode << "x (outputs are identical)" << std::endl;
+  return 0;
+}
@@ -16,6 +16,9 @@
 # include <cstdlib>
 # include <cstdio>
 # include <cstring>
+# if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  include <emmintrin.h>
+# endif
 
 # define BITSTREAM_SUCCESS 1
 # define BITSTREAM_FAILURE 0
@@ -177,7 +180,8 @@ namespace uplinksimple {
 // 01101 - Next value is last value + 2.
 // 01100 - Next value is last value - 2.
 
-	inline uint16_t * decode(const uint8_t * bitstream_data, unsigned int bitstream_length_bytes, int numelements, uint16_t* output)
+	//! reference decoder (one bs_get per bit/field); decode() below produces the same output
+	inline uint16_t * decode_bitwise(const uint8_t * bitstream_data, unsigned int bitstream_length_bytes, int numelements, uint16_t* output)
 {
 
     uint16_t lastVal = 0;
@@ -280,6 +284,169 @@ namespace uplinksimple {
 
 //------------------------------------------------------------------------------
 
+// Table-driven decoder: the bitstream is read through a 64-bit buffer and the next 12 bits are resolved by a
+// lookup table into up to 6 pixels of the short codes (00, 11, 10, 0110x) at once; runs (010) and resets (0111)
+// are decoded directly from the buffer.
+
+struct DecodeTableEntry {
+    uint8_t numValues;      // pixels decoded by this entry (0: the next code is a run or a reset)
+    uint8_t numBits;        // bits consumed by all numValues codes
+    uint8_t firstBits;      // bits consumed by the first code only
+    int8_t  delta[6];       // value of pixel k relative to the last value
+};
+
+struct DecodeTable {
+    static const int LOOKUP_BITS = 12;
+    DecodeTableEntry entries[1 << LOOKUP_BITS];
+
+    DecodeTable() {
+        for (int idx = 0; idx < (1 << LOOKUP_BITS); idx++) {
+            DecodeTableEntry& e = entries[idx];
+            memset(&e, 0, sizeof(DecodeTableEntry));
+            int pos = 0;            // bits parsed so far
+            int value = 0;
+            while (e.numValues < 6) {
+                const int left = LOOKUP_BITS - pos;
+                if (left < 2) break;
+                const int b2 = (idx >> (left - 2)) & 0x3;
+                int len = 0, delta = 0;
+                if (b2 == 0) { len = 2; delta = 0; }
+                else if (b2 == 3) { len = 2; delta = 1; }
+                else if (b2 == 2) { len = 2; delta = -1; }
+                else {
+                    if (left < 5) break;
+                    const int b5 = (idx >> (left - 5)) & 0x1f;
+                    if ((b5 >> 1) == 0x6) { len = 5; delta = (b5 & 1) ? 2 : -2; }    // 0110x
+                    else break;                                                     // 010 or 0111
+                }
+                value += delta;
+                e.delta[e.numValues] = (int8_t)value;
+                if (e.numValues == 0) e.firstBits = (uint8_t)len;
+                e.numValues++;
+                pos += len;
+            }
+            e.numBits = (uint8_t)pos;
+        }
+    }
+
+    static const DecodeTable& get() {
+        static const DecodeTable table;
+        return table;
+    }
+};
+
+// MSB-first bit reader; reads zeros past the end of the stream
+struct BitReader64 {
+    const uint8_t* pos;
+    const uint8_t* end;
+    uint64_t buf;           // valid bits are aligned to the most significant bit
+    unsigned int bits;
+
+    BitReader64(const uint8_t* data, unsigned int length) : pos(data), end(data + length), buf(0), bits(0) {}
+
+    // makes at least 56 bits available
+    inline void refill() {
+        if (end - pos >= 8) {
+            uint64_t x;
+            memcpy(&x, pos, sizeof(uint64_t));
+#if defined(_MSC_VER)
+            x = _byteswap_uint64(x);
+#else
+            x = __builtin_bswap64(x);
+#endif
+            buf |= x >> bits;
+            pos += (63 - bits) >> 3;
+            bits |= 56;
+        }
+        else {
+            while (bits <= 56) {
+                const uint64_t byte = pos < end ? *pos++ : 0;
+                buf |= byte << (56 - bits);
+                bits += 8;
+            }
+        }
+    }
+    inline uint32_t peek(unsigned int n) const {
+        return (uint32_t)(buf >> (64 - n));
+    }
+    inline void consume(unsigned int n) {
+        buf <<= n;
+        bits -= n;
+    }
+};
+
+inline void fill_run(uint16_t* out, int n, uint16_t value)
+{
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    const __m128i v = _mm_set1_epi16((short)value);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) _mm_storeu_si128((__m128i*)(out + i), v);
+    for (; i < n; i++) out[i] = value;
+#else
+    for (int i = 0; i < n; i++) out[i] = value;
+#endif
+}
+
+inline uint16_t * decode(const uint8_t * bitstream_data, unsigned int bitstream_length_bytes, int numelements, uint16_t* output)
+{
+    const DecodeTable& table = DecodeTable::get();
+
+    uint16_t * depthimage = 0 == output
+        ? (uint16_t*)malloc(numelements * sizeof(uint16_t))
+        : output
+        ;
+
+    uint16_t * depth_ptr = depthimage;
+    uint16_t lastVal = 0;
+
+    BitReader64 bs(bitstream_data, bitstream_length_bytes);
+
+    while (numelements > 0)
+    {
+        if (bs.bits < 32) bs.refill();
+
+        const DecodeTableEntry& e = table.entries[bs.peek(DecodeTable::LOOKUP_BITS)];
+
+        if (e.numValues != 0 && numelements >= 8)
+        {
+            // writes all 6 slots; the ones beyond numValues are overwritten by the following codes
+            for (int k = 0; k < 6; k++) depth_ptr[k] = (uint16_t)(lastVal + e.delta[k]);
+            lastVal = depth_ptr[e.numValues - 1];
+            depth_ptr += e.numValues;
+            numelements -= e.numValues;
+            bs.consume(e.numBits);
+        }
+        else if (e.numValues != 0)
+        {
+            // close to the end: one code at a time
+            lastVal = (uint16_t)(lastVal + e.delta[0]);
+            *(depth_ptr++) = lastVal;
+            numelements -= 1;
+            bs.consume(e.firstBits);
+        }
+        else if (bs.peek(3) == 0x2) // 010 --> multiple zeros!
+        {
+            int numZeros = (int)(bs.peek(8) & 0x1f) + 5; // We never encode less than 5.
+            if (numZeros > numelements) numZeros = numelements;
+            fill_run(depth_ptr, numZeros, lastVal);
+            depth_ptr += numZeros;
+            numelements -= numZeros;
+            bs.consume(8);
+        }
+        else // 0111 -- RESET!
+        {
+            lastVal = (uint16_t)(bs.peek(15) & 0x7ff); // 11 bits total.
+            *(depth_ptr++) = lastVal;
+            numelements -= 1;
+            bs.consume(15);
+        }
+    }
+
+    return depthimage;
+}
+
+//------------------------------------------------------------------------------
+
 inline uint32_t encode(const uint16_t * data_in, int numelements,
                                   uint8_t* out_buffer, uint32_t out_buffer_size)
 {
@@ -1,13 +1,24 @@
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cmath>
+#include <cstring>
 #include <iostream>
+#include <mutex>
 #include <fstream>
+#include <sstream>
+#include <thread>
 #include <vector>
 #include <unordered_set>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #define TINYOBJLOADER_IMPLEMENTATION
 #include "tiny_obj_loader.h"
 #include "tinyply.h"
+#include "segsIO.h"
 
 using std::vector;
 using std::string;
@@ -68,14 +79,66 @@ bool operator<(const edge &a, const edge &b) {
   return a.w < b.w;
 }
 
-universe *segment_graph(int num_vertices, int num_edges, edge *edges, float c) { 
-  std::sort(edges, edges + num_edges);  // sort edges by weight
+// maps a float to an unsigned key with the same order (negative values and -0 before +0)
+inline uint32_t sort_key(float w) {
+  uint32_t u;
+  memcpy(&u, &w, sizeof(u));
+  return (u & 0x80000000u) ? ~u : (u | 0x80000000u);
+}
+
+// stable parallel LSD radix sort of the edges by weight (4 passes of 8 bits; edges of equal weight keep their order); tmp is scratch space
+void sort_edges(edge *edges, int num_edges, vector<edge>& tmp) {
+  int num_chunks = 1;
+#ifdef _OPENMP
+  num_chunks = omp_get_max_threads();
+#endif
+  tmp.resize(num_edges);
+  vector<int> offsets(num_chunks * 256);
+  edge *src = edges;
+  edge *dst = tmp.data();
+  for (int shift = 0; shift < 32; shift += 8) {
+    std::fill(offsets.begin(), offsets.end(), 0);
+    // per chunk histograms of the current digit
+    #pragma omp parallel for schedule(static, 1)
+    for (int t = 0; t < num_chunks; t++) {
+      const int begin = (int)((long long)num_edges * t / num_chunks);
+      const int end = (int)((long long)num_edges * (t + 1) / num_chunks);
+      int *counts = &offsets[t * 256];
+      for (int i = begin; i < end; i++) {
+        counts[(sort_key(src[i].w) >> shift) & 0xff]++;
+      }
+    }
+    // exclusive prefix sum in (digit, chunk) order keeps the sort stable
+    int sum = 0;
+    for (int d = 0; d < 256; d++) {
+      for (int t = 0; t < num_chunks; t++) {
+        const int count = offsets[t * 256 + d];
+        offsets[t * 256 + d] = sum;
+        sum += count;
+      }
+    }
+    #pragma omp parallel for schedule(static, 1)
+    for (int t = 0; t < num_chunks; t++) {
+      const int begin = (int)((long long)num_edges * t / num_chunks);
+      const int end = (int)((long long)num_edges * (t + 1) / num_chunks);
+      int *pos = &offsets[t * 256];
+      for (int i = begin; i < end; i++) {
+        dst[pos[(sort_key(src[i].w) >> shift) & 0xff]++] = src[i];
+      }
+    }
+    std::swap(src, dst);
+  }
+  // even number of passes: the result is back in edges
+}
+
+// edges must be sorted by weight
+universe *segment_sorted_graph(int num_vertices, int num_edges, const edge *edges, float c) {
   universe *u = new universe(num_vertices);  // make a disjoint-set forest
   float *threshold = new float[num_vertices];
   for (int i = 0; i < num_vertices; i++) { threshold[i] = c; }
   // for each edge, in non-decreasing weight order
   for (int i = 0; i < num_edges; i++) {
-    edge *pedge = &edges[i];
+    const edge *pedge = &edges[i];
     // components conected by this edge
     int a = u->find(pedge->a);
     int b = u->find(pedge->b);
@@ -91,6 +154,31 @@ universe *segment_graph(int num_vertices, int num_edges, edge *edges, float c) {
   return u;
 }
 
+universe *segment_graph(int num_vertices, int num_edges, edge *edges, float c) { 
+  std::sort(edges, edges + num_edges);  // sort edges by weight
+  return segment_sorted_graph(num_vertices, num_edges, edges, c);
+}
+
+// joins segments smaller than min_size with their neighbors (edges sorted by weight)
+void join_small_segments(universe *u, int num_edges, const edge *edges, int min_size) {
+  for (int j = 0; j < num_edges; j++) {
+    int a = u->find(edges[j].a);
+    int b = u->find(edges[j].b);
+    if ((a != b) && ((u->size(a) < min_size) || (u->size(b) < min_size))) {
+      u->join(a, b);
+    }
+  }
+}
+
+// segment index (representative vertex) per vertex
+vector<int> get_components(universe *u, int num_vertices) {
+  vector<int> comps(num_vertices);
+  for (int q = 0; q < num_vertices; q++) {
+    comps[q] = u->find(q);
+  }
+  return comps;
+}
+
 // simple vec3f class
 class vec3f {
  public:
@@ -120,16 +208,47 @@ inline bool ends_with(const std::string & value, const std::string& ending) {
   return std::equal(ending.rbegin(), ending.rend(), value.rbegin());
 }
 
-vector<int> segment(const string& meshFile, const float kthr, const int segMinVerts) {
-  //std::cout << "Loading mesh " << meshFile << std::endl;
+// mesh connectivity graph with edges sorted by weight; independent of the segmentation parameters,
+// so it is built once per mesh and shared by all segmentations of a sweep
+struct mesh_graph {
+  int num_vertices;
+  vector<edge> edges;
+};
+
+// scratch buffers of build_graph; batch mode reuses them across meshes so the large per-mesh arrays are not
+// reallocated (and page-faulted in) for every mesh
+struct graph_buffers {
   vector<float> verts;
   vector<uint32_t> faces;
+  vector<vec3f> points;
+  vector<vec3f> normals;
+  vector<vec3f> faceNormals;
+  vector<int> csrStart;  // vertex -> faces, then vertex -> edges
+  vector<int> csrEntries;
+  vector<int> csrPos;
+  vector<char> duplicate;
+  vector<edge> sortTmp;
+};
+
+// returns false if the mesh cannot be loaded. Edges of equal weight are ordered by std::sort as in earlier versions,
+// so segment ids match existing segmentations (e.g. those referenced by annotations); with stableOrder they are kept
+// in mesh order (faces, then the edges of each face) by a parallel radix sort, independent of the standard library
+bool build_graph(const string& meshFile, mesh_graph& graph, graph_buffers& buffers, bool verbose = true, bool stableOrder = false) {
+  //std::cout << "Loading mesh " << meshFile << std::endl;
+  vector<float>& verts = buffers.verts;
+  vector<uint32_t>& faces = buffers.faces;
+  verts.clear();
+  faces.clear();
   size_t vertexCount = 0;
   size_t faceCount = 0;
 
   if (ends_with(meshFile, ".ply") || ends_with(meshFile, ".PLY")) {
     // Load the geometry from .ply
     std::ifstream ss(meshFile, std::ios::binary);
+    if (!ss) {
+      std::cerr << "Could not open " << meshFile << std::endl;
+      return false;
+    }
     tinyply::PlyFile file(ss);
     vertexCount = file.request_properties_from_element("vertex", { "x", "y", "z" }, verts);
     // Try getting vertex_indices or vertex_index
@@ -148,8 +267,8 @@ vector<int> segment(const string& meshFile, const float kthr, const int segMinVe
     if (!err.empty()) { // `err` may contain warning message.
       std::cerr << err << std::endl;
     }
-    if (!ret) {
-      exit(1);
+    if (!ret || shapes.empty()) {
+      return false;
     }
     if (shapes.size() > 1) {
       std::cerr << "Warning: only single mesh OBJ supported, segmenting first mesh" << std::endl;
@@ -169,46 +288,77 @@ vector<int> segment(const string& meshFile, const float kthr, const int segMinVe
         faces.push_back(idx);
       }
     }
+  } else {
+    std::cerr << "Unsupported mesh format: " << meshFile << std::endl;
+    return false;
   }
 
-  printf("Read mesh with vertexCount %lu %lu, faceCount %lu %lu\n", 
-    vertexCount, verts.size(), faceCount, faces.size());
+  if (verbose) {
+    printf("Read mesh with vertexCount %lu %lu, faceCount %lu %lu\n", 
+      vertexCount, verts.size(), faceCount, faces.size());
+  }
 
-  // create points, normals, edges, counts vectors
-  vector<vec3f> points(vertexCount);
-  vector<vec3f> normals(vertexCount);
-  vector<int> counts(verts.size(), 0);
-  const size_t edgesCount = faceCount*3;
-  edge* edges = new edge[edgesCount];
+  // create points, normals, edges vectors
+  vector<vec3f>& points = buffers.points;
+  vector<vec3f>& normals = buffers.normals;
+  points.resize(vertexCount);
+  normals.resize(vertexCount);
+  size_t edgesCount = faceCount*3;
+  graph.edges.resize(edgesCount);
+  edge* edges = graph.edges.data();
 
-  // Compute face normals and smooth into vertex normals
-  for (int i = 0; i < faceCount; i++) {
+  #pragma omp parallel for
+  for (int i = 0; i < (int)vertexCount; i++) {
+    points[i] = vec3f(verts[3*i], verts[3*i+1], verts[3*i+2]);
+  }
+
+  // Compute face normals and mesh edges
+  vector<vec3f>& faceNormals = buffers.faceNormals;
+  faceNormals.resize(faceCount);
+  #pragma omp parallel for
+  for (int i = 0; i < (int)faceCount; i++) {
     const int fbase = 3*i;
     const uint32_t i1 = faces[fbase];
     const uint32_t i2 = faces[fbase+1];
     const uint32_t i3 = faces[fbase+2];
-    int vbase = 3*i1;
-    vec3f p1(verts[vbase], verts[vbase+1], verts[vbase+2]);
-    vbase = 3*i2;
-    vec3f p2(verts[vbase], verts[vbase+1], verts[vbase+2]);
-    vbase = 3*i3;
-    vec3f p3(verts[vbase], verts[vbase+1], verts[vbase+2]);
-    points[i1] = p1;  points[i2] = p2;  points[i3] = p3;
     const int ebase = 3*i;
     edges[ebase  ].a = i1;  edges[ebase  ].b = i2;
     edges[ebase+1].a = i1;  edges[ebase+1].b = i3;
     edges[ebase+2].a = i3;  edges[ebase+2].b = i2;
+    faceNormals[i] = cross(points[i2] - points[i1], points[i3] - points[i1]);
+  }
 
-    // smoothly blend face normals into vertex normals
-    vec3f normal = cross(p2 - p1, p3 - p1);
-    normals[i1] = lerp(normals[i1], normal, 1.0f / (counts[i1] + 1.0f));
-    normals[i2] = lerp(normals[i2], normal, 1.0f / (counts[i2] + 1.0f));
-    normals[i3] = lerp(normals[i3], normal, 1.0f / (counts[i3] + 1.0f));
-    counts[i1]++; counts[i2]++; counts[i3]++;
+  // incident faces per vertex in face order (CSR)
+  vector<int>& vertFacesStart = buffers.csrStart;
+  vector<int>& vertFaces = buffers.csrEntries;
+  vertFacesStart.assign(vertexCount + 1, 0);
+  vertFaces.resize(faceCount*3);
+  for (size_t i = 0; i < faceCount*3; i++) { vertFacesStart[faces[i] + 1]++; }
+  for (size_t v = 0; v < vertexCount; v++) { vertFacesStart[v + 1] += vertFacesStart[v]; }
+  {
+    vector<int>& pos = buffers.csrPos;
+    pos.assign(vertFacesStart.begin(), vertFacesStart.end() - 1);
+    for (size_t i = 0; i < faceCount*3; i++) { vertFaces[pos[faces[i]]++] = (int)(i / 3); }
+  }
+
+  // smoothly blend face normals into vertex normals (running average in face order, as if accumulated face by face)
+  #pragma omp parallel for
+  for (int v = 0; v < (int)vertexCount; v++) {
+    vec3f normal;
+    int count = 0;          // face corners blended so far
+    int cornersBefore = 0;  // face corners blended before the current face
+    for (int k = vertFacesStart[v]; k < vertFacesStart[v + 1]; k++) {
+      // a degenerate face referencing v more than once is blended with the same weight each time
+      if (k == vertFacesStart[v] || vertFaces[k - 1] != vertFaces[k]) { cornersBefore = count; }
+      normal = lerp(normal, faceNormals[vertFaces[k]], 1.0f / (cornersBefore + 1.0f));
+      count++;
+    }
+    normals[v] = normal;
   }
 
   //std::cout << "Constructing edge graph based on mesh connectivity..." << std::endl;
-  for (int i = 0; i < edgesCount; i++) {
+  #pragma omp parallel for
+  for (int i = 0; i < (int)edgesCount; i++) {
     int a = edges[i].a;
     int b = edges[i].b;
 
@@ -227,63 +377,513 @@ vector<int> segment(const string& meshFile, const float kthr, const int segMinVe
     if (dot2 > 0) { ww = ww * ww; } // make it much less of a problem if convex regions have normal difference
     edges[i].w = ww;
   }
+
+  // Remove duplicate edges (interior edges are shared by two faces). Only copies with the same weight are
+  // dropped: the weight depends on the edge direction, and a copy with a different weight is a separate
+  // merge candidate for segment_graph, so removing it would change the segmentation. A dropped copy directly
+  // follows the kept one among the edges of its weight in mesh order, where it could not merge anything;
+  // with std::sort it may come first, and the edge direction decides the segment ids, so all copies are kept.
+  if (stableOrder) {
+    // edges grouped by their smaller vertex, in edge order (CSR)
+    vector<int>& vertEdgesStart = buffers.csrStart;
+    vector<int>& vertEdges = buffers.csrEntries;
+    vertEdgesStart.assign(vertexCount + 1, 0);
+    vertEdges.resize(edgesCount);
+    for (size_t i = 0; i < edgesCount; i++) { vertEdgesStart[std::min(edges[i].a, edges[i].b) + 1]++; }
+    for (size_t v = 0; v < vertexCount; v++) { vertEdgesStart[v + 1] += vertEdgesStart[v]; }
+    {
+      vector<int>& pos = buffers.csrPos;
+      pos.assign(vertEdgesStart.begin(), vertEdgesStart.end() - 1);
+      for (size_t i = 0; i < edgesCount; i++) { vertEdges[pos[std::min(edges[i].a, edges[i].b)]++] = (int)i; }
+    }
+    vector<char>& duplicate = buffers.duplicate;
+    duplicate.assign(edgesCount, 0);
+    #pragma omp parallel for schedule(dynamic, 1024)
+    for (int v = 0; v < (int)vertexCount; v++) {
+      for (int k = vertEdgesStart[v]; k < vertEdgesStart[v + 1]; k++) {
+        const edge& e = edges[vertEdges[k]];
+        const int other = std::max(e.a, e.b);
+        for (int j = vertEdgesStart[v]; j < k; j++) {
+          const edge& f = edges[vertEdges[j]];
+          if (std::max(f.a, f.b) == other && sort_key(f.w) == sort_key(e.w)) {
+            duplicate[vertEdges[k]] = 1;
+            break;
+          }
+        }
+      }
+    }
+    size_t numUnique = 0;
+    for (size_t i = 0; i < edgesCount; i++) {
+      if (!duplicate[i]) { edges[numUnique++] = edges[i]; }
+    }
+    edgesCount = numUnique;
+  }
+  graph.edges.resize(edgesCount);
+  graph.num_vertices = (int)vertexCount;
+  // sort edges by weight
+  if (stableOrder) {
+    sort_edges(graph.edges.data(), (int)edgesCount, buffers.sortTmp);
+  } else {
+    std::sort(graph.edges.begin(), graph.edges.end());
+  }
   //std::cout << "Constructed graph" << std::endl;
+  return true;
+}
 
+bool build_graph(const string& meshFile, mesh_graph& graph) {
+  graph_buffers buffers;
+  return build_graph(meshFile, graph, buffers);
+}
+
+vector<int> segment(const mesh_graph& graph, const float kthr, const int segMinVerts) {
   // Segment!
-  universe* u = segment_graph(vertexCount, edgesCount, edges, kthr);
+  const int numEdges = (int)graph.edges.size();
+  universe* u = segment_sorted_graph(graph.num_vertices, numEdges, graph.edges.data(), kthr);
   //std::cout << "Segmented" << std::endl;
 
   // Joining small segments
-  for (int j = 0; j < edgesCount; j++) {
-    int a = u->find(edges[j].a);
-    int b = u->find(edges[j].b);
-    if ((a != b) && ((u->size(a) < segMinVerts) || (u->size(b) < segMinVerts))) {
-      u->join(a, b);
-    }
-  }
+  join_small_segments(u, numEdges, graph.edges.data(), segMinVerts);
 
   // Return segment indices as vector
-  vector<int> outComps(vertexCount);
-  for (int q = 0; q < vertexCount; q++) {
-    outComps[q] = u->find(q);
-  }
+  const vector<int> outComps = get_components(u, graph.num_vertices);
+  delete u;
   return outComps;
 }
 
+vector<int> segment(const string& meshFile, const float kthr, const int segMinVerts) {
+  mesh_graph graph;
+  if (!build_graph(meshFile, graph)) { exit(1); }
+  return segment(graph, kthr, segMinVerts);
+}
+
+// two segments of the previous level (ids as in its segIndices) that merge at kThresh
+typedef struct {
+  int a, b;
+  float kthr;
+} segment_merge;
+
+// nested segmentations for increasing kThresh values: level 0 is the regular segmentation, every further level
+// continues the union-find of the previous one with the larger kThresh (threshold of a segment = its largest
+// internal edge weight + kThresh / size), so segments only merge and form a tree; merges of levels > 0 are recorded
+vector<vector<int> > segment_hierarchy(const mesh_graph& graph, const vector<float>& kthrs, const vector<int>& segMinVerts,
+  vector<segment_merge>& merges) {
+  const int numVertices = graph.num_vertices;
+  const int numEdges = (int)graph.edges.size();
+  const edge* edges = graph.edges.data();
+  universe u(numVertices);
+  vector<float> internal(numVertices, 0.0f);  // largest weight of the edges joined into a segment (at its root)
+  vector<float> threshold(numVertices);
+  vector<vector<int> > levels;
+  for (size_t l = 0; l < kthrs.size(); l++) {
+    const float c = kthrs[l];
+    for (int i = 0; i < numVertices; i++) {
+      if (u.find(i) == i) { threshold[i] = internal[i] + c / u.size(i); }
+    }
+    for (int i = 0; i < numEdges; i++) {
+      int a = u.find(edges[i].a);
+      int b = u.find(edges[i].b);
+      if (a != b && edges[i].w <= threshold[a] && edges[i].w <= threshold[b]) {
+        if (l > 0) { merges.push_back({ a, b, c }); }
+        const float w = std::max(edges[i].w, std::max(internal[a], internal[b]));
+        u.join(a, b);
+        a = u.find(a);
+        internal[a] = w;
+        threshold[a] = w + c / u.size(a);
+      }
+    }
+    for (int i = 0; i < numEdges; i++) {
+      int a = u.find(edges[i].a);
+      int b = u.find(edges[i].b);
+      if ((a != b) && ((u.size(a) < segMinVerts[l]) || (u.size(b) < segMinVerts[l]))) {
+        if (l > 0) { merges.push_back({ a, b, c }); }
+        // forced merge: the edge says nothing about the variation inside the segment
+        const float w = std::max(internal[a], internal[b]);
+        u.join(a, b);
+        internal[u.find(a)] = w;
+      }
+    }
+    levels.push_back(get_components(&u, numVertices));
+  }
+  return levels;
+}
+
 void writeToJSON(const string& filename, const string& scanId,
   const float kthr, const int segMinVerts, const vector<int>& segIndices) {
-  std::ofstream ofs(filename);
+  segs::writeSegsJSON(filename, scanId, kthr, segMinVerts, segIndices);
+}
+
+// all levels of a sweep in one file; merges (segment_hierarchy) are written if given
+void writeLevelsToJSON(const string& filename, const string& scanId, const vector<float>& kthrs,
+  const vector<int>& segMinVerts, const vector<vector<int> >& levels, const vector<segment_merge>* merges) {
+  std::ostringstream ofs;
   ofs << "{";
-  ofs << "\"params\":{\"kThresh\":" << kthr <<  ",\"segMinVerts\":" << segMinVerts << "},";
+  ofs << "\"params\":{\"kThresh\":[";
+  for (size_t l = 0; l < levels.size(); l++) { ofs << (l > 0 ? "," : "") << kthrs[l]; }
+  ofs << "],\"segMinVerts\":[";
+  for (size_t l = 0; l < levels.size(); l++) { ofs << (l > 0 ? "," : "") << segMinVerts[l]; }
+  ofs << "]},";
   ofs << "\"sceneId\":\"" << scanId << "\",";
-  ofs << "\"segIndices\":[";
-  for (int i = 0; i < segIndices.size(); i++) {
-    if (i > 0) { ofs << ","; }
-    ofs << segIndices[i];
+  ofs << "\"levels\":[";
+  string out = ofs.str();
+  for (size_t l = 0; l < levels.size(); l++) {
+    std::ostringstream level;
+    level << (l > 0 ? "," : "") << "{\"kThresh\":" << kthrs[l] << ",\"segMinVerts\":" << segMinVerts[l] << ",\"segIndices\":";
+    out += level.str();
+    segs::appendJSONArray(out, levels[l]);
+    out += "}";
+  }
+  out += "]";
+  if (merges) {
+    std::ostringstream merge;
+    merge << ",\"merges\":[";
+    for (size_t i = 0; i < merges->size(); i++) {
+      if (i > 0) { merge << ","; }
+      merge << "[" << (*merges)[i].a << "," << (*merges)[i].b << "," << (*merges)[i].kthr << "]";
+    }
+    merge << "]";
+    out += merge.str();
+  }
+  out += "}";
+  std::ofstream(filename, std::ios::binary).write(out.data(), out.size());
+}
+
+size_t countSegments(const vector<int>& comps) {
+  std::unordered_set<int> comp_indices(comps.begin(), comps.end());
+  return comp_indices.size();
+}
+
+// comma-separated list of values
+template<typename T>
+vector<T> parseList(const string& s, T (*parse)(const char*)) {
+  vector<T> values;
+  size_t begin = 0;
+  while (begin <= s.size()) {
+    size_t end = s.find(',', begin);
+    if (end == string::npos) { end = s.size(); }
+    values.push_back(parse(s.substr(begin, end - begin).c_str()));
+    begin = end + 1;
   }
-  ofs << "]}";
-  ofs.close();
+  return values;
+}
+float parseFloat(const char* s) { return (float)atof(s); }
+int parseInt(const char* s) { return atoi(s); }
+
+struct segment_options {
+  vector<float> kthrs;
+  vector<int> minVerts;
+  bool writeLevels;
+  bool hierarchy;
+  bool binary;
+  bool segmentTable;
+  bool stableOrder;
+};
+
+// one written segmentation (or hierarchy level) of a mesh
+struct segment_result {
+  string file;
+  float kthr;
+  int segMinVerts;
+  size_t numSegments;
+  double seconds;  // segmentation and writing
+};
+
+struct mesh_stats {
+  size_t numVertices;
+  size_t numEdges;
+  double graphSeconds;  // loading and graph construction
+  vector<segment_result> results;
+  string error;
+  mesh_stats() : numVertices(0), numEdges(0), graphSeconds(0) {}
+};
+
+double seconds_since(const std::chrono::steady_clock::time_point& t) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - t).count();
+}
+
+// segments a mesh for all parameter combinations and writes the results next to it
+bool segment_mesh(const string& meshFile, const segment_options& opt, mesh_graph& graph, graph_buffers& buffers,
+  mesh_stats& stats, bool verbose) {
+  const string baseName = meshFile.substr(0, meshFile.find_last_of("."));
+  const int lastslash = meshFile.find_last_of("/");
+  const string scanId = lastslash > 0 ? baseName.substr(lastslash) : baseName;
+
+  auto t = std::chrono::steady_clock::now();
+  if (!build_graph(meshFile, graph, buffers, verbose, opt.stableOrder)) {
+    stats.error = "failed to load mesh";
+    return false;
+  }
+  stats.numVertices = graph.num_vertices;
+  stats.numEdges = graph.edges.size();
+  stats.graphSeconds = seconds_since(t);
+
+  if (opt.hierarchy) {
+    vector<float> levelKthrs = opt.kthrs;
+    std::sort(levelKthrs.begin(), levelKthrs.end());
+    vector<int> levelMinVerts(levelKthrs.size(), opt.minVerts[0]);
+    for (size_t l = 0; l < levelKthrs.size() && opt.minVerts.size() > 1; l++) {
+      // keep segMinVerts paired with its kThresh
+      levelMinVerts[l] = opt.minVerts[std::find(opt.kthrs.begin(), opt.kthrs.end(), levelKthrs[l]) - opt.kthrs.begin()];
+    }
+    t = std::chrono::steady_clock::now();
+    vector<segment_merge> merges;
+    const vector<vector<int> > levels = segment_hierarchy(graph, levelKthrs, levelMinVerts, merges);
+    const string segFile = baseName + ".hierarchy.segs.json";
+    writeLevelsToJSON(segFile, scanId, levelKthrs, levelMinVerts, levels, &merges);
+    const double seconds = seconds_since(t) / levels.size();
+    for (size_t l = 0; l < levels.size(); l++) {
+      stats.results.push_back({ segFile, levelKthrs[l], levelMinVerts[l], countSegments(levels[l]), seconds });
+      if (verbose) {
+        printf("Level %lu (kThresh=%f, segMinVerts=%d): %lu segments\n", l, levelKthrs[l], levelMinVerts[l], stats.results.back().numSegments);
+      }
+    }
+    if (verbose) { printf("Segmentation hierarchy written to %s with %lu merges\n", segFile.c_str(), merges.size()); }
+    return true;
+  }
+
+  vector<float> levelKthrs;
+  vector<int> levelMinVerts;
+  vector<vector<int> > levels;
+  for (size_t k = 0; k < opt.kthrs.size(); k++) {
+    for (size_t m = 0; m < opt.minVerts.size(); m++) {
+      t = std::chrono::steady_clock::now();
+      const vector<int> comps = segment(graph, opt.kthrs[k], opt.minVerts[m]);
+      if (opt.writeLevels) {
+        levelKthrs.push_back(opt.kthrs[k]);
+        levelMinVerts.push_back(opt.minVerts[m]);
+        levels.push_back(comps);
+        stats.results.push_back({ baseName + ".levels.segs.json", opt.kthrs[k], opt.minVerts[m], countSegments(comps), seconds_since(t) });
+        continue;
+      }
+      string segFile = baseName + "." + std::to_string(opt.kthrs[k]);
+      if (opt.minVerts.size() > 1) { segFile += "." + std::to_string(opt.minVerts[m]); }
+      if (opt.binary) {
+        segFile += ".segs.bin";
+        segs::writeSegsBinary(segFile, scanId, opt.kthrs[k], opt.minVerts[m], comps, opt.segmentTable);
+      } else {
+        segFile += ".segs.json";
+        writeToJSON(segFile, scanId, opt.kthrs[k], opt.minVerts[m], comps);
+      }
+      stats.results.push_back({ segFile, opt.kthrs[k], opt.minVerts[m], countSegments(comps), seconds_since(t) });
+      if (verbose) { printf("Segmentation written to %s with %lu segments\n", segFile.c_str(), stats.results.back().numSegments); }
+    }
+  }
+  if (opt.writeLevels) {
+    const string segFile = baseName + ".levels.segs.json";
+    writeLevelsToJSON(segFile, scanId, levelKthrs, levelMinVerts, levels, NULL);
+    if (verbose) { printf("Segmentations written to %s with %lu levels\n", segFile.c_str(), levels.size()); }
+  }
+  return true;
+}
+
+// estimated peak memory of segmenting a mesh (from the element counts of a .ply header, otherwise the file size)
+size_t estimate_memory(const string& meshFile) {
+  std::ifstream ifs(meshFile, std::ios::binary);
+  if (!ifs) { return 0; }
+  size_t numVertices = 0, numFaces = 0;
+  string line;
+  for (int i = 0; i < 100 && std::getline(ifs, line); i++) {
+    if (line.compare(0, 15, "element vertex ") == 0) { numVertices = strtoull(line.c_str() + 15, NULL, 10); }
+    else if (line.compare(0, 13, "element face ") == 0) { numFaces = strtoull(line.c_str() + 13, NULL, 10); }
+    else if (line.compare(0, 10, "end_header") == 0) { break; }
+  }
+  if (numVertices > 0 || numFaces > 0) {
+    // per vertex: input, points, normals, csr, union-find, output; per face: input, face normals, csr, 3 edges + sort buffer
+    return numVertices * 80 + numFaces * 120;
+  }
+  ifs.clear();
+  ifs.seekg(0, std::ios::end);
+  return (size_t)ifs.tellg() * 10;
+}
+
+// bounds the estimated memory of the meshes that are processed at the same time (batch mode)
+class memory_budget {
+ public:
+  memory_budget(size_t limit) : limit(limit), used(0) {}
+  // reserves bytes if they fit (always if nothing else is reserved)
+  bool try_acquire(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!fits(bytes)) { return false; }
+    used += bytes;
+    return true;
+  }
+  // waits until bytes fit
+  void acquire(size_t bytes) {
+    std::unique_lock<std::mutex> lock(mutex);
+    cond.wait(lock, [&]() { return fits(bytes); });
+    used += bytes;
+  }
+  void release(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    used -= bytes;
+    cond.notify_all();
+  }
+ private:
+  bool fits(size_t bytes) const { return limit == 0 || used == 0 || used + bytes <= limit; }
+  const size_t limit;
+  size_t used;
+  std::mutex mutex;
+  std::condition_variable cond;
+};
+
+// segments the meshes of a manifest (lines "mesh [kThresh] [segMinVerts]", defaults from opt) with a pool of
+// numThreads workers; writes per segmentation stats to <manifest>.stats.csv
+int segment_batch(const string& manifestFile, const segment_options& opt, int numThreads, size_t memoryLimit) {
+  std::ifstream manifest(manifestFile);
+  if (!manifest) {
+    printf("Could not open manifest %s\n", manifestFile.c_str());
+    return -1;
+  }
+  vector<string> meshes;
+  vector<segment_options> options;
+  string line;
+  while (std::getline(manifest, line)) {
+    std::istringstream tokens(line);
+    string mesh, kthr, minVerts;
+    if (!(tokens >> mesh) || mesh[0] == '#') { continue; }
+    segment_options o = opt;
+    if (tokens >> kthr) { o.kthrs = parseList(kthr, parseFloat); }
+    if (tokens >> minVerts) { o.minVerts = parseList(minVerts, parseInt); }
+    if (o.hierarchy && o.minVerts.size() != 1 && o.minVerts.size() != o.kthrs.size()) {
+      printf("%s: --hierarchy needs one segMinVerts value or one per kThresh\n", mesh.c_str());
+      return -1;
+    }
+    meshes.push_back(mesh);
+    options.push_back(o);
+  }
+
+  if (numThreads <= 0) { numThreads = std::max(1u, std::thread::hardware_concurrency()); }
+  numThreads = std::max(1, std::min(numThreads, (int)meshes.size()));
+  int threadsPerMesh = 1;
+#ifdef _OPENMP
+  threadsPerMesh = std::max(1, omp_get_max_threads() / numThreads);
+#endif
+  printf("Segmenting %lu meshes with %d threads (%d per mesh)\n", meshes.size(), numThreads, threadsPerMesh);
+
+  const auto start = std::chrono::steady_clock::now();
+  vector<mesh_stats> stats(meshes.size());
+  memory_budget budget(memoryLimit);
+  std::atomic<size_t> next(0);
+  std::atomic<size_t> done(0);
+  std::mutex printMutex;
+  const auto worker = [&]() {
+#ifdef _OPENMP
+    omp_set_num_threads(threadsPerMesh);
+#endif
+    mesh_graph graph;
+    graph_buffers buffers;
+    size_t reserved = 0;  // the buffers keep their capacity, so the reservation covers the largest mesh so far
+    for (size_t i = next++; i < meshes.size(); i = next++) {
+      const size_t estimate = estimate_memory(meshes[i]);
+      if (estimate > reserved) {
+        if (budget.try_acquire(estimate - reserved)) {
+          reserved = estimate;
+        } else {
+          // give up the retained buffers while waiting, so that waiting workers never hold memory
+          graph = mesh_graph();
+          buffers = graph_buffers();
+          budget.release(reserved);
+          budget.acquire(estimate);
+          reserved = estimate;
+        }
+      }
+      try {
+        segment_mesh(meshes[i], options[i], graph, buffers, stats[i], false);
+      } catch (const std::exception& e) {
+        stats[i].error = e.what();
+      }
+      std::lock_guard<std::mutex> lock(printMutex);
+      const size_t numSegments = stats[i].results.empty() ? 0 : stats[i].results.back().numSegments;
+      if (stats[i].error.empty()) {
+        printf("[%lu/%lu] %s: %lu vertices, %lu segments, %.2fs\n", ++done, meshes.size(), meshes[i].c_str(),
+          stats[i].numVertices, numSegments, stats[i].graphSeconds);
+      } else {
+        printf("[%lu/%lu] %s: %s\n", ++done, meshes.size(), meshes[i].c_str(), stats[i].error.c_str());
+      }
+    }
+    budget.release(reserved);
+  };
+  vector<std::thread> threads;
+  for (int t = 1; t < numThreads; t++) { threads.push_back(std::thread(worker)); }
+  worker();
+  for (auto& t : threads) { t.join(); }
+
+  const string statsFile = manifestFile + ".stats.csv";
+  std::ofstream ofs(statsFile);
+  ofs << "mesh,kThresh,segMinVerts,vertices,edges,segments,graph_seconds,segment_seconds,output,error\n";
+  size_t numFailed = 0;
+  for (size_t i = 0; i < meshes.size(); i++) {
+    const mesh_stats& s = stats[i];
+    if (!s.error.empty()) {
+      numFailed++;
+      ofs << meshes[i] << ",,," << s.numVertices << "," << s.numEdges << ",," << s.graphSeconds << ",,,\"" << s.error << "\"\n";
+    }
+    for (const segment_result& r : s.results) {
+      ofs << meshes[i] << "," << r.kthr << "," << r.segMinVerts << "," << s.numVertices << "," << s.numEdges << ","
+        << r.numSegments << "," << s.graphSeconds << "," << r.seconds << "," << r.file << ",\n";
+    }
+  }
+  printf("Segmented %lu meshes (%lu failed) in %.1fs, stats written to %s\n", meshes.size() - numFailed, numFailed,
+    seconds_since(start), statsFile.c_str());
+  return numFailed > 0 ? 1 : 0;
 }
 
 int main(int argc, const char** argv) {
-  if (argc < 2) {
-    printf("Usage: ./segmentator input.ply [kThresh] [segMinVerts] (defaults: kThresh=0.01 segMinVerts=20)\n");
+  vector<string> args;
+  segment_options opt;
+  opt.writeLevels = false;
+  opt.hierarchy = false;
+  opt.binary = false;
+  opt.segmentTable = false;
+  opt.stableOrder = false;
+  string manifestFile;
+  int numThreads = 0;
+  size_t memoryLimit = 0;
+  for (int i = 1; i < argc; i++) {
+    const string arg = argv[i];
+    if (arg == "--levels") { opt.writeLevels = true; }
+    else if (arg == "--hierarchy") { opt.hierarchy = true; }
+    else if (arg == "--binary") { opt.binary = true; }
+    else if (arg == "--segment-table") { opt.binary = true; opt.segmentTable = true; }
+    else if (arg == "--stable-order") { opt.stableOrder = true; }
+    else if (arg == "--batch" && i + 1 < argc) { manifestFile = argv[++i]; }
+    else if (arg == "--threads" && i + 1 < argc) { numThreads = atoi(argv[++i]); }
+    else if (arg == "--memory" && i + 1 < argc) { memoryLimit = (size_t)atof(argv[++i]) * 1024 * 1024; }
+    else { args.push_back(arg); }
+  }
+  if (args.empty() && manifestFile.empty()) {
+    printf("Usage: ./segmentator input.ply [kThresh] [segMinVerts] [--levels|--hierarchy] [--binary] [--segment-table] [--stable-order] (defaults: kThresh=0.01 segMinVerts=20)\n");
+    printf("       ./segmentator --batch manifest.txt [kThresh] [segMinVerts] [--threads n] [--memory MB] [options above]\n");
+    printf("  kThresh and segMinVerts may be comma-separated lists; the mesh graph is built once and segmented for every combination\n");
+    printf("  --levels     write all segmentations to one input.levels.segs.json\n");
+    printf("  --hierarchy  nested segmentations for the increasing kThresh values (one segMinVerts or one per kThresh)\n");
+    printf("               and the kThresh at which segments merge, written to input.hierarchy.segs.json\n");
+    printf("  --binary         write input.<kThresh>.segs.bin files (see segsIO.h) instead of .segs.json\n");
+    printf("  --segment-table  --binary, and store the vertices of each segment in the files as well\n");
+    printf("  --stable-order   order edges of equal weight by mesh order (parallel radix sort, same with every compiler); segment ids\n");
+    printf("                   then differ from earlier versions and from existing annotations of the mesh\n");
+    printf("  --batch      segment the meshes listed in the manifest (lines: mesh [kThresh] [segMinVerts]) in parallel,\n");
+    printf("               --threads meshes at a time (default: all cores) within an estimated --memory budget (default: unlimited);\n");
+    printf("               stats are written to manifest.txt.stats.csv\n");
     exit(-1);
-  } else {
-    const string plyFile = argv[1];
-    const float kthr = argc > 2 ? (float)atof(argv[2]) : 0.01f;
-    const int segMinVerts = argc > 3 ? atoi(argv[3]) : 20;
-    printf("Segmenting %s with kThresh=%f, segMinVerts=%d ...\n", plyFile.c_str(), kthr, segMinVerts);
-    const vector<int> comps = segment(plyFile, kthr, segMinVerts);
-    std::unordered_set<int> comp_indices;
-    for (int i = 0; i < comps.size(); i++) {
-      comp_indices.insert(comps[i]);
-    }  
-    const string baseName = plyFile.substr(0, plyFile.find_last_of("."));
-    const int lastslash = plyFile.find_last_of("/");
-    const string scanId = lastslash > 0 ? baseName.substr(lastslash) : baseName;
-    string segFile = baseName + "." + std::to_string(kthr) + ".segs.json";
-    writeToJSON(segFile, scanId, kthr, segMinVerts, comps);
-    printf("Segmentation written to %s with %lu segments\n", segFile.c_str(), comp_indices.size());
+  }
+  size_t a = manifestFile.empty() ? 1 : 0;
+  opt.kthrs = args.size() > a ? parseList(args[a], parseFloat) : vector<float>(1, 0.01f);
+  opt.minVerts = args.size() > a + 1 ? parseList(args[a + 1], parseInt) : vector<int>(1, 20);
+  if (opt.hierarchy && opt.minVerts.size() != 1 && opt.minVerts.size() != opt.kthrs.size()) {
+    printf("--hierarchy needs one segMinVerts value or one per kThresh\n");
+    exit(-1);
+  }
+  if (!manifestFile.empty()) {
+    return segment_batch(manifestFile, opt, numThreads, memoryLimit);
+  }
+
+  const string plyFile = args[0];
+  printf("Segmenting %s with kThresh=%s, segMinVerts=%s ...\n", plyFile.c_str(),
+    args.size() > 1 ? args[1].c_str() : "0.01", args.size() > 2 ? args[2].c_str() : "20");
+  mesh_graph graph;
+  graph_buffers buffers;
+  mesh_stats stats;
+  if (!segment_mesh(plyFile, opt, graph, buffers, stats, true)) {
+    exit(1);
   }
 }
@@ -0,0 +1,363 @@
+#pragma once
+
+// Reading and writing of mesh segmentations (segment id per vertex) without external dependencies:
+// - .segs.json: {"params":{"kThresh":..,"segMinVerts":..},"sceneId":"..","segIndices":[..]} with a fast writer and reader
+//   (the reader handles the files written by segmentator and by Segmentation::saveToFile; readSegsJSON returns
+//   false for anything else, so callers can fall back to a full JSON parser)
+// - .segs.bin: compact binary format, all values little-endian
+//     uint32  magic 'SEGB', version (1), flags (1: segment table present)
+//     uint32  numVertices, numSegments, numRuns, runBytes
+//     float32 kThresh
+//     uint32  segMinVerts, sceneIdBytes
+//     char    sceneId[sceneIdBytes], zero-padded to a multiple of 4 bytes
+//     runs:   numRuns x (varint zigzag(segment id - segment id of the previous run), varint run length - 1),
+//             runBytes bytes, zero-padded to a multiple of 4 bytes
+//     optional segment table (CSR): uint32 segIds[numSegments] (ascending), uint32 vertOffsets[numSegments + 1],
+//             uint32 vertIds[numVertices] (vertices of segment s: vertIds[vertOffsets[s] .. vertOffsets[s + 1]), ascending)
+//   varints are LEB128 (7 bits per byte, least significant first, high bit set on all but the last byte)
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace segs {
+
+const unsigned int SEGS_BINARY_MAGIC = 0x42474553;  // 'SEGB'
+const unsigned int SEGS_BINARY_VERSION = 1;
+const unsigned int SEGS_BINARY_FLAG_SEGMENT_TABLE = 1;
+
+struct SegsData {
+  std::string sceneId;
+  float kThresh;
+  unsigned int segMinVerts;
+  std::map<std::string, double> params;  // all numeric entries of "params" (readSegsJSON only)
+  std::vector<unsigned int> segIndices;  // segment id per vertex
+  // segment table (CSR, see computeSegmentTable); empty unless read from a binary file that contains it
+  std::vector<unsigned int> segIds;
+  std::vector<unsigned int> vertOffsets;
+  std::vector<unsigned int> vertIds;
+
+  SegsData() : kThresh(0.0f), segMinVerts(0) {}
+};
+
+// segment table of a segmentation: sorted segment ids, and the vertices of each segment (ascending) in CSR form
+template<typename T>
+void computeSegmentTable(const std::vector<T>& segIndices, std::vector<unsigned int>& segIds,
+  std::vector<unsigned int>& vertOffsets, std::vector<unsigned int>& vertIds) {
+  segIds.clear();
+  std::unordered_map<unsigned int, unsigned int> slots;
+  for (size_t i = 0; i < segIndices.size(); i++) {
+    // runs of equal ids are common, so only look up on changes
+    if (i == 0 || segIndices[i] != segIndices[i - 1]) {
+      if (slots.insert(std::make_pair((unsigned int)segIndices[i], 0u)).second) { segIds.push_back((unsigned int)segIndices[i]); }
+    }
+  }
+  std::sort(segIds.begin(), segIds.end());
+  for (size_t s = 0; s < segIds.size(); s++) { slots[segIds[s]] = (unsigned int)s; }
+  vertOffsets.assign(segIds.size() + 1, 0);
+  std::vector<unsigned int> slotPerVertex(segIndices.size());
+  unsigned int slot = 0;
+  for (size_t i = 0; i < segIndices.size(); i++) {
+    if (i == 0 || segIndices[i] != segIndices[i - 1]) { slot = slots[(unsigned int)segIndices[i]]; }
+    slotPerVertex[i] = slot;
+    vertOffsets[slot + 1]++;
+  }
+  for (size_t s = 0; s < segIds.size(); s++) { vertOffsets[s + 1] += vertOffsets[s]; }
+  vertIds.resize(segIndices.size());
+  std::vector<unsigned int> pos(vertOffsets.begin(), vertOffsets.end() - 1);
+  for (size_t i = 0; i < segIndices.size(); i++) { vertIds[pos[slotPerVertex[i]]++] = (unsigned int)i; }
+}
+
+namespace detail {
+
+inline void putUINT(std::string& out, unsigned int v) {
+  const unsigned char b[4] = { (unsigned char)v, (unsigned char)(v >> 8), (unsigned char)(v >> 16), (unsigned char)(v >> 24) };
+  out.append((const char*)b, 4);
+}
+inline unsigned int getUINT(const unsigned char* p) {
+  return (unsigned int)p[0] | ((unsigned int)p[1] << 8) | ((unsigned int)p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+inline void putVarint(std::string& out, unsigned long long v) {
+  while (v >= 0x80) { out.push_back((char)(v | 0x80)); v >>= 7; }
+  out.push_back((char)v);
+}
+inline bool getVarint(const unsigned char*& p, const unsigned char* end, unsigned long long& v) {
+  v = 0;
+  for (int shift = 0; p < end && shift < 64; shift += 7) {
+    const unsigned char b = *p++;
+    v |= (unsigned long long)(b & 0x7f) << shift;
+    if (b < 0x80) { return true; }
+  }
+  return false;
+}
+inline void pad4(std::string& out) {
+  while (out.size() % 4) { out.push_back('\0'); }
+}
+
+inline bool readFile(const std::string& filename, std::string& data) {
+  FILE* f = fopen(filename.c_str(), "rb");
+  if (!f) { return false; }
+  fseek(f, 0, SEEK_END);
+  const long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  data.resize(size > 0 ? (size_t)size : 0);
+  const bool ok = size >= 0 && fread(&data[0], 1, data.size(), f) == data.size();
+  fclose(f);
+  return ok;
+}
+inline bool writeFile(const std::string& filename, const std::string& data) {
+  FILE* f = fopen(filename.c_str(), "wb");
+  if (!f) { return false; }
+  const bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+  return fclose(f) == 0 && ok;
+}
+
+// appends the decimal representation of v
+inline void appendUINT(std::string& out, unsigned int v) {
+  char buf[10];
+  int n = 0;
+  do { buf[n++] = (char)('0' + v % 10); v /= 10; } while (v);
+  while (n) { out.push_back(buf[--n]); }
+}
+
+inline const char* skipWhitespace(const char* p, const char* end) {
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) { p++; }
+  return p;
+}
+// position after '"key"' and the following ':'; NULL if not found
+inline const char* findKey(const char* begin, const char* end, const char* key) {
+  const std::string quoted = std::string("\"") + key + "\"";
+  const char* p = std::search(begin, end, quoted.begin(), quoted.end());
+  if (p == end) { return NULL; }
+  p = skipWhitespace(p + quoted.size(), end);
+  if (p == end || *p != ':') { return NULL; }
+  return skipWhitespace(p + 1, end);
+}
+// number (possibly quoted, as written by Segmentation::saveToFile) at p; p is moved past it
+inline bool parseNumber(const char*& p, const char* end, double& v) {
+  const bool quoted = p < end && *p == '"';
+  if (quoted) { p++; }
+  const std::string s(p, std::min(end, p + 64));
+  char* e = NULL;
+  v = strtod(s.c_str(), &e);
+  if (e == s.c_str()) { return false; }
+  p += e - s.c_str();
+  if (quoted) {
+    if (p == end || *p != '"') { return false; }
+    p++;
+  }
+  return true;
+}
+// flat object of numbers {"key": value, ...} at p
+inline bool parseNumberObject(const char* p, const char* end, std::map<std::string, double>& values) {
+  if (p == end || *p != '{') { return false; }
+  p = skipWhitespace(p + 1, end);
+  while (p < end && *p == '"') {
+    const char* keyEnd = std::find(p + 1, end, '"');
+    if (keyEnd == end) { return false; }
+    const std::string key(p + 1, keyEnd);
+    p = skipWhitespace(keyEnd + 1, end);
+    if (p == end || *p != ':') { return false; }
+    p = skipWhitespace(p + 1, end);
+    double v;
+    if (!parseNumber(p, end, v)) { return false; }
+    values[key] = v;
+    p = skipWhitespace(p, end);
+    if (p < end && *p == ',') { p = skipWhitespace(p + 1, end); }
+  }
+  return p < end && *p == '}';
+}
+
+}  // namespace detail
+
+// appends the values as a JSON array ("[v0,v1,...]")
+template<typename T>
+void appendJSONArray(std::string& out, const std::vector<T>& values) {
+  out.reserve(out.size() + values.size() * 8 + 2);
+  out.push_back('[');
+  for (size_t i = 0; i < values.size(); i++) {
+    if (i > 0) { out.push_back(','); }
+    detail::appendUINT(out, (unsigned int)values[i]);
+  }
+  out.push_back(']');
+}
+
+// writes the segmentation as .segs.json (same output as segmentator's original ofstream writer, assembled in memory)
+template<typename T>
+bool writeSegsJSON(const std::string& filename, const std::string& sceneId, float kThresh, int segMinVerts, const std::vector<T>& segIndices) {
+  std::ostringstream header;
+  header << "{";
+  header << "\"params\":{\"kThresh\":" << kThresh << ",\"segMinVerts\":" << segMinVerts << "},";
+  header << "\"sceneId\":\"" << sceneId << "\",";
+  header << "\"segIndices\":";
+  std::string out = header.str();
+  appendJSONArray(out, segIndices);
+  out += "}";
+  return detail::writeFile(filename, out);
+}
+
+// fast reader for .segs.json files; returns false if the file cannot be read or has an unexpected layout
+inline bool readSegsJSON(const std::string& filename, SegsData& data) {
+  std::string file;
+  if (!detail::readFile(filename, file)) { return false; }
+  const char* begin = file.data();
+  const char* end = begin + file.size();
+  data = SegsData();
+
+  const char* p = detail::findKey(begin, end, "segIndices");
+  if (!p || *p != '[') { return false; }
+  p++;
+  data.segIndices.reserve((end - p) / 4);
+  while (true) {
+    p = detail::skipWhitespace(p, end);
+    if (p == end) { return false; }
+    if (*p == ']') { break; }
+    if (*p < '0' || *p > '9') { return false; }
+    unsigned long long v = 0;
+    while (p < end && *p >= '0' && *p <= '9') { v = v * 10 + (*p++ - '0'); }
+    if (v > 0xffffffffull) { return false; }
+    data.segIndices.push_back((unsigned int)v);
+    p = detail::skipWhitespace(p, end);
+    if (p < end && *p == ',') { p++; }
+    else if (p == end || *p != ']') { return false; }
+  }
+
+  p = detail::findKey(begin, end, "sceneId");
+  if (p && *p == '"') {
+    for (p++; p < end && *p != '"'; p++) {
+      if (*p == '\\' && p + 1 < end) { p++; }
+      data.sceneId.push_back(*p);
+    }
+  }
+  p = detail::findKey(begin, end, "params");
+  if (p) {
+    if (!detail::parseNumberObject(p, end, data.params)) { return false; }
+    if (data.params.count("kThresh")) { data.kThresh = (float)data.params["kThresh"]; }
+    if (data.params.count("segMinVerts")) { data.segMinVerts = (unsigned int)data.params["segMinVerts"]; }
+  }
+  return true;
+}
+
+// writes the segmentation as .segs.bin (format above); withSegmentTable also stores the segment-to-vertex table
+template<typename T>
+bool writeSegsBinary(const std::string& filename, const std::string& sceneId, float kThresh, int segMinVerts,
+  const std::vector<T>& segIndices, bool withSegmentTable = false) {
+  std::string runs;
+  unsigned int numRuns = 0;
+  long long prev = 0;
+  for (size_t i = 0; i < segIndices.size();) {
+    size_t j = i + 1;
+    while (j < segIndices.size() && segIndices[j] == segIndices[i]) { j++; }
+    const long long delta = (long long)(unsigned int)segIndices[i] - prev;
+    detail::putVarint(runs, ((unsigned long long)delta << 1) ^ (unsigned long long)(delta >> 63));
+    detail::putVarint(runs, j - i - 1);
+    prev = (long long)(unsigned int)segIndices[i];
+    numRuns++;
+    i = j;
+  }
+  std::vector<unsigned int> segIds, vertOffsets, vertIds;
+  computeSegmentTable(segIndices, segIds, vertOffsets, vertIds);
+
+  std::string out;
+  out.reserve(48 + sceneId.size() + runs.size() + (withSegmentTable ? 4 * (2 * segIds.size() + vertIds.size() + 1) : 0));
+  detail::putUINT(out, SEGS_BINARY_MAGIC);
+  detail::putUINT(out, SEGS_BINARY_VERSION);
+  detail::putUINT(out, withSegmentTable ? SEGS_BINARY_FLAG_SEGMENT_TABLE : 0);
+  detail::putUINT(out, (unsigned int)segIndices.size());
+  detail::putUINT(out, (unsigned int)segIds.size());
+  detail::putUINT(out, numRuns);
+  detail::putUINT(out, (unsigned int)runs.size());
+  unsigned int kThreshBits;
+  memcpy(&kThreshBits, &kThresh, sizeof(kThreshBits));
+  detail::putUINT(out, kThreshBits);
+  detail::putUINT(out, (unsigned int)segMinVerts);
+  detail::putUINT(out, (unsigned int)sceneId.size());
+  out += sceneId;
+  detail::pad4(out);
+  out += runs;
+  detail::pad4(out);
+  if (withSegmentTable) {
+    for (size_t s = 0; s < segIds.size(); s++) { detail::putUINT(out, segIds[s]); }
+    for (size_t s = 0; s < vertOffsets.size(); s++) { detail::putUINT(out, vertOffsets[s]); }
+    for (size_t i = 0; i < vertIds.size(); i++) { detail::putUINT(out, vertIds[i]); }
+  }
+  return detail::writeFile(filename, out);
+}
+
+inline bool isSegsBinary(const std::string& filename) {
+  unsigned char magic[4];
+  FILE* f = fopen(filename.c_str(), "rb");
+  if (!f) { return false; }
+  const bool ok = fread(magic, 1, 4, f) == 4 && detail::getUINT(magic) == SEGS_BINARY_MAGIC;
+  fclose(f);
+  return ok;
+}
+
+// reads a .segs.bin file; returns false if the file cannot be read or is invalid
+inline bool readSegsBinary(const std::string& filename, SegsData& data) {
+  std::string file;
+  if (!detail::readFile(filename, file) || file.size() < 40) { return false; }
+  const unsigned char* begin = (const unsigned char*)file.data();
+  if (detail::getUINT(begin) != SEGS_BINARY_MAGIC || detail::getUINT(begin + 4) > SEGS_BINARY_VERSION) { return false; }
+  const unsigned int flags = detail::getUINT(begin + 8);
+  const unsigned int numVertices = detail::getUINT(begin + 12);
+  const unsigned int numSegments = detail::getUINT(begin + 16);
+  const unsigned int numRuns = detail::getUINT(begin + 20);
+  const unsigned int runBytes = detail::getUINT(begin + 24);
+  data = SegsData();
+  const unsigned int kThreshBits = detail::getUINT(begin + 28);
+  memcpy(&data.kThresh, &kThreshBits, sizeof(data.kThresh));
+  data.segMinVerts = detail::getUINT(begin + 32);
+  const size_t sceneIdBytes = detail::getUINT(begin + 36);
+  const size_t runsBegin = (40 + sceneIdBytes + 3) / 4 * 4;
+  const size_t tableBegin = (runsBegin + (size_t)runBytes + 3) / 4 * 4;
+  if (tableBegin > file.size()) { return false; }
+  data.sceneId.assign((const char*)begin + 40, sceneIdBytes);
+
+  // the counts in the header are only trusted for allocations once the payload is known to hold them: every run
+  // takes at least two bytes, the segment table 4 bytes per entry, and the run lengths must add up to numVertices
+  // (checked in a first pass over the runs; the second one fills segIndices)
+  if (numRuns > runBytes / 2) { return false; }
+  const bool hasSegmentTable = (flags & SEGS_BINARY_FLAG_SEGMENT_TABLE) != 0;
+  if (hasSegmentTable && tableBegin + 4 * (2 * (size_t)numSegments + 1 + numVertices) > file.size()) { return false; }
+  for (int pass = 0; pass < 2; pass++) {
+    if (pass == 1) { data.segIndices.resize(numVertices); }
+    const unsigned char* p = begin + runsBegin;
+    const unsigned char* runsEnd = p + runBytes;
+    long long id = 0;
+    size_t v = 0;
+    for (unsigned int r = 0; r < numRuns; r++) {
+      unsigned long long zigzag, length;
+      if (!detail::getVarint(p, runsEnd, zigzag) || !detail::getVarint(p, runsEnd, length)) { return false; }
+      id += (long long)(zigzag >> 1) ^ -(long long)(zigzag & 1);
+      if (length >= numVertices - v) { return false; }
+      if (pass == 1) { std::fill(data.segIndices.begin() + v, data.segIndices.begin() + v + (size_t)length + 1, (unsigned int)id); }
+      v += (size_t)length + 1;
+    }
+    if (v != numVertices) { return false; }
+  }
+
+  if (hasSegmentTable) {
+    const unsigned char* t = begin + tableBegin;
+    data.segIds.resize(numSegments);
+    data.vertOffsets.resize(numSegments + 1);
+    data.vertIds.resize(numVertices);
+    for (size_t s = 0; s < data.segIds.size(); s++, t += 4) { data.segIds[s] = detail::getUINT(t); }
+    for (size_t s = 0; s < data.vertOffsets.size(); s++, t += 4) { data.vertOffsets[s] = detail::getUINT(t); }
+    for (size_t i = 0; i < data.vertIds.size(); i++, t += 4) { data.vertIds[i] = detail::getUINT(t); }
+    for (size_t s = 0; s + 1 < data.vertOffsets.size(); s++) {
+      if (data.vertOffsets[s] > data.vertOffsets[s + 1]) { return false; }
+    }
+    if (data.vertOffsets.front() != 0 || data.vertOffsets.back() != numVertices) { return false; }
+  }
+  return true;
+}
+
+}  // namespace segs
@@ -0,0 +1,467 @@
+#include "sensorData.h"
+
+//command line utilities operating on .sens files
+//run ./senstool <command> [args] (without arguments to list the commands)
+
+static void printUsage() {
+	std::cout << "usage: ./senstool <command> [args]" << std::endl;
+	std::cout << "commands:" << std::endl;
+	std::cout << "\tindex <sensFile> [--sidecar]\t\tadds a frame index (trailer or <sensFile>.idx) for random access" << std::endl;
+	std::cout << "\tconvert-depth <inFile> <outFile> <raw|zlib|rundelta> [--index]\tre-encodes the depth frames" << std::endl;
+	std::cout << "\texport-poses <sensFile> <poseFile>\t\twrites the poses and time stamps of all frames to a text file" << std::endl;
+	std::cout << "\tset-poses <sensFile> <poseFile> [--timestamps]\toverwrites the poses (and time stamps) in place" << std::endl;
+	std::cout << "\tapply-transform <sensFile> <matrixFile>\t\tleft-multiplies all poses with a 4x4 matrix (.aln or 16 values) in place" << std::endl;
+	std::cout << "\trecover <sensFile>\t\t\t\trolls back an interrupted set-poses/apply-transform" << std::endl;
+	std::cout << "\texport <sensFile> <outDir> [--begin i] [--end i] [--stride n] [--threads n] [--depth-png]" << std::endl;
+	std::cout << "\t\t\t\t\t\twrites color, depth and pose files of the selected frames" << std::endl;
+	std::cout << "\tbenchmark-color <sensFile> [--quality q] [--frames n]\tcompares raw, png and jpeg color encoding (size, speed, PSNR)" << std::endl;
+	std::cout << "\tstream <sensFile|-> [--window n]\t\tdecodes all frames from a file or stdin with constant memory" << std::endl;
+	std::cout << "\tconcat <outFile> <inFile> [inFile ...] [--index]\tconcatenates .sens files without decoding them" << std::endl;
+	std::cout << "\tappend <sensFile> <otherFile>\t\t\tappends the frames of otherFile to sensFile in place" << std::endl;
+	std::cout << "\tpreview <sensFile> [--color-factor n] [--depth-factor n] [--quality q] [--threads n]" << std::endl;
+	std::cout << "\t\t\t\t\t\tadds a low-resolution preview of all frames" << std::endl;
+	std::cout << "\texport-preview <sensFile> <outDir> [--stride n]\twrites the preview frames as images" << std::endl;
+}
+
+static bool hasOption(int argc, char* argv[], const std::string& option) {
+	for (int i = 0; i < argc; i++) {
+		if (option == argv[i]) return true;
+	}
+	return false;
+}
+
+//! returns the value following the option (or defaultValue if the option is not given)
+static size_t getOptionValue(int argc, char* argv[], const std::string& option, size_t defaultValue) {
+	for (int i = 0; i + 1 < argc; i++) {
+		if (option == argv[i]) return (size_t)std::stoull(argv[i + 1]);
+	}
+	return defaultValue;
+}
+
+static double secondsSince(const std::chrono::high_resolution_clock::time_point& start) {
+	return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+//! runs func(frameIdx, threadIdx) for all frames on all cores
+template<class Func>
+static void parallelForFrames(size_t numFrames, Func func) {
+	const unsigned int numThreads = std::max(1u, std::thread::hardware_concurrency());
+	std::atomic<size_t> next(0);
+	std::vector<std::thread> threads;
+	std::exception_ptr exception;
+	std::mutex mutex;
+	for (unsigned int t = 0; t < numThreads; t++) {
+		threads.push_back(std::thread([&, t] {
+			try {
+				for (size_t i = next++; i < numFrames; i = next++) func(i, t);
+			}
+			catch (...) {
+				std::lock_guard<std::mutex> lock(mutex);
+				exception = std::current_exception();
+				next = numFrames;
+			}
+		}));
+	}
+	for (auto& t : threads) t.join();
+	if (exception) std::rethrow_exception(exception);
+}
+
+static int commandConvertDepth(int argc, char* argv[]) {
+	if (argc < 3) {
+		printUsage();
+		return EXIT_FAILURE;
+	}
+	const std::string inFile = argv[0];
+	const std::string outFile = argv[1];
+	const std::string typeStr = argv[2];
+	ml::SensorData::COMPRESSION_TYPE_DEPTH type;
+	if (typeStr == "raw") type = ml::SensorData::TYPE_RAW_USHORT;
+	else if (typeStr == "zlib") type = ml::SensorData::TYPE_ZLIB_USHORT;
+	else if (typeStr == "rundelta") type = ml::SensorData::TYPE_RUNDELTA_USHORT;
+	else throw MLIB_EXCEPTION("unknown depth compression type " + typeStr);
+
+	ml::SensorData sd;
+	//writing in place truncates the input, so it must not be mapped (compared by file identity: the paths may differ or go through links)
+	if (ml::SensorData::isSameFile(inFile, outFile)) sd.loadFromFile(inFile);
+	else sd.loadFromFileMapped(inFile);	//the frames are re-encoded, no need to copy the old payloads
+	std::cout << "depth: " << ml::SensorData::COMPRESSION_TYPE_DEPTH_Str(sd.m_depthCompressionType) << " -> " << ml::SensorData::COMPRESSION_TYPE_DEPTH_Str(type) << std::endl;
+
+	//only used to encode (dimensions and target type)
+	ml::SensorData encoder;
+	encoder.m_depthWidth = sd.m_depthWidth;
+	encoder.m_depthHeight = sd.m_depthHeight;
+	encoder.m_depthCompressionType = type;
+
+	const unsigned int numThreads = std::max(1u, std::thread::hardware_concurrency());
+	ml::SensorData::FrameBufferPool buffers(sd, numThreads);
+	ml::UINT64 sizeBefore = 0, sizeAfter = 0;
+	for (const auto& f : sd.m_frames) sizeBefore += f.getDepthSizeBytes();
+
+	auto start = std::chrono::high_resolution_clock::now();
+	parallelForFrames(sd.m_frames.size(), [&](size_t i, unsigned int t) {
+		sd.decompressDepthInto(sd.m_frames[i], buffers.getDepth(t));
+	});
+	const double decodeBefore = secondsSince(start);
+
+	start = std::chrono::high_resolution_clock::now();
+	parallelForFrames(sd.m_frames.size(), [&](size_t i, unsigned int t) {
+		sd.decompressDepthInto(sd.m_frames[i], buffers.getDepth(t));
+		encoder.replaceDepth(sd.m_frames[i], buffers.getDepth(t));
+	});
+	const double convert = secondsSince(start);
+	sd.m_depthCompressionType = type;
+	for (const auto& f : sd.m_frames) sizeAfter += f.getDepthSizeBytes();
+
+	start = std::chrono::high_resolution_clock::now();
+	parallelForFrames(sd.m_frames.size(), [&](size_t i, unsigned int t) {
+		sd.decompressDepthInto(sd.m_frames[i], buffers.getDepth(t));
+	});
+	const double decodeAfter = secondsSince(start);
+
+	std::cout << "depth size [MB]:\t" << sizeBefore / (1024.0*1024.0) << " -> " << sizeAfter / (1024.0*1024.0) << std::endl;
+	std::cout << "depth decode [s]:\t" << decodeBefore << " -> " << decodeAfter << " (" << numThreads << " threads, conversion " << convert << "s)" << std::endl;
+
+	sd.saveToFile(outFile, hasOption(argc, argv, "--index"));
+	std::cout << "written to " << outFile << std::endl;
+	return 0;
+}
+
+//! returns a * b
+static ml::mat4f multiply(const ml::mat4f& a, const ml::mat4f& b) {
+	ml::mat4f res;
+	for (unsigned int i = 0; i < 4; i++) {
+		for (unsigned int j = 0; j < 4; j++) {
+			float sum = 0.0f;
+			for (unsigned int k = 0; k < 4; k++) sum += a.matrix[i * 4 + k] * b.matrix[k * 4 + j];
+			res.matrix[i * 4 + j] = sum;
+		}
+	}
+	return res;
+}
+
+//pose file: per frame one line with the 16 values of the camera-to-world matrix (row-major) followed by the color and depth time stamps
+static int commandExportPoses(int argc, char* argv[]) {
+	if (argc < 2) {
+		printUsage();
+		return EXIT_FAILURE;
+	}
+	const std::vector<ml::SensorData::FramePose> poses = ml::SensorData::readFramePoses(argv[0]);
+	std::ofstream out(argv[1]);
+	if (!out) throw MLIB_EXCEPTION("could not open file for writing: " + std::string(argv[1]));
+	out << std::setprecision(9);
+	for (const auto& p : poses) {
+		for (unsigned int i = 0; i < 16; i++) out << p.m_cameraToWorld.matrix[i] << " ";
+		out << p.m_timeStampColor << " " << p.m_timeStampDepth << std::endl;
+	}
+	std::cout << "exported " << poses.size() << " poses to " << argv[1] << std::endl;
+	return 0;
+}
+
+static int commandSetPoses(int argc, char* argv[]) {
+	if (argc < 2) {
+		printUsage();
+		return EXIT_FAILURE;
+	}
+	const std::string filename = argv[0];
+	const bool timeStamps = hasOption(argc, argv, "--timestamps");
+
+	std::vector<ml::SensorData::FramePose> poses = ml::SensorData::readFramePoses(filename);
+	std::ifstream in(argv[1]);
+	if (!in) throw MLIB_EXCEPTION("could not open file " + std::string(argv[1]));
+	for (auto& p : poses) {
+		for (unsigned int i = 0; i < 16; i++) in >> p.m_cameraToWorld.matrix[i];
+		ml::UINT64 timeStampColor, timeStampDepth;
+		in >> timeStampColor >> timeStampDepth;
+		if (timeStamps) {
+			p.m_timeStampColor = timeStampColor;
+			p.m_timeStampDepth = timeStampDepth;
+		}
+		if (!in) throw MLIB_EXCEPTION("expected " + std::to_string(poses.size()) + " poses in " + std::string(argv[1]));
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+	ml::SensorData::writeFramePoses(filename, poses);
+	std::cout << "updated " << poses.size() << " poses in " << secondsSince(start) << "s" << std::endl;
+	return 0;
+}
+
+static int commandApplyTransform(int argc, char* argv[]) {
+	if (argc < 2) {
+		printUsage();
+		return EXIT_FAILURE;
+	}
+	const std::string filename = argv[0];
+	const std::string matrixFile = argv[1];
+	std::ifstream in(matrixFile);
+	if (!in) throw MLIB_EXCEPTION("could not open file " + matrixFile);
+	if (matrixFile.size() >= 4 && matrixFile.substr(matrixFile.size() - 4) == ".aln") {
+		std::string tmp;
+		std::getline(in, tmp); std::getline(in, tmp); std::getline(in, tmp);	//ignore header lines
+	}
+	ml::mat4f transform;
+	for (unsigned int i = 0; i < 16; i++) in >> transform.matrix[i];
+	if (!in) throw MLIB_EXCEPTION("expected 16 values in " + matrixFile);
+
+	auto start = std::chrono::high_resolution_clock::now();
+	std::vector<ml::SensorData::FramePose> poses = ml::SensorData::readFramePoses(filename);
+	for (auto& p : poses) {
+		if (p.m_cameraToWorld.matrix[0] == -std::numeric_limits<float>::infinity()) continue;	//avoid creating NANs
+		p.m_cameraToWorld = multiply(transform, p.m_cameraToWorld);
+	}
+	ml::SensorData::writeFramePoses(filename, poses);
+	std::cout << "transformed " << poses.size() << " poses in " << secondsSince(start) << "s" << std::endl;
+	return 0;
+}
+
+static int commandRecover(int argc, char* argv[]) {
+	if (argc < 1) {
+		printUsage();
+		return EXIT_FAILURE;
+	}
+	if (ml::SensorData::recoverFramePoses(argv[0])) std::cout << "rolled back an interrupted pose update of " << argv[0] << std::endl;
+	else std::cout << "nothing to recover" << std::endl;
+	return 0;
+}
+
+static int commandExport(int argc, char* argv[]) {
+	if (argc < 2) {
+		printUsage();
+		return EXIT_FAILURE;
+	}
+	ml::SensorData::ImageExportOptions options;
+	options.frameBegin = getOptionValue(argc, argv, "--begin", options.frameBegin);
+	options.frameEnd = getOptionValue(argc, argv, "--end", options.frameEnd);
+	options.frameStride = getOptionValue(argc, argv, "--stride", options.frameStride);
+	options.numThreads = (unsigned int)getOptionValue(argc, argv, "--threads", options.numThreads);
+	options.depthAsPNG = hasOption(argc, argv, "--depth-png");
+
+	ml::SensorData sd;
+	sd.loadFromFileMapped(argv[0]);	//only the selected frames are read from disk
+	auto start = std::chrono::high_resolution_clock::now();
+	sd.saveToImages(argv[1], options);
+	std::cout << std::endl << "exported in " << secondsSince(start) << "s" << std::endl;
+	return 0;
+}
+
+static int commandBenchmarkColor(int argc, char* argv[]) {
+	if (argc < 1) {
+		printUsage();
+		return EXIT_FAILURE;
+	}
+	ml::SensorData sd;
+	sd.loadFromFileMapped(argv[0]);
+	const size_t numFrames = std::min(getOptionValue(argc, argv, "--frames", 50), sd.m_frames.size());
+	const unsigned int quality = (unsigned int)getOptionValue(argc, argv, "--quality", 90);
+	const size_t numPixels = (size_t)sd.m_colorWidth*sd.m_colorHeight;
+	const unsigned int numThreads = std::max(1u, std::thread::hardware_concurrency());
+	std::cout << numFrames << " frames (" << sd.m_colorWidth << "x" << sd.m_colorHeight << "), " << numThreads << " threads, jpeg quality " << quality << std::endl;
+
+	std::vector<std::vector<ml::vec3uc>> colors(numFrames, std::vector<ml::vec3uc>(numPixels));
+	parallelForFrames(numFrames, [&](size_t i, unsigned int /*t*/) {
+		sd.decompressColorInto(sd.m_frames[i], colors[i].data());
+	});
+
+	const ml::SensorData::COMPRESSION_TYPE_COLOR types[] = { ml::SensorData::TYPE_RAW, ml::SensorData::TYPE_PNG, ml::SensorData::TYPE_JPEG };
+	for (ml::SensorData::COMPRESSION_TYPE_COLOR type : types) {
+		//only used to encode (dimensions and target type)
+		ml::SensorData encoder;
+		encoder.m_colorWidth = sd.m_colorWidth;
+		encoder.m_colorHeight = sd.m_colorHeight;
+		encoder.m_colorCompressionType = type;
+		encoder.setColorCompressionQuality(quality);
+		ml::SensorData::FrameBufferPool buffers(encoder, numThreads);
+		std::vector<ml::SensorData::RGBDFrame> frames(numFrames);
+
+		auto start = std::chrono::high_resolution_clock::now();
+		parallelForFrames(numFrames, [&](size_t i, unsigned int /*t*/) {
+			encoder.replaceColor(frames[i], colors[i].data());
+		});
+		const double encode = secondsSince(start);
+
+		start = std::chrono::high_resolution_clock::now();
+		parallelForFrames(numFrames, [&](size_t i, unsigned int t) {
+			encoder.decompressColorInto(frames[i], buffers.getColor(t));
+		});
+		const double decode = secondsSince(start);
+
+		//PSNR over all frames
+		ml::UINT64 sizeBytes = 0;
+		double squaredError = 0.0;
+		for (size_t i = 0; i < numFrames; i++) {
+			sizeBytes += frames[i].getColorSizeBytes();
+			encoder.decompressColorInto(frames[i], buffers.getColor());
+			const unsigned char* a = (const unsigned char*)colors[i].data();
+			const unsigned char* b = (const unsigned char*)buffers.getColor();
+			for (size_t j = 0; j < numPixels * 3; j++) squaredError += ((int)a[j] - (int)b[j]) * ((int)a[j] - (int)b[j]);
+			frames[i].free();
+		}
+		const double mse = squaredError / ((double)numFrames * numPixels * 3);
+
+		std::cout << ml::SensorData::COMPRESSION_TYPE_COLOR_Str(type) << ":\t" << sizeBytes / (1024.0 * numFrames) << " KB/frame ("
+			<< (double)numPixels * 3 * numFrames / sizeBytes << ":1), encode " << 1000.0 * encode / numFrames << " ms/frame, decode "
+			<< 1000.0 * decode / numFrames << " ms/frame, PSNR ";
+		if (mse == 0.0) std::cout << "inf (lossless)" << std::endl;
+		else std::cout << 10.0 * std::log10(255.0 * 255.0 / mse) << " dB" << std::endl;
+	}
+	return 0;
+}
+
+static int commandStream(int argc, char* argv[]) {
+	if (argc < 1) {
+		printUsage();
+		return EXIT_FAILURE;
+	}
+	ml::SensorDataStreamReader reader(argv[0], (unsigned int)getOptionValue(argc, argv, "--window", 4));
+	const ml::SensorData& header = reader.getHeader();
+	std::cout << "frames:\t\t" << reader.getNumFrames() << " (" << header.m_colorWidth << "x" << header.m_colorHeight << " "
+		<< ml::SensorData::COMPRESSION_TYPE_COLOR_Str(header.m_colorCompressionType) << ", " << header.m_depthWidth << "x" << header.m_depthHeight << " "
+		<< ml::SensorData::COMPRESSION_TYPE_DEPTH_Str(header.m_depthCompressionType) << ")" << std::endl;
+
+	//decodes every frame to validate the stream
+	ml::SensorData::FrameBufferPool buffers(header);
+	ml::SensorData::RGBDFrame frame;
+	ml::UINT64 sizeBytes = 0;
+	size_t numValidPoses = 0;
+	auto start = std::chrono::high_resolution_clock::now();
+	while (reader.readNext(frame)) {
+		buffers.decompress(header, frame);
+		sizeBytes += frame.getColorSizeBytes() + frame.getDepthSizeBytes();
+		if (frame.getCameraToWorld().matrix[0] != -std::numeric_limits<float>::infinity()) numValidPoses++;
+	}
+	frame.free();
+	const double seconds = secondsSince(start);
+
+	std::vector<ml::SensorData::IMUFrame> imuFrames;
+	reader.getIMUFrames(imuFrames);
+	std::cout << "valid poses:\t" << numValidPoses << std::endl;
+	std::cout << "IMU frames:\t" << imuFrames.size() << std::endl;
+	std::cout << "decoded in " << seconds << "s (" << sizeBytes / (1024.0*1024.0) / seconds << " MB/s compressed)" << std::endl;
+	return 0;
+}
+
+static int commandConcat(int argc, char* argv[]) {
+	std::vector<std::string> inFiles;
+	for (int i = 1; i < argc; i++) {
+		if (std::string(argv[i]) != "--index") inFiles.push_back(argv[i]);
+	}
+	if (inFiles.empty()) {
+		printUsage();
+		return EXIT_FAILURE;
+	}
+	auto start = std::chrono::high_resolution_clock::now();
+	ml::SensorData::concatFiles(inFiles, argv[0], hasOption(argc, argv, "--index"));
+	const ml::SensorData::FrameIndex index = ml::SensorData::loadFrameIndex(argv[0]);
+	std::cout << "wrote " << index.m_frameOffsets.size() << " frames to " << argv[0] << " in " << secondsSince(start) << "s" << std::endl;
+	return 0;
+}
+
+static int commandAppend(int argc, char* argv[]) {
+	if (argc < 2) {
+		printUsage();
+		return EXIT_FAILURE;
+	}
+	auto start = std::chrono::high_resolution_clock::now();
+	ml::SensorData::appendFile(argv[0], argv[1]);
+	const ml::SensorData::FrameIndex index = ml::SensorData::loadFrameIndex(argv[0]);
+	std::cout << argv[0] << " has " << index.m_frameOffsets.size() << " frames (appended in " << secondsSince(start) << "s)" << std::endl;
+	return 0;
+}
+
+static int commandPreview(int argc, char* argv[]) {
+	if (argc < 1) {
+		printUsage();
+		return EXIT_FAILURE;
+	}
+	ml::SensorData::PreviewOptions options;
+	options.colorDownsampleFactor = (unsigned int)getOptionValue(argc, argv, "--color-factor", options.colorDownsampleFactor);
+	options.depthDownsampleFactor = (unsigned int)getOptionValue(argc, argv, "--depth-factor", options.depthDownsampleFactor);
+	options.colorQuality = (unsigned int)getOptionValue(argc, argv, "--quality", options.colorQuality);
+	options.numThreads = (unsigned int)getOptionValue(argc, argv, "--threads", options.numThreads);
+
+	auto start = std::chrono::high_resolution_clock::now();
+	ml::SensorData::writePreviews(argv[0], options);
+	const double seconds = secondsSince(start);
+	const ml::SensorData::FrameIndex index = ml::SensorData::loadFrameIndex(argv[0]);
+	std::ifstream in(argv[0], std::ios::binary | std::ios::ate);
+	const ml::UINT64 previewSizeBytes = (ml::UINT64)in.tellg() - index.m_previewOffset;
+	std::cout << "preview of " << index.m_frameOffsets.size() << " frames: " << previewSizeBytes / (1024.0*1024.0) << " MB (written in " << seconds << "s)" << std::endl;
+	return 0;
+}
+
+static int commandExportPreview(int argc, char* argv[]) {
+	if (argc < 2) {
+		printUsage();
+		return EXIT_FAILURE;
+	}
+	ml::SensorData preview;
+	auto start = std::chrono::high_resolution_clock::now();
+	if (!ml::SensorData::loadPreview(argv[0], preview)) {
+		std::cout << argv[0] << " has no preview (see ./senstool preview)" << std::endl;
+		return EXIT_FAILURE;
+	}
+	std::cout << "loaded " << preview.m_frames.size() << " preview frames (" << preview.m_colorWidth << "x" << preview.m_colorHeight << ", "
+		<< preview.m_depthWidth << "x" << preview.m_depthHeight << ") in " << secondsSince(start) << "s" << std::endl;
+	ml::SensorData::ImageExportOptions options;
+	options.frameStride = getOptionValue(argc, argv, "--stride", options.frameStride);
+	preview.saveToImages(argv[1], options);
+	return 0;
+}
+
+static int commandIndex(int argc, char* argv[]) {
+	if (argc < 1) {
+		printUsage();
+		return EXIT_FAILURE;
+	}
+	const std::string filename = argv[0];
+	const bool sidecar = hasOption(argc, argv, "--sidecar");
+
+	std::cout << "indexing " << filename << "... ";
+	ml::SensorData::writeFrameIndex(filename, sidecar);
+	std::cout << "done!" << std::endl;
+
+	ml::SensorData::FrameIndex index = ml::SensorData::loadFrameIndex(filename);
+	std::cout << "numFrames =\t" << index.m_frameOffsets.size() << std::endl;
+	std::cout << "IMUOffset =\t" << index.m_IMUOffset << std::endl;
+	std::cout << "dataSize =\t" << index.m_dataSizeBytes << std::endl;
+	return 0;
+}
+
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2) {
+		printUsage();
+		return EXIT_FAILURE;
+	}
+	try {
+		const std::string command = argv[1];
+		if (command == "index") return commandIndex(argc - 2, argv + 2);
+		if (command == "convert-depth") return commandConvertDepth(argc - 2, argv + 2);
+		if (command == "export-poses") return commandExportPoses(argc - 2, argv + 2);
+		if (command == "set-poses") return commandSetPoses(argc - 2, argv + 2);
+		if (command == "apply-transform") return commandApplyTransform(argc - 2, argv + 2);
+		if (command == "recover") return commandRecover(argc - 2, argv + 2);
+		if (command == "export") return commandExport(argc - 2, argv + 2);
+		if (command == "benchmark-color") return commandBenchmarkColor(argc - 2, argv + 2);
+		if (command == "stream") return commandStream(argc - 2, argv + 2);
+		if (command == "concat") return commandConcat(argc - 2, argv + 2);
+		if (command == "append") return commandAppend(argc - 2, argv + 2);
+		if (command == "preview") return commandPreview(argc - 2, argv + 2);
+		if (command == "export-preview") return commandExportPreview(argc - 2, argv + 2);
+
+		std::cout << "unknown command: " << command << std::endl;
+		printUsage();
+		return EXIT_FAILURE;
+	}
+	catch (const std::exception& e)
+	{
+		std::cout << "Exception caught! " << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+	catch (...)
+	{
+		std::cout << "Exception caught! (unknown)" << std::endl;
+		return EXIT_FAILURE;
+	}
+	return 0;
+}
@@ -16,6 +16,7 @@
 
 
 #include <cstring>
+#include <cstdio>
 #include <cmath>
 
 #include <vector>
@@ -27,10 +28,12 @@
 #include <atomic>
 #include <thread> 
 #include <mutex>
+#include <condition_variable>
 #include <sstream>
 #include <algorithm>
 #include <chrono>
 #include <iomanip>
+#include <memory>
 
 //we treat everything that is not WIN32 as linux
 #ifndef WIN32
@@ -41,11 +44,18 @@
 #ifdef WIN32
 #include "windows.h"
 #include <tchar.h>
+#include <io.h>
+#include <fcntl.h>
 #endif
 
 #ifdef LINUX
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <dirent.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
 #endif
 
 namespace stb {
@@ -58,6 +68,9 @@ namespace stb {
 #undef STB_IMAGE_WRITE_IMPLEMENTATION
 }
 
+#include "sensorData/depthCodec.h"
+#include "sensorData/jpegCodec.h"
+
 #ifdef _USE_UPLINK_COMPRESSION
 #if _WIN32
 #pragma comment(lib, "gdiplus.lib")
@@ -343,6 +356,91 @@ namespace ml {
 			mat4f m_extrinsic;
 		};
 
+		//! read-only memory mapping of a file; the pages are shared through the OS page cache (e.g., between several processes)
+		class MemoryMappedFile {
+		public:
+			MemoryMappedFile() {
+				m_data = NULL;
+				m_sizeBytes = 0;
+#ifdef WIN32
+				m_file = INVALID_HANDLE_VALUE;
+				m_mapping = NULL;
+#else
+				m_fd = -1;
+#endif
+			}
+
+			MemoryMappedFile(const std::string& filename) : MemoryMappedFile() {
+				open(filename);
+			}
+
+			~MemoryMappedFile() {
+				close();
+			}
+
+			void open(const std::string& filename) {
+				close();
+#ifdef WIN32
+				m_file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+				if (m_file == INVALID_HANDLE_VALUE) throw MLIB_EXCEPTION("could not open file " + filename);
+				LARGE_INTEGER size;
+				if (!GetFileSizeEx(m_file, &size)) { close(); throw MLIB_EXCEPTION("could not determine size of " + filename); }
+				m_sizeBytes = (UINT64)size.QuadPart;
+				if (m_sizeBytes == 0) { close(); throw MLIB_EXCEPTION("empty file " + filename); }
+				m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+				if (m_mapping == NULL) { close(); throw MLIB_EXCEPTION("could not map file " + filename); }
+				m_data = (const unsigned char*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+				if (m_data == NULL) { close(); throw MLIB_EXCEPTION("could not map file " + filename); }
+#else
+				m_fd = ::open(filename.c_str(), O_RDONLY);
+				if (m_fd < 0) throw MLIB_EXCEPTION("could not open file " + filename);
+				struct stat st;
+				if (fstat(m_fd, &st) != 0) { close(); throw MLIB_EXCEPTION("could not determine size of " + filename); }
+				m_sizeBytes = (UINT64)st.st_size;
+				if (m_sizeBytes == 0) { close(); throw MLIB_EXCEPTION("empty file " + filename); }
+				void* data = mmap(NULL, (size_t)m_sizeBytes, PROT_READ, MAP_SHARED, m_fd, 0);
+				if (data == MAP_FAILED) { close(); throw MLIB_EXCEPTION("could not map file " + filename); }
+				m_data = (const unsigned char*)data;
+#endif
+			}
+
+			void close() {
+#ifdef WIN32
+				if (m_data) UnmapViewOfFile(m_data);
+				if (m_mapping) CloseHandle(m_mapping);
+				if (m_file != INVALID_HANDLE_VALUE) CloseHandle(m_file);
+				m_file = INVALID_HANDLE_VALUE;
+				m_mapping = NULL;
+#else
+				if (m_data) munmap((void*)m_data, (size_t)m_sizeBytes);
+				if (m_fd >= 0) ::close(m_fd);
+				m_fd = -1;
+#endif
+				m_data = NULL;
+				m_sizeBytes = 0;
+			}
+
+			const unsigned char* getData() const {
+				return m_data;
+			}
+			UINT64 getSizeBytes() const {
+				return m_sizeBytes;
+			}
+
+		private:
+			MemoryMappedFile(const MemoryMappedFile&);
+			MemoryMappedFile& operator=(const MemoryMappedFile&);
+
+			const unsigned char* m_data;
+			UINT64 m_sizeBytes;
+#ifdef WIN32
+			HANDLE m_file;
+			HANDLE m_mapping;
+#else
+			int m_fd;
+#endif
+		};
+
 		enum COMPRESSION_TYPE_COLOR {
 			TYPE_COLOR_UNKNOWN = -1,
 			TYPE_RAW = 0,
@@ -353,7 +451,8 @@ namespace ml {
 			TYPE_DEPTH_UNKNOWN = -1,
 			TYPE_RAW_USHORT = 0,
 			TYPE_ZLIB_USHORT = 1,
-			TYPE_OCCI_USHORT = 2
+			TYPE_OCCI_USHORT = 2,
+			TYPE_RUNDELTA_USHORT = 3	//zero runs + bit-packed deltas (see sensorData/depthCodec.h)
 		};
 
 		static std::string COMPRESSION_TYPE_COLOR_Str(COMPRESSION_TYPE_COLOR type) {
@@ -368,6 +467,7 @@ namespace ml {
 			if (type == TYPE_RAW_USHORT) return "TYPE_RAW_USHORT";
 			if (type == TYPE_ZLIB_USHORT) return "TYPE_ZLIB_USHORT";
 			if (type == TYPE_OCCI_USHORT) return "TYPE_OCCI_USHORT";
+			if (type == TYPE_RUNDELTA_USHORT) return "TYPE_RUNDELTA_USHORT";
 			return "unknown compression type entry";
 		}
 
@@ -379,6 +479,8 @@ namespace ml {
 				m_depthCompressed = NULL;
 				m_colorSizeBytes = 0;
 				m_depthSizeBytes = 0;
+				m_bMappedColor = false;
+				m_bMappedDepth = false;
 				m_cameraToWorld.setZero(-std::numeric_limits<float>::infinity());
 				m_timeStampColor = 0;
 				m_timeStampDepth = 0;
@@ -390,6 +492,8 @@ namespace ml {
 				m_depthSizeBytes = other.m_depthSizeBytes;
 				m_colorCompressed = (unsigned char*)std::malloc(m_colorSizeBytes);
 				m_depthCompressed = (unsigned char*)std::malloc(m_depthSizeBytes);
+				m_bMappedColor = false;
+				m_bMappedDepth = false;
 
 				if (!m_colorCompressed || !m_depthCompressed) throw MLIB_EXCEPTION("out of memory");
 
@@ -406,6 +510,8 @@ namespace ml {
 				m_depthSizeBytes = other.m_depthSizeBytes;
 				m_colorCompressed = other.m_colorCompressed;
 				m_depthCompressed = other.m_depthCompressed;
+				m_bMappedColor = other.m_bMappedColor;
+				m_bMappedDepth = other.m_bMappedDepth;
 
 				m_timeStampColor = other.m_timeStampColor;
 				m_timeStampDepth = other.m_timeStampDepth;
@@ -464,6 +570,8 @@ namespace ml {
 
 		private:
 			friend class SensorData;
+			friend class SensorDataRandomAccessReader;
+			friend class SensorDataStreamReader;
 
 			RGBDFrame(
 				const vec3uc* color, unsigned int colorWidth, unsigned int colorHeight,
@@ -472,16 +580,19 @@ namespace ml {
 				COMPRESSION_TYPE_COLOR colorType = TYPE_JPEG,
 				COMPRESSION_TYPE_DEPTH depthType = TYPE_ZLIB_USHORT,
 				UINT64 timeStampColor = 0,
-				UINT64 timeStampDepth = 0)
+				UINT64 timeStampDepth = 0,
+				unsigned int colorQuality = 90)
 			{
 				m_colorCompressed = NULL;
 				m_depthCompressed = NULL;
 				m_colorSizeBytes = 0;
 				m_depthSizeBytes = 0;
+				m_bMappedColor = false;
+				m_bMappedDepth = false;
 
 				if (color) {
 					//Timer t;
-					compressColor(color, colorWidth, colorHeight, colorType);
+					compressColor(color, colorWidth, colorHeight, colorType, colorQuality);
 					//std::cout << "compressColor " << t.getElapsedTimeMS() << " [ms] " << std::endl;
 				}
 				if (depth) {
@@ -497,27 +608,33 @@ namespace ml {
 			
 			//! overwrites the depth frame data
 			void replaceDepth(const unsigned short* depth, unsigned int depthWidth, unsigned int depthHeight, COMPRESSION_TYPE_DEPTH depthType = TYPE_ZLIB_USHORT) {
+				const UINT64 timeStampDepth = m_timeStampDepth;	//freeDepth() resets the time stamp
 				freeDepth();
 				compressDepth(depth, depthWidth, depthHeight, depthType);
+				m_timeStampDepth = timeStampDepth;
 			}
 
 			//! overwrites the color frame data
-			void replaceColor(const vec3uc* color, unsigned int colorWidth, unsigned int colorHeight, COMPRESSION_TYPE_COLOR colorType = TYPE_JPEG) {
+			void replaceColor(const vec3uc* color, unsigned int colorWidth, unsigned int colorHeight, COMPRESSION_TYPE_COLOR colorType = TYPE_JPEG, unsigned int colorQuality = 90) {
+				const UINT64 timeStampColor = m_timeStampColor;	//freeColor() resets the time stamp
 				freeColor();
-				compressColor(color, colorWidth, colorHeight, colorType);
+				compressColor(color, colorWidth, colorHeight, colorType, colorQuality);
+				m_timeStampColor = timeStampColor;
 			}
 
 			void freeColor() {
-				if (m_colorCompressed) std::free(m_colorCompressed);
+				if (m_colorCompressed && !m_bMappedColor) std::free(m_colorCompressed);
 				m_colorCompressed = NULL;
 				m_colorSizeBytes = 0;
 				m_timeStampColor = 0;
+				m_bMappedColor = false;
 			}
 			void freeDepth() {
-				if (m_depthCompressed) std::free(m_depthCompressed);
+				if (m_depthCompressed && !m_bMappedDepth) std::free(m_depthCompressed);
 				m_depthCompressed = NULL;
 				m_depthSizeBytes = 0;
 				m_timeStampDepth = 0;
+				m_bMappedDepth = false;
 			}
 
 			//! assignment operator
@@ -529,6 +646,8 @@ namespace ml {
 					m_depthSizeBytes = other.m_depthSizeBytes;
 					m_colorCompressed = (unsigned char*)std::malloc(m_colorSizeBytes);
 					m_depthCompressed = (unsigned char*)std::malloc(m_depthSizeBytes);
+					m_bMappedColor = false;
+					m_bMappedDepth = false;
 
 					if (!m_colorCompressed || !m_depthCompressed) throw MLIB_EXCEPTION("out of memory");
 
@@ -551,6 +670,8 @@ namespace ml {
 					m_depthSizeBytes = other.m_depthSizeBytes;
 					m_colorCompressed = other.m_colorCompressed;
 					m_depthCompressed = other.m_depthCompressed;
+					m_bMappedColor = other.m_bMappedColor;
+					m_bMappedDepth = other.m_bMappedDepth;
 
 					m_timeStampColor = other.m_timeStampColor;
 					m_timeStampDepth = other.m_timeStampDepth;
@@ -563,10 +684,11 @@ namespace ml {
 			}
 
 
-			void compressColor(const vec3uc* color, unsigned int width, unsigned int height, COMPRESSION_TYPE_COLOR type) {
+			//! quality (in [1, 100]) is only used by the JPEG encoder; without _USE_UPLINK_COMPRESSION the bundled stb png writer and jpegCodec.h are used
+			void compressColor(const vec3uc* color, unsigned int width, unsigned int height, COMPRESSION_TYPE_COLOR type, unsigned int quality = 90) {
 
 				if (type == TYPE_RAW) {
-					if (m_colorSizeBytes != width*height) {
+					if (m_colorSizeBytes != width*height*sizeof(vec3uc)) {
 						freeColor();
 						m_colorSizeBytes = width*height*sizeof(vec3uc);
 						m_colorCompressed = (unsigned char*)std::malloc(m_colorSizeBytes);
@@ -589,7 +711,12 @@ namespace ml {
 					m_colorSizeBytes = block.Size;
 					block.relinquishOwnership();
 #else
-					throw MLIB_EXCEPTION("need UPLINK_COMPRESSION");
+					//both encoders keep all state on the stack, so frames can be compressed on several threads at once
+					int sizeBytes = 0;
+					if (type == TYPE_PNG)	m_colorCompressed = stb::stbi_write_png_to_mem((unsigned char*)color, 0, (int)width, (int)height, 3, &sizeBytes);
+					else					m_colorCompressed = compressColorJPEG(color, width, height, quality, sizeBytes);
+					if (!m_colorCompressed) throw MLIB_EXCEPTION("color compression failed");
+					m_colorSizeBytes = sizeBytes;
 #endif
 				}
 				else {
@@ -597,6 +724,37 @@ namespace ml {
 				}
 			}
 
+			//! JPEG encoding into a malloc'ed buffer (jpegcodec::writeToFunc has the interface of stbi_write_jpg_to_func); returns NULL on failure
+			static unsigned char* compressColorJPEG(const vec3uc* color, unsigned int width, unsigned int height, unsigned int quality, int& sizeBytes) {
+				struct Buffer {
+					unsigned char* data;
+					size_t size, capacity;
+					bool failed;
+					static void write(void* context, void* bytes, int size) {
+						Buffer& b = *(Buffer*)context;
+						if (b.failed) return;
+						if (b.size + size > b.capacity) {
+							const size_t capacity = std::max(2 * b.capacity, b.size + size);
+							unsigned char* grown = (unsigned char*)std::realloc(b.data, capacity);
+							if (!grown) { b.failed = true; return; }
+							b.data = grown;
+							b.capacity = capacity;
+						}
+						std::memcpy(b.data + b.size, bytes, size);
+						b.size += size;
+					}
+				};
+				Buffer b = { NULL, 0, (size_t)width * height / 4 + 1024, false };	//initial guess of 2 bits per pixel, grown on demand
+				b.data = (unsigned char*)std::malloc(b.capacity);
+				if (!b.data) return NULL;
+				if (!jpegcodec::writeToFunc(&Buffer::write, &b, (int)width, (int)height, 3, color, (int)quality) || b.failed) {
+					std::free(b.data);
+					return NULL;
+				}
+				sizeBytes = (int)b.size;
+				return b.data;
+			}
+
 			vec3uc* decompressColorAlloc(COMPRESSION_TYPE_COLOR type) const {
 				if (type == TYPE_RAW)	return decompressColorAlloc_raw(type);
 #ifdef _USE_UPLINK_COMPRESSION
@@ -645,6 +803,34 @@ namespace ml {
 				return res;
 			}
 
+			//! decompresses into a buffer of width*height pixels
+			void decompressColorInto(vec3uc* color, unsigned int width, unsigned int height, COMPRESSION_TYPE_COLOR type) const {
+				if (m_colorCompressed == NULL || m_colorSizeBytes == 0) throw MLIB_EXCEPTION("invalid data");
+				const size_t sizeBytes = (size_t)width*height*sizeof(vec3uc);
+				if (type == TYPE_RAW) {
+					if (m_colorSizeBytes != sizeBytes) throw MLIB_EXCEPTION("invalid data");
+					memcpy(color, m_colorCompressed, sizeBytes);
+					return;
+				}
+#ifdef _USE_UPLINK_COMPRESSION
+				vec3uc* res = decompressColorAlloc_occ(type);
+				memcpy(color, res, sizeBytes);
+				std::free(res);
+#else
+				//stb has no decode-into-buffer interface for images; it allocates the decoded image internally
+				if (type != TYPE_JPEG && type != TYPE_PNG) throw MLIB_EXCEPTION("invliad type");
+				int w = 0, h = 0;
+				unsigned char* raw = stb::stbi_load_from_memory(m_colorCompressed, (int)m_colorSizeBytes, &w, &h, NULL, 3);
+				if (raw == NULL) throw MLIB_EXCEPTION("decompression error");
+				if ((unsigned int)w != width || (unsigned int)h != height) {
+					std::free(raw);
+					throw MLIB_EXCEPTION("image dimensions do not match");
+				}
+				memcpy(color, raw, sizeBytes);
+				std::free(raw);
+#endif
+			}
+
 			void compressDepth(const unsigned short* depth, unsigned int width, unsigned int height, COMPRESSION_TYPE_DEPTH type) {
 				freeDepth();
 
@@ -685,6 +871,12 @@ namespace ml {
 					throw MLIB_EXCEPTION("need UPLINK_COMPRESSION");
 #endif
 				}
+				else if (type == TYPE_RUNDELTA_USHORT) {
+					freeDepth();
+					unsigned char* tmpBuff = (unsigned char*)std::malloc(depthcodec::compressBound(width*height));
+					m_depthSizeBytes = depthcodec::compress(depth, width*height, tmpBuff);
+					m_depthCompressed = (unsigned char*)std::realloc(tmpBuff, m_depthSizeBytes);
+				}
 				else {
 					throw MLIB_EXCEPTION("unknown compression type");
 				}
@@ -694,6 +886,7 @@ namespace ml {
 				if (type == TYPE_RAW_USHORT)	return decompressDepthAlloc_raw(type);
 				else if (type == TYPE_ZLIB_USHORT) return decompressDepthAlloc_stb(type);
 				else if (type == TYPE_OCCI_USHORT) return decompressDepthAlloc_occ(width, height, type);
+				else if (type == TYPE_RUNDELTA_USHORT) return decompressDepthAlloc_rundelta(width, height, type);
 				else {
 					throw MLIB_EXCEPTION("invalid type");
 					return NULL;
@@ -721,6 +914,16 @@ namespace ml {
 #endif
 			}
 
+			unsigned short* decompressDepthAlloc_rundelta(unsigned int width, unsigned int height, COMPRESSION_TYPE_DEPTH type) const {
+				if (type != TYPE_RUNDELTA_USHORT) throw MLIB_EXCEPTION("invliad type");
+				unsigned short* res = (unsigned short*)std::malloc(width*height * 2);
+				if (!depthcodec::decompress(m_depthCompressed, m_depthSizeBytes, res, width*height)) {
+					std::free(res);
+					throw MLIB_EXCEPTION("decompression error");
+				}
+				return res;
+			}
+
 			unsigned short* decompressDepthAlloc_raw(COMPRESSION_TYPE_DEPTH type) const {
 				if (type != TYPE_RAW_USHORT) throw MLIB_EXCEPTION("invliad type");
 				if (m_depthCompressed == NULL || m_depthSizeBytes == 0) throw MLIB_EXCEPTION("invalid data");
@@ -729,6 +932,34 @@ namespace ml {
 				return res;
 			}
 
+			//! decompresses into a buffer of width*height values (no heap allocations)
+			void decompressDepthInto(unsigned short* depth, unsigned int width, unsigned int height, COMPRESSION_TYPE_DEPTH type) const {
+				if (m_depthCompressed == NULL || m_depthSizeBytes == 0) throw MLIB_EXCEPTION("invalid data");
+				const size_t sizeBytes = (size_t)width*height*sizeof(unsigned short);
+				if (type == TYPE_RAW_USHORT) {
+					if (m_depthSizeBytes != sizeBytes) throw MLIB_EXCEPTION("invalid data");
+					memcpy(depth, m_depthCompressed, sizeBytes);
+				}
+				else if (type == TYPE_ZLIB_USHORT) {
+					int len = stb::stbi_zlib_decode_buffer((char*)depth, (int)sizeBytes, (const char*)m_depthCompressed, (int)m_depthSizeBytes);
+					if (len != (int)sizeBytes) throw MLIB_EXCEPTION("decompression error");
+				}
+				else if (type == TYPE_OCCI_USHORT) {
+#ifdef _USE_UPLINK_COMPRESSION
+					uplinksimple::decode(m_depthCompressed, (unsigned int)m_depthSizeBytes, width*height, depth);
+					uplinksimple::shift2depth(depth, width*height);
+#else
+					throw MLIB_EXCEPTION("need UPLINK_COMPRESSION");
+#endif
+				}
+				else if (type == TYPE_RUNDELTA_USHORT) {
+					if (!depthcodec::decompress(m_depthCompressed, m_depthSizeBytes, depth, width*height)) throw MLIB_EXCEPTION("decompression error");
+				}
+				else {
+					throw MLIB_EXCEPTION("invalid type");
+				}
+			}
+
 
 			void saveToFile(std::ostream& out) const {
 				out.write((const char*)&m_cameraToWorld, sizeof(mat4f));
@@ -753,6 +984,37 @@ namespace ml {
 				in.read((char*)m_depthCompressed, m_depthSizeBytes);
 			}
 
+			//! size of the fixed part of a frame record (pose, time stamps, payload sizes)
+			static UINT64 getRecordHeaderSizeBytes() {
+				return sizeof(mat4f) + 4 * sizeof(UINT64);
+			}
+
+			//! size of the frame record in a .sens file
+			UINT64 getRecordSizeBytes() const {
+				return getRecordHeaderSizeBytes() + m_colorSizeBytes + m_depthSizeBytes;
+			}
+
+			//! points the frame into an in-memory (typically mapped) frame record without copying the payloads; returns the record size in bytes
+			UINT64 loadFromMemory(const unsigned char* data, UINT64 sizeBytes) {
+				free();
+				const UINT64 headerSizeBytes = getRecordHeaderSizeBytes();
+				if (sizeBytes < headerSizeBytes) throw MLIB_EXCEPTION("unexpected end of file");
+				std::memcpy(&m_cameraToWorld, data, sizeof(mat4f));	data += sizeof(mat4f);
+				std::memcpy(&m_timeStampColor, data, sizeof(UINT64));	data += sizeof(UINT64);
+				std::memcpy(&m_timeStampDepth, data, sizeof(UINT64));	data += sizeof(UINT64);
+				std::memcpy(&m_colorSizeBytes, data, sizeof(UINT64));	data += sizeof(UINT64);
+				std::memcpy(&m_depthSizeBytes, data, sizeof(UINT64));	data += sizeof(UINT64);
+				if (m_colorSizeBytes > sizeBytes - headerSizeBytes || m_depthSizeBytes > sizeBytes - headerSizeBytes - m_colorSizeBytes) {
+					m_colorSizeBytes = m_depthSizeBytes = 0;
+					throw MLIB_EXCEPTION("unexpected end of file");
+				}
+				m_colorCompressed = const_cast<unsigned char*>(data);
+				m_depthCompressed = const_cast<unsigned char*>(data + m_colorSizeBytes);
+				m_bMappedColor = true;
+				m_bMappedDepth = true;
+				return headerSizeBytes + m_colorSizeBytes + m_depthSizeBytes;
+			}
+
 			bool operator==(const RGBDFrame& other) const {
 				if (m_colorSizeBytes != other.m_colorSizeBytes) return false;
 				if (m_depthSizeBytes != other.m_depthSizeBytes) return false;
@@ -778,6 +1040,8 @@ namespace ml {
 			UINT64 m_depthSizeBytes;					//compressed byte size
 			unsigned char* m_colorCompressed;			//compressed color data
 			unsigned char* m_depthCompressed;			//compressed depth data
+			bool m_bMappedColor;						//color data points into a memory-mapped file (not owned)
+			bool m_bMappedDepth;						//depth data points into a memory-mapped file (not owned)
 			UINT64 m_timeStampColor;					//time stamp color (convection: in microseconds)
 			UINT64 m_timeStampDepth;					//time stamp depth (convention: in microseconds)
 			mat4f m_cameraToWorld;						//camera trajectory: from current frame to base frame
@@ -793,6 +1057,11 @@ namespace ml {
 				timeStamp = 0;
 			}
 
+			//! size of an IMU frame record in a .sens file
+			static UINT64 getRecordSizeBytes() {
+				return 5 * sizeof(vec3d) + sizeof(UINT64);
+			}
+
 			void loadFromFile(std::istream& in) {
 				in.read((char*)&rotationRate, sizeof(vec3d));
 				in.read((char*)&acceleration, sizeof(vec3d));
@@ -840,6 +1109,86 @@ namespace ml {
 		///version 3 was missing the IMUFrame vector
 		//the first 3 versions [0,1,2] are reserved for the old .sensor files
 
+#define M_SENSOR_DATA_INDEX_VERSION 1
+#define M_SENSOR_DATA_INDEX_MAGIC 0x31584449534e4553ull	//"SENSIDX1"
+#define M_SENSOR_DATA_INDEX_VERSION_PREVIEW 2
+#define M_SENSOR_DATA_INDEX_MAGIC_PREVIEW 0x32584449534e4553ull	//"SENSIDX2"
+
+		//! byte offsets of the records of a .sens file; optionally stored as a trailer behind the IMU block (or as a sidecar file)
+		//! layout: [version][numFrames][frameOffsets][IMUOffset] followed by the footer [dataSizeBytes][magic]
+		//! with a preview (see writePreviews; between the IMU block and the index): [version 2][numFrames][frameOffsets][IMUOffset][dataSizeBytes][previewOffset] followed by the footer [indexSizeBytes][magic 2]
+		struct FrameIndex {
+			FrameIndex() {
+				m_IMUOffset = 0;
+				m_dataSizeBytes = 0;
+				m_previewOffset = 0;
+			}
+
+			void saveToFile(std::ostream& out) const {
+				const bool hasPreview = m_previewOffset != 0;
+				const unsigned int version = hasPreview ? M_SENSOR_DATA_INDEX_VERSION_PREVIEW : M_SENSOR_DATA_INDEX_VERSION;
+				const UINT64 numFrames = m_frameOffsets.size();
+				const UINT64 magic = hasPreview ? M_SENSOR_DATA_INDEX_MAGIC_PREVIEW : M_SENSOR_DATA_INDEX_MAGIC;
+				out.write((const char*)&version, sizeof(unsigned int));
+				out.write((const char*)&numFrames, sizeof(UINT64));
+				if (numFrames > 0) out.write((const char*)&m_frameOffsets[0], numFrames*sizeof(UINT64));
+				out.write((const char*)&m_IMUOffset, sizeof(UINT64));
+				if (hasPreview) {
+					const UINT64 indexSizeBytes = sizeof(unsigned int) + (numFrames + 4) * sizeof(UINT64);
+					out.write((const char*)&m_dataSizeBytes, sizeof(UINT64));
+					out.write((const char*)&m_previewOffset, sizeof(UINT64));
+					out.write((const char*)&indexSizeBytes, sizeof(UINT64));
+				}
+				else {
+					out.write((const char*)&m_dataSizeBytes, sizeof(UINT64));
+				}
+				out.write((const char*)&magic, sizeof(UINT64));
+			}
+
+			//! reads the index whose footer ends at 'endOffset' (a trailer starts at m_dataSizeBytes, or indexSizeBytes before the footer with a preview; a sidecar file at 0); returns false if there is no valid index
+			bool loadFromFile(std::istream& in, UINT64 endOffset, bool isTrailer) {
+				const UINT64 footerSizeBytes = 2 * sizeof(UINT64);
+				if (endOffset < footerSizeBytes + sizeof(unsigned int) + 2 * sizeof(UINT64)) return false;
+
+				UINT64 footer = 0, magic = 0;
+				in.clear();
+				in.seekg(endOffset - footerSizeBytes);
+				in.read((char*)&footer, sizeof(UINT64));
+				in.read((char*)&magic, sizeof(UINT64));
+				if (!in || (magic != M_SENSOR_DATA_INDEX_MAGIC && magic != M_SENSOR_DATA_INDEX_MAGIC_PREVIEW)) return false;
+				const bool hasPreview = magic == M_SENSOR_DATA_INDEX_MAGIC_PREVIEW;
+				if (hasPreview && footer > endOffset - footerSizeBytes) return false;
+
+				const UINT64 begin = !isTrailer ? 0 : hasPreview ? endOffset - footerSizeBytes - footer : footer;
+				if (begin >= endOffset) return false;
+				unsigned int version = 0;
+				UINT64 numFrames = 0;
+				in.seekg(begin);
+				in.read((char*)&version, sizeof(unsigned int));
+				in.read((char*)&numFrames, sizeof(UINT64));
+				if (!in || version != (hasPreview ? M_SENSOR_DATA_INDEX_VERSION_PREVIEW : M_SENSOR_DATA_INDEX_VERSION)) return false;
+				if (begin + sizeof(unsigned int) + (numFrames + (hasPreview ? 4 : 2)) * sizeof(UINT64) + footerSizeBytes != endOffset) return false;
+
+				m_frameOffsets.resize(numFrames);
+				if (numFrames > 0) in.read((char*)&m_frameOffsets[0], numFrames*sizeof(UINT64));
+				in.read((char*)&m_IMUOffset, sizeof(UINT64));
+				if (hasPreview) {
+					in.read((char*)&m_dataSizeBytes, sizeof(UINT64));
+					in.read((char*)&m_previewOffset, sizeof(UINT64));
+				}
+				else {
+					m_dataSizeBytes = footer;
+					m_previewOffset = 0;
+				}
+				return (bool)in;
+			}
+
+			std::vector<UINT64> m_frameOffsets;	//absolute offsets of the RGBDFrame records
+			UINT64 m_IMUOffset;					//absolute offset of the IMU block (starts with the number of IMU frames)
+			UINT64 m_dataSizeBytes;				//end of the IMU block (i.e., where a trailing index or the preview starts)
+			UINT64 m_previewOffset;				//absolute offset of the preview stream (0: no preview)
+		};
+
 
 		SensorData() {
 			m_versionNumber = M_SENSOR_DATA_VERSION;
@@ -850,11 +1199,13 @@ namespace ml {
 			m_depthHeight = 0;
 			m_colorCompressionType = TYPE_COLOR_UNKNOWN;
 			m_depthCompressionType = TYPE_DEPTH_UNKNOWN;
+			m_colorCompressionQuality = 90;
 		}
 
 		SensorData(const std::string& filename) {
 			m_versionNumber = M_SENSOR_DATA_VERSION;
 			m_sensorName = "Unknown";
+			m_colorCompressionQuality = 90;
 			loadFromFile(filename);
 		}
 
@@ -877,6 +1228,7 @@ namespace ml {
 			m_IMUFrames.clear();
 			m_colorCompressionType = TYPE_COLOR_UNKNOWN;
 			m_depthCompressionType = TYPE_DEPTH_UNKNOWN;
+			m_mappedFile.reset();
 		}
 
 		//! checks the version number
@@ -910,13 +1262,21 @@ namespace ml {
 			m_calibrationDepth = calibrationDepth;
 		}
 
+		//! sets the JPEG quality in [1, 100] used when frames are added or replaced (not stored in the file)
+		void setColorCompressionQuality(unsigned int quality) {
+			m_colorCompressionQuality = std::max(1u, std::min(quality, 100u));
+		}
+		unsigned int getColorCompressionQuality() const {
+			return m_colorCompressionQuality;
+		}
+
 		// Ownership of frame is transferred. Make sure to free the frame by hand.
 		RGBDFrame createFrame(const vec3uc* color, const unsigned short* depth, const mat4f& cameraToWorld = mat4f::identity(), UINT64 timeStampColor = 0, UINT64 timeStampDepth = 0) const {
-			return RGBDFrame(color, m_colorWidth, m_colorHeight, depth, m_depthWidth, m_depthHeight, cameraToWorld, m_colorCompressionType, m_depthCompressionType, timeStampColor, timeStampDepth);
+			return RGBDFrame(color, m_colorWidth, m_colorHeight, depth, m_depthWidth, m_depthHeight, cameraToWorld, m_colorCompressionType, m_depthCompressionType, timeStampColor, timeStampDepth, m_colorCompressionQuality);
 		}
 
 		RGBDFrame& addFrame(const vec3uc* color, const unsigned short* depth, const mat4f& cameraToWorld = mat4f::identity(), UINT64 timeStampColor = 0, UINT64 timeStampDepth = 0) {
-			m_frames.push_back(RGBDFrame(color, m_colorWidth, m_colorHeight, depth, m_depthWidth, m_depthHeight, cameraToWorld, m_colorCompressionType, m_depthCompressionType, timeStampColor, timeStampDepth));
+			m_frames.push_back(RGBDFrame(color, m_colorWidth, m_colorHeight, depth, m_depthWidth, m_depthHeight, cameraToWorld, m_colorCompressionType, m_depthCompressionType, timeStampColor, timeStampDepth, m_colorCompressionQuality));
 			return m_frames.back();
 		}
 
@@ -945,6 +1305,58 @@ namespace ml {
 			return decompressDepthAlloc(m_frames[frameIdx]);
 		}
 
+		//! decompresses the frame into 'color' (m_colorWidth*m_colorHeight pixels, owned by the caller)
+		void decompressColorInto(const RGBDFrame& f, vec3uc* color) const {
+			f.decompressColorInto(color, m_colorWidth, m_colorHeight, m_colorCompressionType);
+		}
+		//! decompresses the frame into 'color' (m_colorWidth*m_colorHeight pixels, owned by the caller)
+		void decompressColorInto(size_t frameIdx, vec3uc* color) const {
+			if (frameIdx >= m_frames.size()) throw MLIB_EXCEPTION("out of bounds");
+			decompressColorInto(m_frames[frameIdx], color);
+		}
+
+		//! decompresses the frame into 'depth' (m_depthWidth*m_depthHeight values, owned by the caller)
+		void decompressDepthInto(const RGBDFrame& f, unsigned short* depth) const {
+			f.decompressDepthInto(depth, m_depthWidth, m_depthHeight, m_depthCompressionType);
+		}
+		//! decompresses the frame into 'depth' (m_depthWidth*m_depthHeight values, owned by the caller)
+		void decompressDepthInto(size_t frameIdx, unsigned short* depth) const {
+			if (frameIdx >= m_frames.size()) throw MLIB_EXCEPTION("out of bounds");
+			decompressDepthInto(m_frames[frameIdx], depth);
+		}
+
+		//! reusable color/depth frame buffers for decompress*Into, one set per thread (e.g., indexed by omp_get_thread_num())
+		class FrameBufferPool {
+		public:
+			FrameBufferPool(const SensorData& sd, unsigned int numThreads = 1) {
+				m_color.resize(std::max(numThreads, 1u));
+				m_depth.resize(std::max(numThreads, 1u));
+				for (size_t i = 0; i < m_color.size(); i++) {
+					m_color[i].resize((size_t)sd.m_colorWidth*sd.m_colorHeight);
+					m_depth[i].resize((size_t)sd.m_depthWidth*sd.m_depthHeight);
+				}
+			}
+
+			unsigned int getNumThreads() const {
+				return (unsigned int)m_color.size();
+			}
+			vec3uc* getColor(unsigned int thread = 0) {
+				return m_color[thread].data();
+			}
+			unsigned short* getDepth(unsigned int thread = 0) {
+				return m_depth[thread].data();
+			}
+
+			//! decompresses the frame into the buffers of the given thread
+			void decompress(const SensorData& sd, const RGBDFrame& f, unsigned int thread = 0) {
+				sd.decompressColorInto(f, getColor(thread));
+				sd.decompressDepthInto(f, getDepth(thread));
+			}
+		private:
+			std::vector<std::vector<vec3uc>> m_color;
+			std::vector<std::vector<unsigned short>> m_depth;
+		};
+
 		//! replaces the depth data of the given frame
 		void replaceDepth(RGBDFrame& f, const unsigned short* depth) {
 			f.replaceDepth(depth, m_depthWidth, m_depthHeight, m_depthCompressionType);
@@ -956,7 +1368,7 @@ namespace ml {
 
 		//! replaces the color data of the given frame
 		void replaceColor(RGBDFrame& f, const vec3uc* color) {
-			f.replaceColor(color, m_colorWidth, m_colorHeight, m_colorCompressionType);
+			f.replaceColor(color, m_colorWidth, m_colorHeight, m_colorCompressionType, m_colorCompressionQuality);
 		}
 		void replaceColor(size_t frameIdx, const vec3uc* color) {
 			if (frameIdx > m_frames.size()) throw MLIB_EXCEPTION("out of bounds");
@@ -964,33 +1376,29 @@ namespace ml {
 		}
 
 #ifdef _HAS_MLIB
-		//! not efficient but easy to use 
+		//! easy to use; decodes into a scratch buffer and converts to meters
 		DepthImage32 computeDepthImage(const RGBDFrame& f) const {		
-			USHORT* depth = decompressDepthAlloc(f);
 			DepthImage32 d(m_depthWidth, m_depthHeight);
 			d.setInvalidValue(0.0f);
-			for (unsigned int i = 0; i < m_depthWidth * m_depthHeight; i++) {
-				if (depth[i] == 0) d.getData()[i] = d.getInvalidValue();
-				else d.getData()[i] = (float)depth[i] / m_depthShift;
+			std::vector<unsigned short> depth((size_t)m_depthWidth * m_depthHeight);
+			decompressDepthInto(f, depth.data());
+			float* data = d.getData();
+			for (size_t i = 0; i < depth.size(); i++) {
+				data[i] = (depth[i] == 0) ? d.getInvalidValue() : (float)depth[i] / m_depthShift;
 			}
-			std::free(depth);
 			return d;
 		}
-		//! not efficient but easy to use 
+		//! easy to use; decodes directly into the image
 		DepthImage32 computeDepthImage(size_t frameIdx) const {
 			return computeDepthImage(m_frames[frameIdx]);
 		}
-		//! not efficient but easy to use 
+		//! easy to use; decodes directly into the image
 		ColorImageR8G8B8 computeColorImage(const RGBDFrame& f) const {
-			vec3uc* color = decompressColorAlloc(f);
 			ColorImageR8G8B8 c(m_colorWidth, m_colorHeight);
-			for (unsigned int i = 0; i < m_colorWidth * m_colorHeight; i++) {
-				c.getData()[i] = color[i];
-			}
-			std::free(color);
+			decompressColorInto(f, c.getData());
 			return c;
 		}
-		//! not efficient but easy to use 
+		//! easy to use; decodes directly into the image
 		ColorImageR8G8B8 computeColorImage(size_t frameIdx) const {
 			return computeColorImage(m_frames[frameIdx]);
 		}
@@ -1043,6 +1451,148 @@ namespace ml {
 			return findClosestIMUFrame(m_frames[frameIdx], basedOnRGB);
 		}
 
+		enum IMU_INTERPOLATION {
+			IMU_NEAREST = 0,	//closest IMU frame in time (same as findClosestIMUFrame)
+			IMU_LINEAR = 1,		//linear interpolation between the IMU frames before and after the frame
+			IMU_SLERP = 2		//like IMU_LINEAR, but attitude (roll, pitch, yaw) and gravity direction are interpolated on the sphere
+		};
+
+		//! IMU data of all RGB-D frames as one array per quantity (frame i at index i; a vector<vec3d> is a flat array of 3 doubles per frame)
+		struct IMUFrameAlignment {
+			std::vector<vec3d> m_rotationRate;
+			std::vector<vec3d> m_acceleration;
+			std::vector<vec3d> m_magneticField;
+			std::vector<vec3d> m_attitude;			//roll, pitch, yaw
+			std::vector<vec3d> m_gravity;
+			std::vector<size_t> m_closestIMUFrame;	//index into m_IMUFrames of the closest IMU frame
+
+			size_t getNumFrames() const {
+				return m_closestIMUFrame.size();
+			}
+			void resize(size_t numFrames) {
+				m_rotationRate.resize(numFrames);
+				m_acceleration.resize(numFrames);
+				m_magneticField.resize(numFrames);
+				m_attitude.resize(numFrames);
+				m_gravity.resize(numFrames);
+				m_closestIMUFrame.resize(numFrames);
+			}
+		};
+
+		//! aligns all RGB-D frames with the IMU frames (sorted by time stamp) in a single merge pass over both time lines; frames outside the IMU time range get the first or last IMU frame
+		IMUFrameAlignment alignIMUFrames(IMU_INTERPOLATION interpolation = IMU_NEAREST, bool basedOnRGB = true) const {
+			if (m_IMUFrames.size() == 0) throw MLIB_EXCEPTION("no imu data available");
+
+			//visit the frames in time order (they usually are already)
+			std::vector<size_t> order(m_frames.size());
+			for (size_t i = 0; i < order.size(); i++) order[i] = i;
+			const auto timeStamp = [&](size_t i) { return basedOnRGB ? m_frames[i].m_timeStampColor : m_frames[i].m_timeStampDepth; };
+			std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return timeStamp(a) < timeStamp(b); });
+
+			IMUFrameAlignment res;
+			res.resize(m_frames.size());
+			size_t next = 0;	//first IMU frame with timeStamp >= t
+			for (size_t k = 0; k < order.size(); k++) {
+				const size_t i = order[k];
+				const UINT64 t = timeStamp(i);
+				while (next < m_IMUFrames.size() && m_IMUFrames[next].timeStamp < t) next++;
+
+				size_t a = 0, b = 0;	//bracketing IMU frames
+				if (next == 0) a = b = 0;
+				else if (next == m_IMUFrames.size()) a = b = m_IMUFrames.size() - 1;
+				else if (m_IMUFrames[next].timeStamp == t) a = b = next;
+				else {
+					a = next - 1;
+					b = next;
+				}
+				res.m_closestIMUFrame[i] = (t - std::min(t, m_IMUFrames[a].timeStamp) < m_IMUFrames[b].timeStamp - std::min(m_IMUFrames[b].timeStamp, t)) ? a : b;
+
+				const IMUFrame& fa = m_IMUFrames[interpolation == IMU_NEAREST ? res.m_closestIMUFrame[i] : a];
+				const IMUFrame& fb = m_IMUFrames[interpolation == IMU_NEAREST ? res.m_closestIMUFrame[i] : b];
+				const double w = (a == b || interpolation == IMU_NEAREST) ? 0.0 : (double)(t - fa.timeStamp) / (double)(fb.timeStamp - fa.timeStamp);
+				res.m_rotationRate[i] = lerp(fa.rotationRate, fb.rotationRate, w);
+				res.m_acceleration[i] = lerp(fa.acceleration, fb.acceleration, w);
+				res.m_magneticField[i] = lerp(fa.magneticField, fb.magneticField, w);
+				if (interpolation == IMU_SLERP && w != 0.0) {
+					res.m_attitude[i] = slerpAttitude(fa.attitude, fb.attitude, w);
+					res.m_gravity[i] = slerpDirection(fa.gravity, fb.gravity, w);
+				}
+				else {
+					res.m_attitude[i] = lerp(fa.attitude, fb.attitude, w);
+					res.m_gravity[i] = lerp(fa.gravity, fb.gravity, w);
+				}
+			}
+			return res;
+		}
+
+		static vec3d lerp(const vec3d& a, const vec3d& b, double w) {
+			vec3d res;
+			for (unsigned int k = 0; k < 3; k++) res.array[k] = a.array[k] + w * (b.array[k] - a.array[k]);
+			return res;
+		}
+
+		//! interpolates the direction on the sphere and the length linearly
+		static vec3d slerpDirection(const vec3d& a, const vec3d& b, double w) {
+			const double la = std::sqrt(a.x*a.x + a.y*a.y + a.z*a.z), lb = std::sqrt(b.x*b.x + b.y*b.y + b.z*b.z);
+			if (la == 0.0 || lb == 0.0) return lerp(a, b, w);
+			const double cosAngle = std::max(-1.0, std::min(1.0, (a.x*b.x + a.y*b.y + a.z*b.z) / (la * lb)));
+			const double angle = std::acos(cosAngle);
+			if (angle < 1e-9) return lerp(a, b, w);
+			const double sa = std::sin((1.0 - w) * angle) / (std::sin(angle) * la), sb = std::sin(w * angle) / (std::sin(angle) * lb);
+			const double length = la + w * (lb - la);
+			vec3d res;
+			for (unsigned int k = 0; k < 3; k++) res.array[k] = (sa * a.array[k] + sb * b.array[k]) * length;
+			return res;
+		}
+
+		//! interpolates CoreMotion attitudes (roll about y, pitch about x, yaw about z; R = Rz(yaw) * Rx(pitch) * Ry(roll)) along the shortest rotation
+		static vec3d slerpAttitude(const vec3d& a, const vec3d& b, double w) {
+			//quaternions (w, x, y, z)
+			const auto toQuaternion = [](const vec3d& rpy, double* q) {
+				const double cr = std::cos(rpy.x / 2), sr = std::sin(rpy.x / 2);
+				const double cp = std::cos(rpy.y / 2), sp = std::sin(rpy.y / 2);
+				const double cy = std::cos(rpy.z / 2), sy = std::sin(rpy.z / 2);
+				//qz(yaw) * qx(pitch) * qy(roll)
+				q[0] = cy*cp*cr - sy*sp*sr;
+				q[1] = cy*sp*cr - sy*cp*sr;
+				q[2] = cy*cp*sr + sy*sp*cr;
+				q[3] = sy*cp*cr + cy*sp*sr;
+			};
+			double qa[4], qb[4], q[4];
+			toQuaternion(a, qa);
+			toQuaternion(b, qb);
+			double d = qa[0]*qb[0] + qa[1]*qb[1] + qa[2]*qb[2] + qa[3]*qb[3];
+			if (d < 0.0) {
+				for (unsigned int k = 0; k < 4; k++) qb[k] = -qb[k];
+				d = -d;
+			}
+			double wa = 1.0 - w, wb = w;
+			if (d < 0.9995) {
+				const double angle = std::acos(d);
+				wa = std::sin((1.0 - w) * angle) / std::sin(angle);
+				wb = std::sin(w * angle) / std::sin(angle);
+			}
+			double length = 0.0;
+			for (unsigned int k = 0; k < 4; k++) {
+				q[k] = wa * qa[k] + wb * qb[k];
+				length += q[k] * q[k];
+			}
+			length = std::sqrt(length);
+			for (unsigned int k = 0; k < 4; k++) q[k] /= length;
+
+			//rotation matrix entries needed for R = Rz * Rx * Ry
+			const double r01 = 2 * (q[1]*q[2] - q[0]*q[3]);
+			const double r11 = 1 - 2 * (q[1]*q[1] + q[3]*q[3]);
+			const double r20 = 2 * (q[1]*q[3] - q[0]*q[2]);
+			const double r21 = 2 * (q[2]*q[3] + q[0]*q[1]);
+			const double r22 = 1 - 2 * (q[1]*q[1] + q[2]*q[2]);
+			vec3d res;
+			res.x = std::atan2(-r20, r22);
+			res.y = std::asin(std::max(-1.0, std::min(1.0, r21)));
+			res.z = std::atan2(-r01, r11);
+			return res;
+		}
+
 #ifdef _HAS_MLIB
 		//! transforms the trajectory of all frames
 		void applyTransform(const mat4f& t) {
@@ -1097,163 +1647,1044 @@ namespace ml {
 			}
 		}
 
-		//! saves a .sens file
-		void saveToFile(const std::string& filename) const {
+		//! saves a .sens file (optionally followed by a frame index trailer for random access)
+		void saveToFile(const std::string& filename, bool withFrameIndex = false) const {
 			std::ofstream out(filename, std::ios::binary);
 			if (!out) {
 				throw std::runtime_error("Unable to open file for writing: " + filename);
 			}
 			writeHeaderToFile(out);
+			const UINT64 firstFrameOffset = (UINT64)out.tellp() + sizeof(UINT64);
 			writeRGBFramesToFile(out);
 			writeIMUFramesToFile(out);
+			if (withFrameIndex) computeFrameIndex(firstFrameOffset).saveToFile(out);
 		}
 
-#ifdef _HAS_MLIB
-		//! Enables writing out RGB frames directly to a file. Does not work with IMU frames and has to be closed after writing finished!
-		class LiveSensorDataWriter
-		{
-		public:
-			LiveSensorDataWriter(const SensorData* data, const std::string& filename, bool overwriteExistingFile = false, unsigned int cacheSize = 500)
-				: m_data(data), m_cacheSize(cacheSize), m_headerWritten(false), m_frameCounterRGB(0)
-			{
-				std::string actualFilename = filename;
-				if (!overwriteExistingFile) {
-					while (util::fileExists(actualFilename)) {
-						std::string path = util::directoryFromPath(actualFilename);
-						std::string curr = util::fileNameFromPath(actualFilename);
-						std::string ext = util::getFileExtension(curr);
-						curr = util::removeExtensions(curr);
-						std::string base = util::getBaseBeforeNumericSuffix(curr);
-						unsigned int num = util::getNumericSuffix(curr);
-						if (num == (unsigned int)-1) {
-							num = 0;
-						}
-						actualFilename = path + base + std::to_string(num + 1) + "." + ext;
-					}
-				}
-				m_out.open(actualFilename, std::ios::binary);
-				if (!m_out) {
-					throw std::runtime_error("Unable to open file for writing: " + filename);
-				}
-				startBackgroundThread();
+		//! computes the frame index of the in-memory frames, given the offset of the first frame record
+		FrameIndex computeFrameIndex(UINT64 firstFrameOffset) const {
+			FrameIndex index;
+			index.m_frameOffsets.resize(m_frames.size());
+			UINT64 offset = firstFrameOffset;
+			for (size_t i = 0; i < m_frames.size(); i++) {
+				index.m_frameOffsets[i] = offset;
+				offset += m_frames[i].getRecordSizeBytes();
 			}
+			index.m_IMUOffset = offset;
+			index.m_dataSizeBytes = offset + sizeof(UINT64) + m_IMUFrames.size() * IMUFrame::getRecordSizeBytes();
+			return index;
+		}
 
-			~LiveSensorDataWriter()
-			{
-				close();
-			}
+		//! computes the frame index of a .sens stream by walking over the frame records (the payloads are skipped, not read)
+		static FrameIndex computeFrameIndex(std::istream& in) {
+			SensorData header;
+			header.readHeaderFromFile(in);
+			UINT64 numFrames = 0;
+			in.read((char*)&numFrames, sizeof(UINT64));
+			if (!in) throw MLIB_EXCEPTION("unexpected end of file");
+
+			FrameIndex index;
+			for (UINT64 i = 0; i < numFrames; i++) {
+				const UINT64 offset = (UINT64)in.tellg();
+				UINT64 colorSizeBytes = 0, depthSizeBytes = 0;
+				in.seekg(sizeof(mat4f) + 2 * sizeof(UINT64), std::ios::cur);
+				in.read((char*)&colorSizeBytes, sizeof(UINT64));
+				in.read((char*)&depthSizeBytes, sizeof(UINT64));
+				if (!in) throw MLIB_EXCEPTION("unexpected end of file");
+				in.seekg(colorSizeBytes + depthSizeBytes, std::ios::cur);
+				index.m_frameOffsets.push_back(offset);
+			}
+			index.m_IMUOffset = (UINT64)in.tellg();
+			UINT64 numIMUFrames = 0;
+			in.read((char*)&numIMUFrames, sizeof(UINT64));
+			if (!in) throw MLIB_EXCEPTION("unexpected end of file");
+			index.m_dataSizeBytes = index.m_IMUOffset + sizeof(UINT64) + numIMUFrames * IMUFrame::getRecordSizeBytes();
+			return index;
+		}
 
-			void close() {
-				if (m_backgroundThread.joinable()) {
-					m_bTerminateThread = true;
-					m_backgroundThread.join();
-					// Write number of IMU frames (0)
-					m_data->writeNumFramesToFile(0, m_out);
-					// Write number of RGB frames
-					m_out.seekp(m_numFramesPosRGB);
-					m_data->writeNumFramesToFile(m_frameCounterRGB, m_out);
-					m_out.close();
-				}
-			}
+		static std::string getFrameIndexSidecarFilename(const std::string& filename) {
+			return filename + ".idx";
+		}
 
-			//! appends the data to the cache for process AND frees the memory
-			void writeNextAndFree(vec3uc* color, unsigned short* depth, const mat4f& transform = mat4f::identity(), uint64_t timeStampColor = 0, uint64_t timeStampDepth = 0) {
-				TempFrame f;
-				f.colorFrame = color;
-				f.depthFrame = depth;
-				f.transform = transform;
-				f.timeStampColor = timeStampColor;
-				f.timeStampDepth = timeStampDepth;
-				while (m_frameCache.size() >= m_cacheSize) {
-#ifdef _WIN32
-					Sleep(0);
-#endif
-				}
-				m_mutexCache.lock();
-				m_frameCache.push_back(f);
-				m_mutexCache.unlock();
-			}
+		//! returns the frame index of a .sens file: read from its trailer or sidecar file if available, otherwise computed by walking the file
+		static FrameIndex loadFrameIndex(const std::string& filename) {
+			std::ifstream in(filename, std::ios::binary | std::ios::ate);
+			if (!in.is_open()) throw MLIB_EXCEPTION("could not open file " + filename);
+			const UINT64 fileSizeBytes = (UINT64)in.tellg();
 
-		private:
-			struct TempFrame {
-				vec3uc* colorFrame;
-				unsigned short* depthFrame;
-				mat4f transform;
-				uint64_t timeStampColor;
-				uint64_t timeStampDepth;
+			FrameIndex index;
+			if (index.loadFromFile(in, fileSizeBytes, true) && index.m_dataSizeBytes + 2 * sizeof(UINT64) < fileSizeBytes) return index;
 
-				void free() {
-					if (colorFrame) {
-						std::free(colorFrame);
-						colorFrame = nullptr;
-					}
-					if (depthFrame) {
-						std::free(depthFrame);
-						depthFrame = nullptr;
-					}
-					timeStampDepth = 0;
-					timeStampColor = 0;
-				}
-			};
+			std::ifstream inSidecar(getFrameIndexSidecarFilename(filename), std::ios::binary | std::ios::ate);
+			if (inSidecar.is_open() && index.loadFromFile(inSidecar, (UINT64)inSidecar.tellg(), false) && index.m_dataSizeBytes == fileSizeBytes) return index;
 
-			//! writes RGBFrame to .sens file
-			void writeFrameToFile(const RGBDFrame& frame)
+			in.clear();
+			in.seekg(0);
+			return computeFrameIndex(in);
+		}
+
+		//! adds a frame index to an existing .sens file: appended as a trailer, or written to a sidecar file (<filename>.idx)
+		static void writeFrameIndex(const std::string& filename, bool sidecar = false) {
+			FrameIndex index;
+			UINT64 fileSizeBytes = 0;
 			{
-				if (!m_out) {
-					throw std::runtime_error("Output file has been closed");
+				std::ifstream in(filename, std::ios::binary | std::ios::ate);
+				if (!in.is_open()) throw MLIB_EXCEPTION("could not open file " + filename);
+				fileSizeBytes = (UINT64)in.tellg();
+				if (index.loadFromFile(in, fileSizeBytes, true)) {
+					if (!sidecar) return;	//already indexed
 				}
-				if (!m_headerWritten) {
-					m_headerWritten = true;
-					m_data->writeHeaderToFile(m_out);
-					m_numFramesPosRGB = m_out.tellp();
-					m_data->writeNumFramesToFile(0, m_out);
+				else {
+					in.clear();
+					in.seekg(0);
+					index = computeFrameIndex(in);
+					if (index.m_dataSizeBytes != fileSizeBytes) throw MLIB_EXCEPTION("unexpected trailing data in " + filename);
 				}
-				frame.saveToFile(m_out);
-				++m_frameCounterRGB;
 			}
+			if (sidecar) {
+				if (index.m_dataSizeBytes != fileSizeBytes) throw MLIB_EXCEPTION("sidecar index requires a file without index trailer: " + filename);
+				std::ofstream out(getFrameIndexSidecarFilename(filename), std::ios::binary);
+				if (!out) throw MLIB_EXCEPTION("could not open file for writing: " + getFrameIndexSidecarFilename(filename));
+				index.saveToFile(out);
+			}
+			else {
+				std::ofstream out(filename, std::ios::binary | std::ios::app);
+				if (!out) throw MLIB_EXCEPTION("could not open file for writing: " + filename);
+				index.saveToFile(out);
+			}
+		}
 
-			void startBackgroundThread() {
-				const auto backgroundThreadFunc = [&]
-				{
-					while (!m_bTerminateThread || m_frameCache.size() > 0) {
-						if (m_frameCache.size() == 0) {
-							continue;
-						}
-						m_mutexCache.lock();
-						TempFrame frame = m_frameCache.front();
-						m_frameCache.pop_front();
-						m_mutexCache.unlock();
-						SensorData::RGBDFrame rgbFrame = m_data->createFrame(frame.colorFrame, frame.depthFrame, frame.transform, frame.timeStampColor, frame.timeStampDepth);
-						writeFrameToFile(rgbFrame);
-						rgbFrame.free();
-						frame.free();
-					}
-				};
-				m_backgroundThread = std::thread(backgroundThreadFunc);
+		//! pose and time stamps of a frame, i.e., the leading part of a frame record that can be patched in place (the payload sizes and payloads follow)
+		struct FramePose {
+			FramePose() {
+				m_cameraToWorld.setIdentity();
+				m_timeStampColor = 0;
+				m_timeStampDepth = 0;
+			}
+			FramePose(const RGBDFrame& f) {
+				m_cameraToWorld = f.getCameraToWorld();
+				m_timeStampColor = f.getTimeStampColor();
+				m_timeStampDepth = f.getTimeStampDepth();
 			}
 
-		private:
-			const SensorData* m_data;
-			unsigned int m_cacheSize;
-			std::ofstream m_out;
-			std::thread m_backgroundThread;
-			std::mutex m_mutexCache;
-			std::atomic<bool> m_bTerminateThread;
-			uint64_t m_frameCounterRGB;
-			bool m_headerWritten;
-			std::streampos m_numFramesPosRGB;
-			std::list<TempFrame> m_frameCache;
-		};
+			static UINT64 getRecordSizeBytes() {
+				return sizeof(mat4f) + 2 * sizeof(UINT64);
+			}
+
+			void saveToFile(std::ostream& out) const {
+				out.write((const char*)&m_cameraToWorld, sizeof(mat4f));
+				out.write((const char*)&m_timeStampColor, sizeof(UINT64));
+				out.write((const char*)&m_timeStampDepth, sizeof(UINT64));
+			}
+
+			void loadFromFile(std::istream& in) {
+				in.read((char*)&m_cameraToWorld, sizeof(mat4f));
+				in.read((char*)&m_timeStampColor, sizeof(UINT64));
+				in.read((char*)&m_timeStampDepth, sizeof(UINT64));
+			}
+
+			bool operator==(const FramePose& other) const {
+				return std::memcmp(&m_cameraToWorld, &other.m_cameraToWorld, sizeof(mat4f)) == 0 && m_timeStampColor == other.m_timeStampColor && m_timeStampDepth == other.m_timeStampDepth;
+			}
+
+			bool operator!=(const FramePose& other) const {
+				return !((*this) == other);
+			}
+
+			mat4f m_cameraToWorld;
+			UINT64 m_timeStampColor;
+			UINT64 m_timeStampDepth;
+		};
+
+#define M_SENSOR_DATA_JOURNAL_MAGIC 0x4c4e524a534e4553ull	//"SENSJRNL"
+
+		//! FNV-1a hash (detects incomplete journals)
+		static UINT64 computeChecksum(const char* data, size_t sizeBytes) {
+			UINT64 hash = 0xcbf29ce484222325ull;
+			for (size_t i = 0; i < sizeBytes; i++) {
+				hash ^= (unsigned char)data[i];
+				hash *= 0x100000001b3ull;
+			}
+			return hash;
+		}
+
+		//! true if both paths refer to the same existing file, also under different spellings of the path or through links
+		static bool isSameFile(const std::string& filename0, const std::string& filename1) {
+#ifdef WIN32
+			BY_HANDLE_FILE_INFORMATION info[2];
+			const std::string filenames[2] = { filename0, filename1 };
+			for (unsigned int i = 0; i < 2; i++) {
+				HANDLE file = CreateFileA(filenames[i].c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+				if (file == INVALID_HANDLE_VALUE) return false;
+				const bool success = GetFileInformationByHandle(file, &info[i]) != 0;
+				CloseHandle(file);
+				if (!success) return false;
+			}
+			return info[0].dwVolumeSerialNumber == info[1].dwVolumeSerialNumber && info[0].nFileIndexHigh == info[1].nFileIndexHigh && info[0].nFileIndexLow == info[1].nFileIndexLow;
+#else
+			struct stat st0, st1;
+			if (stat(filename0.c_str(), &st0) != 0 || stat(filename1.c_str(), &st1) != 0) return false;
+			return st0.st_dev == st1.st_dev && st0.st_ino == st1.st_ino;
 #endif
+		}
 
-		//! loads a .sens file
-		void loadFromFile(const std::string& filename) {
+		//! flushes the contents of a file to disk
+		static void syncFile(const std::string& filename) {
+#ifdef WIN32
+			HANDLE file = CreateFileA(filename.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+			if (file == INVALID_HANDLE_VALUE) throw MLIB_EXCEPTION("could not open file " + filename);
+			const bool success = FlushFileBuffers(file) != 0;
+			CloseHandle(file);
+#else
+			const int fd = ::open(filename.c_str(), O_RDONLY);
+			if (fd < 0) throw MLIB_EXCEPTION("could not open file " + filename);
+			const bool success = fsync(fd) == 0;
+			::close(fd);
+#endif
+			if (!success) throw MLIB_EXCEPTION("could not sync " + filename);
+		}
+
+		//! poses and time stamps of all frames (e.g., to be written with writeFramePoses)
+		std::vector<FramePose> getFramePoses() const {
+			std::vector<FramePose> poses;
+			poses.reserve(m_frames.size());
+			for (const RGBDFrame& f : m_frames) poses.push_back(FramePose(f));
+			return poses;
+		}
+
+		//! reads the poses and time stamps of all frames of a .sens file without reading any payloads; the file is not modified.
+		//! throws if there is a journal of an interrupted writeFramePoses (the poses could be a mix of old and new values; roll back with recoverFramePoses first)
+		static std::vector<FramePose> readFramePoses(const std::string& filename) {
+			if (std::ifstream(getFramePoseJournalFilename(filename)).is_open()) {
+				throw MLIB_EXCEPTION("interrupted pose update of " + filename + ": roll it back with recoverFramePoses first");
+			}
+			const FrameIndex index = loadFrameIndex(filename);
 			std::ifstream in(filename, std::ios::binary);
+			if (!in.is_open()) throw MLIB_EXCEPTION("could not open file " + filename);
+			std::vector<FramePose> poses(index.m_frameOffsets.size());
+			for (size_t i = 0; i < poses.size(); i++) {
+				in.seekg(index.m_frameOffsets[i]);
+				poses[i].loadFromFile(in);
+			}
+			if (!in) throw MLIB_EXCEPTION("unexpected end of file " + filename);
+			return poses;
+		}
 
-			if (!in.is_open()) {
-				throw MLIB_EXCEPTION("could not open file " + filename);
+		static std::string getFramePoseJournalFilename(const std::string& filename) {
+			return filename + ".journal";
+		}
+
+		//! overwrites the poses and time stamps of all frames of a .sens file in place; only the changed frame records are touched (80 bytes each).
+		//! the preview frames (see writePreviews) carry a copy of the poses and are patched in the same pass.
+		//! crash-safe: the old values are written to an undo journal (<filename>.journal) and synced before the file is patched; an interrupted patch is rolled back by recoverFramePoses.
+		//! throws if there is a journal: the poses were then probably derived from a half-patched file (call recoverFramePoses and read them again)
+		static void writeFramePoses(const std::string& filename, const std::vector<FramePose>& poses) {
+			if (std::ifstream(getFramePoseJournalFilename(filename)).is_open()) {
+				throw MLIB_EXCEPTION("interrupted pose update of " + filename + ": roll it back with recoverFramePoses and recompute the poses");
+			}
+
+			const FrameIndex index = loadFrameIndex(filename);
+			if (index.m_frameOffsets.size() != poses.size()) throw MLIB_EXCEPTION("number of poses (" + std::to_string(poses.size()) + ") does not match the number of frames (" + std::to_string(index.m_frameOffsets.size()) + ") of " + filename);
+
+			//record offsets of the full frames followed by those of the preview frames (record i gets poses[i % poses.size()])
+			std::vector<UINT64> offsets = index.m_frameOffsets;
+			std::vector<size_t> changed;
+			std::vector<FramePose> oldPoses;
+			{
+				std::ifstream in(filename, std::ios::binary);
+				if (!in.is_open()) throw MLIB_EXCEPTION("could not open file " + filename);
+				if (index.m_previewOffset != 0) {
+					in.seekg(index.m_previewOffset);
+					const FrameIndex previewIndex = computeFrameIndex(in);
+					if (previewIndex.m_frameOffsets.size() != poses.size()) throw MLIB_EXCEPTION("invalid preview in " + filename);
+					offsets.insert(offsets.end(), previewIndex.m_frameOffsets.begin(), previewIndex.m_frameOffsets.end());
+				}
+				for (size_t i = 0; i < offsets.size(); i++) {
+					FramePose old;
+					in.seekg(offsets[i]);
+					old.loadFromFile(in);
+					if (!in) throw MLIB_EXCEPTION("unexpected end of file " + filename);
+					if (old != poses[i % poses.size()]) {
+						changed.push_back(i);
+						oldPoses.push_back(old);
+					}
+				}
+			}
+			if (changed.empty()) return;
+
+			//undo journal: [magic][numEntries] {[offset][old pose]} [checksum]
+			const std::string journalFilename = getFramePoseJournalFilename(filename);
+			{
+				std::stringstream journal;
+				const UINT64 magic = M_SENSOR_DATA_JOURNAL_MAGIC;
+				const UINT64 numEntries = changed.size();
+				journal.write((const char*)&magic, sizeof(UINT64));
+				journal.write((const char*)&numEntries, sizeof(UINT64));
+				for (size_t i = 0; i < changed.size(); i++) {
+					journal.write((const char*)&offsets[changed[i]], sizeof(UINT64));
+					oldPoses[i].saveToFile(journal);
+				}
+				const std::string data = journal.str();
+				const UINT64 checksum = computeChecksum(data.data(), data.size());
+				std::ofstream out(journalFilename, std::ios::binary);
+				if (!out) throw MLIB_EXCEPTION("could not open file for writing: " + journalFilename);
+				out.write(data.data(), data.size());
+				out.write((const char*)&checksum, sizeof(UINT64));
+				out.close();
+				if (!out) throw MLIB_EXCEPTION("could not write " + journalFilename);
+				syncFile(journalFilename);
+			}
+
+			{
+				std::fstream out(filename, std::ios::binary | std::ios::in | std::ios::out);
+				if (!out.is_open()) throw MLIB_EXCEPTION("could not open file for writing: " + filename);
+				for (size_t i : changed) {
+					out.seekp(offsets[i]);
+					poses[i % poses.size()].saveToFile(out);
+				}
+				out.close();
+				if (!out) throw MLIB_EXCEPTION("could not write " + filename + " (run recoverFramePoses to roll back)");
+				syncFile(filename);
+			}
+			std::remove(journalFilename.c_str());
+		}
+
+		//! rolls back an interrupted writeFramePoses if there is a complete undo journal; returns true if the file was rolled back
+		static bool recoverFramePoses(const std::string& filename) {
+			const std::string journalFilename = getFramePoseJournalFilename(filename);
+			std::vector<UINT64> offsets;
+			std::vector<FramePose> oldPoses;
+			{
+				std::ifstream in(journalFilename, std::ios::binary | std::ios::ate);
+				if (!in.is_open()) return false;
+				const UINT64 sizeBytes = (UINT64)in.tellg();
+				in.seekg(0);
+				std::string data((size_t)sizeBytes, '\0');
+				in.read(&data[0], sizeBytes);
+
+				//an incomplete journal means the file was not touched yet
+				UINT64 magic = 0, numEntries = 0, checksum = 0;
+				const UINT64 entrySizeBytes = sizeof(UINT64) + FramePose::getRecordSizeBytes();
+				bool valid = in && sizeBytes >= 3 * sizeof(UINT64);
+				if (valid) {
+					std::memcpy(&magic, &data[0], sizeof(UINT64));
+					std::memcpy(&numEntries, &data[sizeof(UINT64)], sizeof(UINT64));
+					std::memcpy(&checksum, &data[sizeBytes - sizeof(UINT64)], sizeof(UINT64));
+					const UINT64 entriesSizeBytes = sizeBytes - 3 * sizeof(UINT64);
+					valid = magic == M_SENSOR_DATA_JOURNAL_MAGIC && entriesSizeBytes % entrySizeBytes == 0 && numEntries == entriesSizeBytes / entrySizeBytes;
+					valid = valid && checksum == computeChecksum(data.data(), sizeBytes - sizeof(UINT64));
+				}
+				if (valid) {
+					std::stringstream entries(data.substr(2 * sizeof(UINT64), numEntries * entrySizeBytes));
+					offsets.resize(numEntries);
+					oldPoses.resize(numEntries);
+					for (size_t i = 0; i < numEntries; i++) {
+						entries.read((char*)&offsets[i], sizeof(UINT64));
+						oldPoses[i].loadFromFile(entries);
+					}
+				}
+			}
+			if (!offsets.empty()) {
+				std::fstream out(filename, std::ios::binary | std::ios::in | std::ios::out);
+				if (!out.is_open()) throw MLIB_EXCEPTION("could not open file for writing: " + filename);
+				for (size_t i = 0; i < offsets.size(); i++) {
+					out.seekp(offsets[i]);
+					oldPoses[i].saveToFile(out);
+				}
+				out.close();
+				if (!out) throw MLIB_EXCEPTION("could not roll back " + filename);
+				syncFile(filename);
+			}
+			std::remove(journalFilename.c_str());
+			return !offsets.empty();
+		}
+
+		//! true if the frames of other can be stored in this file (same image sizes, compression types, depth shift and calibration;
+		//! a file has a single calibration, so frames of a differently calibrated scan would be back-projected with the wrong intrinsics)
+		bool isCompatible(const SensorData& other) const {
+			return m_colorWidth == other.m_colorWidth && m_colorHeight == other.m_colorHeight &&
+				m_depthWidth == other.m_depthWidth && m_depthHeight == other.m_depthHeight &&
+				m_colorCompressionType == other.m_colorCompressionType && m_depthCompressionType == other.m_depthCompressionType &&
+				m_depthShift == other.m_depthShift &&
+				m_calibrationColor == other.m_calibrationColor && m_calibrationDepth == other.m_calibrationDepth;
+		}
+
+		//! copies sizeBytes from inFile (at inOffset) into the existing outFile (at outOffset) with large sequential copies; on linux the kernel copies the data (copy_file_range or sendfile)
+		static void copyFileBytes(const std::string& inFile, UINT64 inOffset, const std::string& outFile, UINT64 outOffset, UINT64 sizeBytes) {
+			if (sizeBytes == 0) return;
+#ifdef WIN32
+			std::ifstream in(inFile, std::ios::binary);
+			std::fstream out(outFile, std::ios::binary | std::ios::in | std::ios::out);
+			if (!in.is_open()) throw MLIB_EXCEPTION("could not open file " + inFile);
+			if (!out.is_open()) throw MLIB_EXCEPTION("could not open file for writing: " + outFile);
+			in.seekg(inOffset);
+			out.seekp(outOffset);
+			std::vector<char> buffer((size_t)std::min(sizeBytes, (UINT64)(16 * 1024 * 1024)));
+			while (sizeBytes > 0 && in && out) {
+				const size_t n = (size_t)std::min(sizeBytes, (UINT64)buffer.size());
+				in.read(buffer.data(), n);
+				out.write(buffer.data(), (std::streamsize)in.gcount());
+				sizeBytes -= (UINT64)in.gcount();
+			}
+			out.close();
+			if (sizeBytes > 0 || !out) throw MLIB_EXCEPTION("could not copy " + inFile + " to " + outFile);
+#else
+			const int in = ::open(inFile.c_str(), O_RDONLY);
+			if (in < 0) throw MLIB_EXCEPTION("could not open file " + inFile);
+			const int out = ::open(outFile.c_str(), O_WRONLY);
+			if (out < 0) {
+				::close(in);
+				throw MLIB_EXCEPTION("could not open file for writing: " + outFile);
+			}
+			loff_t offIn = (loff_t)inOffset, offOut = (loff_t)outOffset;
+			bool kernelCopy = true;
+			while (sizeBytes > 0) {
+				const size_t n = (size_t)std::min(sizeBytes, (UINT64)(1 << 30));
+				ssize_t copied = -1;
+#ifdef SYS_copy_file_range
+				if (kernelCopy) copied = syscall(SYS_copy_file_range, in, &offIn, out, &offOut, n, 0);
+#endif
+				if (copied < 0 && kernelCopy && lseek(out, offOut, SEEK_SET) == offOut) {
+					//no copy_file_range (old kernel, across file systems): sendfile still copies in the kernel
+					copied = sendfile(out, in, &offIn, n);
+					if (copied > 0) offOut += copied;
+				}
+				if (copied < 0) {
+					kernelCopy = false;
+					std::vector<char> buffer(std::min(n, (size_t)(16 * 1024 * 1024)));
+					copied = pread(in, buffer.data(), buffer.size(), offIn);
+					if (copied > 0 && pwrite(out, buffer.data(), (size_t)copied, offOut) != copied) copied = -1;
+					if (copied > 0) {
+						offIn += copied;
+						offOut += copied;
+					}
+				}
+				if (copied <= 0) break;	//error or unexpected end of file
+				sizeBytes -= (UINT64)copied;
 			}
+			::close(in);
+			const bool success = ::close(out) == 0 && sizeBytes == 0;
+			if (!success) throw MLIB_EXCEPTION("could not copy " + inFile + " to " + outFile);
+#endif
+		}
+
+		//! shrinks (or extends) a file to sizeBytes
+		static void resizeFile(const std::string& filename, UINT64 sizeBytes) {
+#ifdef WIN32
+			HANDLE file = CreateFileA(filename.c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+			if (file == INVALID_HANDLE_VALUE) throw MLIB_EXCEPTION("could not open file " + filename);
+			LARGE_INTEGER size;
+			size.QuadPart = (LONGLONG)sizeBytes;
+			const bool success = SetFilePointerEx(file, size, NULL, FILE_BEGIN) && SetEndOfFile(file);
+			CloseHandle(file);
+#else
+			const bool success = truncate(filename.c_str(), (off_t)sizeBytes) == 0;
+#endif
+			if (!success) throw MLIB_EXCEPTION("could not resize " + filename);
+		}
+
+		//! frame records and IMU block of a .sens file, as byte ranges (used to splice files without decoding them)
+		struct FileLayout {
+			UINT64 m_numFramesOffset;	//offset of the frame count (i.e., the size of the header)
+			UINT64 m_numFrames;
+			UINT64 m_numIMUFrames;
+			FrameIndex m_index;
+			UINT64 m_fileSizeBytes;		//larger than m_index.m_dataSizeBytes if there is an index trailer
+
+			//! first byte of the frame records
+			UINT64 getFramesBegin() const { return m_numFramesOffset + sizeof(UINT64); }
+			//! first byte of the IMU records
+			UINT64 getIMUFramesBegin() const { return m_index.m_IMUOffset + sizeof(UINT64); }
+		};
+
+		//! reads the header of a .sens file and locates its records (through the frame index, see loadFrameIndex)
+		static FileLayout loadFileLayout(const std::string& filename, SensorData& header) {
+			FileLayout layout;
+			std::ifstream in(filename, std::ios::binary | std::ios::ate);
+			if (!in.is_open()) throw MLIB_EXCEPTION("could not open file " + filename);
+			layout.m_fileSizeBytes = (UINT64)in.tellg();
+			in.seekg(0);
+			header.readHeaderFromFile(in);
+			layout.m_numFramesOffset = (UINT64)in.tellg();
+			in.close();
+			layout.m_index = loadFrameIndex(filename);
+			layout.m_numFrames = layout.m_index.m_frameOffsets.size();
+			layout.m_numIMUFrames = (layout.m_index.m_dataSizeBytes - layout.getIMUFramesBegin()) / IMUFrame::getRecordSizeBytes();
+			return layout;
+		}
+
+		//! writes the concatenation of .sens files (frames and IMU frames in the order of the files) to outFile; the records are copied as they are, without loading the files
+		static void concatFiles(const std::vector<std::string>& inFiles, const std::string& outFile, bool withFrameIndex = false) {
+			if (inFiles.empty()) throw MLIB_EXCEPTION("no input files");
+			SensorData header;
+			std::vector<FileLayout> layouts;
+			UINT64 numFrames = 0, numIMUFrames = 0;
+			for (const std::string& f : inFiles) {
+				if (isSameFile(f, outFile)) throw MLIB_EXCEPTION("output file must not be an input file: " + f);
+				SensorData h;
+				layouts.push_back(loadFileLayout(f, layouts.empty() ? header : h));
+				if (layouts.size() > 1 && !header.isCompatible(h)) throw MLIB_EXCEPTION("sensor data incompatible: " + f);
+				numFrames += layouts.back().m_numFrames;
+				numIMUFrames += layouts.back().m_numIMUFrames;
+			}
+
+			//header, frame and IMU counts are written here; the records are copied into the gaps
+			UINT64 framesOffset = 0, IMUOffset = 0;
+			{
+				std::ofstream out(outFile, std::ios::binary);
+				if (!out) throw MLIB_EXCEPTION("could not open file for writing: " + outFile);
+				header.writeHeaderToFile(out);
+				out.write((const char*)&numFrames, sizeof(UINT64));
+				framesOffset = (UINT64)out.tellp();
+				IMUOffset = framesOffset;
+				for (const FileLayout& l : layouts) IMUOffset += l.m_index.m_IMUOffset - l.getFramesBegin();
+				out.seekp(IMUOffset);
+				out.write((const char*)&numIMUFrames, sizeof(UINT64));
+				if (!out) throw MLIB_EXCEPTION("could not write " + outFile);
+			}
+
+			UINT64 offset = framesOffset;
+			for (size_t i = 0; i < layouts.size(); i++) {
+				const UINT64 sizeBytes = layouts[i].m_index.m_IMUOffset - layouts[i].getFramesBegin();
+				copyFileBytes(inFiles[i], layouts[i].getFramesBegin(), outFile, offset, sizeBytes);
+				offset += sizeBytes;
+			}
+			offset += sizeof(UINT64);
+			for (size_t i = 0; i < layouts.size(); i++) {
+				const UINT64 sizeBytes = layouts[i].m_numIMUFrames * IMUFrame::getRecordSizeBytes();
+				copyFileBytes(inFiles[i], layouts[i].getIMUFramesBegin(), outFile, offset, sizeBytes);
+				offset += sizeBytes;
+			}
+			if (withFrameIndex) writeFrameIndex(outFile);
+		}
+
+		//! appends the frames and IMU frames of secondFile to filename in place: the records of secondFile are copied behind the frames of filename,
+		//! followed by the merged IMU block; only the IMU block of filename is held in memory (not crash-safe; write a new file with concatFiles to keep the original)
+		static void appendFile(const std::string& filename, const std::string& secondFile) {
+			if (isSameFile(filename, secondFile)) throw MLIB_EXCEPTION("cannot append a file to itself: " + filename);
+			SensorData firstHeader, secondHeader;
+			const FileLayout first = loadFileLayout(filename, firstHeader);
+			const FileLayout second = loadFileLayout(secondFile, secondHeader);
+			if (!firstHeader.isCompatible(secondHeader)) throw MLIB_EXCEPTION("sensor data incompatible: " + secondFile);
+			const bool hadIndexTrailer = first.m_fileSizeBytes > first.m_index.m_dataSizeBytes;
+			const bool hadSidecarIndex = std::ifstream(getFrameIndexSidecarFilename(filename)).is_open();
+
+			std::vector<char> IMUFrames((size_t)(first.m_numIMUFrames * IMUFrame::getRecordSizeBytes()));
+			{
+				std::ifstream in(filename, std::ios::binary);
+				in.seekg(first.getIMUFramesBegin());
+				if (!IMUFrames.empty()) in.read(IMUFrames.data(), IMUFrames.size());
+				if (!in) throw MLIB_EXCEPTION("unexpected end of file " + filename);
+			}
+			std::remove(getFrameIndexSidecarFilename(filename).c_str());	//stale after the append
+
+			const UINT64 framesSizeBytes = second.m_index.m_IMUOffset - second.getFramesBegin();
+			UINT64 offset = first.m_index.m_IMUOffset;
+			copyFileBytes(secondFile, second.getFramesBegin(), filename, offset, framesSizeBytes);
+			offset += framesSizeBytes;
+			{
+				std::fstream out(filename, std::ios::binary | std::ios::in | std::ios::out);
+				if (!out.is_open()) throw MLIB_EXCEPTION("could not open file for writing: " + filename);
+				const UINT64 numIMUFrames = first.m_numIMUFrames + second.m_numIMUFrames;
+				out.seekp(offset);
+				out.write((const char*)&numIMUFrames, sizeof(UINT64));
+				if (!IMUFrames.empty()) out.write(IMUFrames.data(), IMUFrames.size());
+				out.close();
+				if (!out) throw MLIB_EXCEPTION("could not write " + filename);
+			}
+			offset += sizeof(UINT64) + IMUFrames.size();
+			const UINT64 IMUSizeBytes = second.m_numIMUFrames * IMUFrame::getRecordSizeBytes();
+			copyFileBytes(secondFile, second.getIMUFramesBegin(), filename, offset, IMUSizeBytes);
+			resizeFile(filename, offset + IMUSizeBytes);	//drops the rest of an old index trailer
+			{
+				std::fstream out(filename, std::ios::binary | std::ios::in | std::ios::out);
+				const UINT64 numFrames = first.m_numFrames + second.m_numFrames;
+				out.seekp(first.m_numFramesOffset);
+				out.write((const char*)&numFrames, sizeof(UINT64));
+				out.close();
+				if (!out) throw MLIB_EXCEPTION("could not write " + filename);
+			}
+			if (hadIndexTrailer) writeFrameIndex(filename);
+			if (hadSidecarIndex) writeFrameIndex(filename, true);
+		}
+
+		//! parameters of the low-resolution preview stream (see writePreviews)
+		struct PreviewOptions {
+			PreviewOptions() {
+				colorDownsampleFactor = 8;
+				depthDownsampleFactor = 4;
+				colorQuality = 75;
+				numThreads = 0;
+			}
+			unsigned int colorDownsampleFactor;	//e.g., 1296x968 -> 162x121 (box filter)
+			unsigned int depthDownsampleFactor;	//e.g., 640x480 -> 160x120 (nearest sample, no mixing across depth edges)
+			unsigned int colorQuality;			//jpeg quality of the preview color frames
+			unsigned int numThreads;			//0: all cores
+		};
+
+		//! adds (or replaces) a low-resolution preview of all frames to a .sens file: stored behind the IMU block (ignored by older readers) and located through the frame index trailer;
+		//! the preview is a .sens stream itself (jpeg color, depth compressed like the full frames, scaled intrinsics) and is read with loadPreview
+		static void writePreviews(const std::string& filename, const PreviewOptions& options = PreviewOptions()) {
+			if (options.colorDownsampleFactor == 0 || options.depthDownsampleFactor == 0) throw MLIB_EXCEPTION("downsample factor must be > 0");
+			SensorData preview;
+			FrameIndex index = loadFrameIndex(filename);
+			{
+				SensorData sd;
+				sd.loadFromFileMapped(filename);
+
+				const unsigned int cf = options.colorDownsampleFactor, df = options.depthDownsampleFactor;
+				const unsigned int colorWidth = std::max(sd.m_colorWidth / cf, 1u), colorHeight = std::max(sd.m_colorHeight / cf, 1u);
+				const unsigned int depthWidth = std::max(sd.m_depthWidth / df, 1u), depthHeight = std::max(sd.m_depthHeight / df, 1u);
+				const auto scaleIntrinsics = [](const CalibrationData& c, float sx, float sy) {
+					mat4f intrinsic = c.m_intrinsic;
+					intrinsic._m00 *= sx;	intrinsic._m02 = (intrinsic._m02 + 0.5f) * sx - 0.5f;
+					intrinsic._m11 *= sy;	intrinsic._m12 = (intrinsic._m12 + 0.5f) * sy - 0.5f;
+					return CalibrationData(intrinsic, c.m_extrinsic);
+				};
+				preview.initDefault(colorWidth, colorHeight, depthWidth, depthHeight,
+					scaleIntrinsics(sd.m_calibrationColor, (float)colorWidth / sd.m_colorWidth, (float)colorHeight / sd.m_colorHeight),
+					scaleIntrinsics(sd.m_calibrationDepth, (float)depthWidth / sd.m_depthWidth, (float)depthHeight / sd.m_depthHeight),
+					TYPE_JPEG, sd.m_depthCompressionType, sd.m_depthShift, sd.m_sensorName);
+				preview.setColorCompressionQuality(options.colorQuality);
+				preview.m_frames.resize(sd.m_frames.size());
+
+				const unsigned int numThreads = (unsigned int)std::min((size_t)(options.numThreads > 0 ? options.numThreads : std::max(1u, std::thread::hardware_concurrency())), std::max(sd.m_frames.size(), (size_t)1));
+				std::atomic<size_t> next(0);
+				std::mutex mutex;
+				std::exception_ptr exception;
+				const auto worker = [&]() {
+					FrameBufferPool buffers(sd);
+					std::vector<unsigned char> color((size_t)colorWidth*colorHeight * 3);
+					std::vector<unsigned short> depth((size_t)depthWidth*depthHeight);
+					try {
+						for (size_t i = next++; i < sd.m_frames.size(); i = next++) {
+							const RGBDFrame& f = sd.m_frames[i];
+							buffers.decompress(sd, f);
+							const unsigned char* fullColor = (const unsigned char*)buffers.getColor();
+							for (unsigned int y = 0; y < colorHeight; y++) {
+								for (unsigned int x = 0; x < colorWidth; x++) {
+									unsigned int sum[3] = { 0, 0, 0 };
+									for (unsigned int v = 0; v < cf; v++) {
+										const unsigned char* row = fullColor + (size_t)std::min(y * cf + v, sd.m_colorHeight - 1) * sd.m_colorWidth * 3;
+										for (unsigned int u = 0; u < cf; u++) {
+											const unsigned char* c = row + std::min(x * cf + u, sd.m_colorWidth - 1) * 3;
+											sum[0] += c[0];	sum[1] += c[1];	sum[2] += c[2];
+										}
+									}
+									const unsigned int n = cf * cf;
+									for (unsigned int k = 0; k < 3; k++) color[((size_t)y * colorWidth + x) * 3 + k] = (unsigned char)((sum[k] + n / 2) / n);
+								}
+							}
+							const unsigned short* fullDepth = buffers.getDepth();
+							for (unsigned int y = 0; y < depthHeight; y++) {
+								for (unsigned int x = 0; x < depthWidth; x++) {
+									depth[y * depthWidth + x] = fullDepth[(size_t)std::min(y * df + df / 2, sd.m_depthHeight - 1) * sd.m_depthWidth + std::min(x * df + df / 2, sd.m_depthWidth - 1)];
+								}
+							}
+
+							RGBDFrame& p = preview.m_frames[i];
+							preview.replaceColor(p, (const vec3uc*)color.data());
+							preview.replaceDepth(p, depth.data());
+							p.setCameraToWorld(f.getCameraToWorld());
+							p.setTimeStampColor(f.getTimeStampColor());
+							p.setTimeStampDepth(f.getTimeStampDepth());
+						}
+					}
+					catch (...) {
+						std::lock_guard<std::mutex> lock(mutex);
+						exception = std::current_exception();
+						next = sd.m_frames.size();
+					}
+				};
+				std::vector<std::thread> threads;
+				for (unsigned int t = 1; t < numThreads; t++) threads.push_back(std::thread(worker));
+				worker();
+				for (auto& t : threads) t.join();
+				if (exception) std::rethrow_exception(exception);
+			}	//unmaps the file
+
+			//drop an old index trailer (and preview), then append the preview and the new index
+			resizeFile(filename, index.m_dataSizeBytes);
+			std::remove(getFrameIndexSidecarFilename(filename).c_str());
+			std::ofstream out(filename, std::ios::binary | std::ios::app);
+			if (!out) throw MLIB_EXCEPTION("could not open file for writing: " + filename);
+			index.m_previewOffset = index.m_dataSizeBytes;
+			preview.writeHeaderToFile(out);
+			preview.writeRGBFramesToFile(out);
+			preview.writeIMUFramesToFile(out);
+			index.saveToFile(out);
+			out.close();
+			if (!out) throw MLIB_EXCEPTION("could not write " + filename);
+		}
+
+		//! loads the low-resolution preview of a .sens file (see writePreviews) without reading the full frames; returns false if the file has no preview
+		static bool loadPreview(const std::string& filename, SensorData& preview) {
+			const FrameIndex index = loadFrameIndex(filename);
+			if (index.m_previewOffset == 0) return false;
 
+			std::ifstream in(filename, std::ios::binary);
+			if (!in.is_open()) throw MLIB_EXCEPTION("could not open file " + filename);
+			in.seekg(index.m_previewOffset);
+			preview.free();
+			preview.readHeaderFromFile(in);
+
+			UINT64 numFrames = 0;
+			in.read((char*)&numFrames, sizeof(UINT64));
+			if (!in || numFrames != index.m_frameOffsets.size()) throw MLIB_EXCEPTION("invalid preview in " + filename);
+			preview.m_frames.resize(numFrames);
+			for (size_t i = 0; i < preview.m_frames.size(); i++) {
+				preview.m_frames[i].loadFromFile(in);
+			}
+			if (!in) throw MLIB_EXCEPTION("unexpected end of file " + filename);
+			return true;
+		}
+
+#ifdef _HAS_MLIB
+		//! Enables writing out RGB frames directly to a file. Has to be closed after writing finished; the IMU frames of data are written on close.
+		//! Frames are compressed by a pool of worker threads and written in order by a dedicated writer thread; producers block while cacheSize frames are in flight.
+		class LiveSensorDataWriter
+		{
+		public:
+			LiveSensorDataWriter(const SensorData* data, const std::string& filename, bool overwriteExistingFile = false, unsigned int cacheSize = 500, unsigned int numThreads = 0)
+				: m_data(data), m_cacheSize(std::max(cacheSize, 1u)), m_headerWritten(false), m_frameCounterRGB(0), m_queue(m_cacheSize)
+			{
+				std::string actualFilename = filename;
+				if (!overwriteExistingFile) {
+					while (util::fileExists(actualFilename)) {
+						std::string path = util::directoryFromPath(actualFilename);
+						std::string curr = util::fileNameFromPath(actualFilename);
+						std::string ext = util::getFileExtension(curr);
+						curr = util::removeExtensions(curr);
+						std::string base = util::getBaseBeforeNumericSuffix(curr);
+						unsigned int num = util::getNumericSuffix(curr);
+						if (num == (unsigned int)-1) {
+							num = 0;
+						}
+						actualFilename = path + base + std::to_string(num + 1) + "." + ext;
+					}
+				}
+				m_out.open(actualFilename, std::ios::binary);
+				if (!m_out) {
+					throw std::runtime_error("Unable to open file for writing: " + filename);
+				}
+				if (numThreads == 0) numThreads = std::max(1u, std::thread::hardware_concurrency());
+				startBackgroundThreads(numThreads);
+			}
+
+			~LiveSensorDataWriter()
+			{
+				try {
+					close();
+				}
+				catch (...) {}
+			}
+
+			//! waits for all frames to be written and finalizes the file; rethrows the first compression or write error
+			void close() {
+				if (m_writeThread.joinable()) {
+					{
+						std::lock_guard<std::mutex> lock(m_mutex);
+						m_bTerminateThread = true;
+					}
+					m_numQueued.close();
+					m_condCompressed.notify_all();
+					for (auto& t : m_compressThreads) {
+						t.join();
+					}
+					m_compressThreads.clear();
+					m_writeThread.join();
+					for (auto& f : m_compressed) {
+						f.free();	//only left over if a thread failed
+					}
+					if (m_exception) {
+						m_out.close();
+						std::rethrow_exception(m_exception);
+					}
+					if (!m_headerWritten) {
+						writeHeaderToFile();
+					}
+					m_data->writeIMUFramesToFile(m_out);
+					// Write number of RGB frames
+					m_out.seekp(m_numFramesPosRGB);
+					m_data->writeNumFramesToFile(m_frameCounterRGB, m_out);
+					m_out.close();
+					if (!m_out) throw MLIB_EXCEPTION("error while writing the .sens file");
+				}
+			}
+
+			//! appends the data to the cache for process AND frees the memory
+			void writeNextAndFree(vec3uc* color, unsigned short* depth, const mat4f& transform = mat4f::identity(), uint64_t timeStampColor = 0, uint64_t timeStampDepth = 0) {
+				writeFrameAndFree(m_nextFrameIdx++, color, depth, transform, timeStampColor, timeStampDepth);
+			}
+
+			//! same as writeNextAndFree, but with an explicit frame index for multiple producer threads; frames are written in index order, so the indices must be 0, 1, 2, ... without gaps (don't mix with writeNextAndFree)
+			void writeFrameAndFree(UINT64 frameIdx, vec3uc* color, unsigned short* depth, const mat4f& transform = mat4f::identity(), uint64_t timeStampColor = 0, uint64_t timeStampDepth = 0) {
+				TempFrame f;
+				f.frameIdx = frameIdx;
+				f.colorFrame = color;
+				f.depthFrame = depth;
+				f.transform = transform;
+				f.timeStampColor = timeStampColor;
+				f.timeStampDepth = timeStampDepth;
+				{
+					//wait until the frame fits into the reorder window (no more than cacheSize frames in flight)
+					std::unique_lock<std::mutex> lock(m_mutex);
+					m_condWritten.wait(lock, [&] { return frameIdx < m_nextWrite + m_cacheSize || m_exception; });
+					if (m_exception) {
+						f.free();
+						std::rethrow_exception(m_exception);
+					}
+					m_numInFlight++;
+				}
+				if (!m_queue.push(f)) throw MLIB_EXCEPTION("frame queue overflow");
+				m_numQueued.notify();
+			}
+
+			//! stops writing after a producer failed: blocked and subsequent writeFrameAndFree calls as well as close rethrow e
+			void abort(std::exception_ptr e) {
+				setException(e);
+			}
+
+		private:
+			struct TempFrame {
+				UINT64 frameIdx;
+				vec3uc* colorFrame;
+				unsigned short* depthFrame;
+				mat4f transform;
+				uint64_t timeStampColor;
+				uint64_t timeStampDepth;
+
+				void free() {
+					if (colorFrame) {
+						std::free(colorFrame);
+						colorFrame = nullptr;
+					}
+					if (depthFrame) {
+						std::free(depthFrame);
+						depthFrame = nullptr;
+					}
+					timeStampDepth = 0;
+					timeStampColor = 0;
+				}
+			};
+
+			//! bounded lock-free multi-producer/multi-consumer ring buffer (each cell carries a sequence number, cf. D. Vyukov)
+			class FrameQueue {
+			public:
+				FrameQueue(size_t capacity) {
+					size_t size = 1;
+					while (size < capacity) size *= 2;
+					m_cells = std::vector<Cell>(size);
+					for (size_t i = 0; i < size; i++) m_cells[i].seq.store(i, std::memory_order_relaxed);
+					m_mask = size - 1;
+					m_pushPos.store(0, std::memory_order_relaxed);
+					m_popPos.store(0, std::memory_order_relaxed);
+				}
+				bool push(const TempFrame& f) {
+					size_t pos = m_pushPos.load(std::memory_order_relaxed);
+					Cell* cell;
+					while (1) {
+						cell = &m_cells[pos & m_mask];
+						const size_t seq = cell->seq.load(std::memory_order_acquire);
+						const std::ptrdiff_t dif = (std::ptrdiff_t)seq - (std::ptrdiff_t)pos;
+						if (dif == 0) {
+							if (m_pushPos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+						}
+						else if (dif < 0) return false;	//full
+						else pos = m_pushPos.load(std::memory_order_relaxed);
+					}
+					cell->frame = f;
+					cell->seq.store(pos + 1, std::memory_order_release);
+					return true;
+				}
+				bool pop(TempFrame& f) {
+					size_t pos = m_popPos.load(std::memory_order_relaxed);
+					Cell* cell;
+					while (1) {
+						cell = &m_cells[pos & m_mask];
+						const size_t seq = cell->seq.load(std::memory_order_acquire);
+						const std::ptrdiff_t dif = (std::ptrdiff_t)seq - (std::ptrdiff_t)(pos + 1);
+						if (dif == 0) {
+							if (m_popPos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+						}
+						else if (dif < 0) return false;	//empty
+						else pos = m_popPos.load(std::memory_order_relaxed);
+					}
+					f = cell->frame;
+					cell->seq.store(pos + m_mask + 1, std::memory_order_release);
+					return true;
+				}
+			private:
+				struct Cell {
+					Cell() {}
+					Cell(const Cell&) {}	//only needed for the vector; cells are never copied after construction
+					Cell& operator=(const Cell&) { return *this; }
+					std::atomic<size_t> seq;
+					TempFrame frame;
+				};
+				std::vector<Cell> m_cells;
+				size_t m_mask;
+				std::atomic<size_t> m_pushPos;
+				std::atomic<size_t> m_popPos;
+			};
+
+			//! counts the queued frames; compress threads sleep on it while the queue is empty
+			class Semaphore {
+			public:
+				Semaphore() : m_count(0), m_bClosed(false) {}
+				void notify() {
+					{
+						std::lock_guard<std::mutex> lock(m_mutex);
+						m_count++;
+					}
+					m_cond.notify_one();
+				}
+				//! returns false once closed and drained
+				bool wait() {
+					std::unique_lock<std::mutex> lock(m_mutex);
+					m_cond.wait(lock, [&] { return m_count > 0 || m_bClosed; });
+					if (m_count == 0) return false;
+					m_count--;
+					return true;
+				}
+				void close() {
+					{
+						std::lock_guard<std::mutex> lock(m_mutex);
+						m_bClosed = true;
+					}
+					m_cond.notify_all();
+				}
+			private:
+				std::mutex m_mutex;
+				std::condition_variable m_cond;
+				size_t m_count;
+				bool m_bClosed;
+			};
+
+			//! writes RGBFrame to .sens file
+			void writeFrameToFile(const RGBDFrame& frame)
+			{
+				if (!m_out) {
+					throw std::runtime_error("Output file has been closed");
+				}
+				if (!m_headerWritten) {
+					writeHeaderToFile();
+				}
+				frame.saveToFile(m_out);
+				++m_frameCounterRGB;
+			}
+
+			//! writes the header and a placeholder for the number of RGB frames (patched on close)
+			void writeHeaderToFile()
+			{
+				m_headerWritten = true;
+				m_data->writeHeaderToFile(m_out);
+				m_numFramesPosRGB = m_out.tellp();
+				m_data->writeNumFramesToFile(0, m_out);
+			}
+
+			void setException(std::exception_ptr e) {
+				{
+					std::lock_guard<std::mutex> lock(m_mutex);
+					if (!m_exception) m_exception = e;
+				}
+				m_condWritten.notify_all();
+				m_condCompressed.notify_all();
+			}
+
+			void startBackgroundThreads(unsigned int numThreads) {
+				m_bTerminateThread = false;
+				m_nextFrameIdx = 0;
+				m_nextWrite = 0;
+				m_numInFlight = 0;
+				m_compressed.resize(m_cacheSize);
+				m_compressedReady.resize(m_cacheSize, 0);
+
+				const auto compressThreadFunc = [this]
+				{
+					while (m_numQueued.wait()) {
+						TempFrame frame;
+						while (!m_queue.pop(frame)) {}	//the push that was counted may not be published yet
+						try {
+							SensorData::RGBDFrame rgbFrame = m_data->createFrame(frame.colorFrame, frame.depthFrame, frame.transform, frame.timeStampColor, frame.timeStampDepth);
+							frame.free();
+							{
+								std::lock_guard<std::mutex> lock(m_mutex);
+								const size_t slot = frame.frameIdx % m_cacheSize;
+								m_compressed[slot] = std::move(rgbFrame);
+								m_compressedReady[slot] = 1;
+							}
+							m_condCompressed.notify_one();
+						}
+						catch (...) {
+							frame.free();
+							setException(std::current_exception());
+						}
+					}
+				};
+				const auto writeThreadFunc = [this]
+				{
+					while (1) {
+						SensorData::RGBDFrame rgbFrame;
+						{
+							std::unique_lock<std::mutex> lock(m_mutex);
+							const size_t slot = m_nextWrite % m_cacheSize;
+							m_condCompressed.wait(lock, [&] { return m_compressedReady[slot] || (m_bTerminateThread && m_numInFlight == 0) || m_exception; });
+							if (!m_compressedReady[slot]) break;
+							rgbFrame = std::move(m_compressed[slot]);
+							m_compressedReady[slot] = 0;
+						}
+						try {
+							writeFrameToFile(rgbFrame);
+						}
+						catch (...) {
+							rgbFrame.free();
+							setException(std::current_exception());
+							break;
+						}
+						rgbFrame.free();
+						{
+							std::lock_guard<std::mutex> lock(m_mutex);
+							m_nextWrite++;
+							m_numInFlight--;
+						}
+						m_condWritten.notify_all();
+					}
+				};
+				for (unsigned int i = 0; i < numThreads; i++) {
+					m_compressThreads.push_back(std::thread(compressThreadFunc));
+				}
+				m_writeThread = std::thread(writeThreadFunc);
+			}
+
+		private:
+			const SensorData* m_data;
+			unsigned int m_cacheSize;
+			std::ofstream m_out;
+			uint64_t m_frameCounterRGB;
+			bool m_headerWritten;
+			std::streampos m_numFramesPosRGB;
+
+			FrameQueue m_queue;							//uncompressed frames
+			Semaphore m_numQueued;
+			std::vector<std::thread> m_compressThreads;
+			std::thread m_writeThread;
+
+			std::mutex m_mutex;							//guards the members below
+			std::condition_variable m_condCompressed;	//a frame was compressed (or termination)
+			std::condition_variable m_condWritten;		//a frame was written (i.e., the reorder window moved)
+			std::vector<RGBDFrame> m_compressed;		//reorder buffer: frame k is placed in slot k % m_cacheSize
+			std::vector<char> m_compressedReady;
+			UINT64 m_nextWrite;
+			UINT64 m_numInFlight;						//frames passed to writeFrameAndFree but not written yet
+			bool m_bTerminateThread;
+			std::exception_ptr m_exception;
+
+			std::atomic<UINT64> m_nextFrameIdx;			//used by writeNextAndFree
+		};
+#endif
+
+		//! reads header from .sens file
+		void readHeaderFromFile(std::istream& in) {
 			in.read((char*)&m_versionNumber, sizeof(unsigned int));
 			assertVersionNumber();
 			UINT64 strLen = 0;
@@ -1271,6 +2702,18 @@ namespace ml {
 			in.read((char*)&m_depthWidth, sizeof(unsigned int));
 			in.read((char*)&m_depthHeight, sizeof(unsigned int));
 			in.read((char*)&m_depthShift, sizeof(unsigned int));
+		}
+
+		//! loads a .sens file
+		void loadFromFile(const std::string& filename) {
+			std::ifstream in(filename, std::ios::binary);
+
+			if (!in.is_open()) {
+				throw MLIB_EXCEPTION("could not open file " + filename);
+			}
+
+			free();
+			readHeaderFromFile(in);
 
 			UINT64 numFrames = 0;
 			in.read((char*)&numFrames, sizeof(UINT64));
@@ -1289,6 +2732,43 @@ namespace ml {
 			}
 		}
 
+		//! loads a .sens file through a read-only memory mapping: frames point into the mapped file instead of owning a copy (the file must not change while mapped)
+		void loadFromFileMapped(const std::string& filename) {
+			std::ifstream in(filename, std::ios::binary);
+
+			if (!in.is_open()) {
+				throw MLIB_EXCEPTION("could not open file " + filename);
+			}
+
+			free();
+			readHeaderFromFile(in);
+
+			UINT64 numFrames = 0;
+			in.read((char*)&numFrames, sizeof(UINT64));
+			if (!in) throw MLIB_EXCEPTION("unexpected end of file " + filename);
+
+			m_mappedFile = std::make_shared<MemoryMappedFile>(filename);
+			const unsigned char* data = m_mappedFile->getData();
+			const UINT64 sizeBytes = m_mappedFile->getSizeBytes();
+			UINT64 offset = (UINT64)in.tellg();
+			if (numFrames > (sizeBytes - offset) / (sizeof(mat4f) + 4 * sizeof(UINT64))) throw MLIB_EXCEPTION("invalid number of frames in " + filename);
+
+			m_frames.resize(numFrames);
+			for (size_t i = 0; i < m_frames.size(); i++) {
+				offset += m_frames[i].loadFromMemory(data + offset, sizeBytes - offset);
+			}
+
+			in.seekg(offset);
+			UINT64 numIMUFrames = 0;
+			in.read((char*)&numIMUFrames, sizeof(UINT64));
+			if (numIMUFrames > 0) {
+				m_IMUFrames.resize(numIMUFrames);
+				for (size_t i = 0; i < m_IMUFrames.size(); i++) {
+					m_IMUFrames[i].loadFromFile(in);
+				}
+			}
+		}
+
 		class StringCounter {
 		public:
 			StringCounter(const std::string& base, const std::string fileEnding, unsigned int numCountDigits = 0, unsigned int initValue = 0) {
@@ -1376,8 +2856,29 @@ namespace ml {
 
 
 
+		//! selects the frames and the output formats of saveToImages
+		struct ImageExportOptions {
+			ImageExportOptions() {
+				frameBegin = 0;
+				frameEnd = (size_t)-1;
+				frameStride = 1;
+				numThreads = 0;
+				depthAsPNG = false;
+			}
+			size_t frameBegin;			//first exported frame
+			size_t frameEnd;			//one past the last exported frame (clamped to the number of frames)
+			size_t frameStride;			//every frameStride-th frame is exported
+			unsigned int numThreads;	//0: all cores
+			bool depthAsPNG;			//16-bit png (<basename>XXXXXX.depth.png) instead of pgm
+		};
+
 		//! 7-scenes format
 		void saveToImages(const std::string& outputFolder, const std::string& basename = "frame-") const {
+			saveToImages(outputFolder, ImageExportOptions(), basename);
+		}
+
+		//! 7-scenes format; only the selected frames are decoded, on a pool of threads that each hold one decoded depth frame at a time (files are numbered by frame index)
+		void saveToImages(const std::string& outputFolder, const ImageExportOptions& options, const std::string& basename = "frame-") const {
 			if (!ml::util::directoryExists(outputFolder)) ml::util::makeDirectory(outputFolder);
 
 			{
@@ -1407,62 +2908,79 @@ namespace ml {
 			}
 
 			if (m_frames.size() == 0) return;	//nothing to do
-			std::string colorFormatEnding = "png";	//default is png			
-			if (m_colorCompressionType == TYPE_PNG) colorFormatEnding = "png";
-			else if (m_colorCompressionType == TYPE_JPEG) colorFormatEnding = "jpg";
+			if (m_colorCompressionType != TYPE_RAW && m_colorCompressionType != TYPE_PNG && m_colorCompressionType != TYPE_JPEG) throw MLIB_EXCEPTION("unknown format");
+			const std::string colorFormatEnding = m_colorCompressionType == TYPE_JPEG ? "jpg" : "png";
 
-
-			StringCounter scColor(outputFolder + "/" + basename, "color." + colorFormatEnding, 6);
-			StringCounter scDepth(outputFolder + "/" + basename, "depth.png", 6);
-			StringCounter scPose(outputFolder + "/" + basename, ".pose.txt", 6);
-			StringCounter scDepthPPM(outputFolder + "/" + basename, "depth.pgm", 6);
+			std::vector<size_t> frameIndices;
+			for (size_t i = options.frameBegin; i < std::min(options.frameEnd, m_frames.size()); i += std::max(options.frameStride, (size_t)1)) {
+				frameIndices.push_back(i);
+			}
+			const unsigned int numThreads = (unsigned int)std::min((size_t)(options.numThreads > 0 ? options.numThreads : std::max(1u, std::thread::hardware_concurrency())), std::max(frameIndices.size(), (size_t)1));
 
 			std::cout << std::endl;
 
-			for (size_t i = 0; i < m_frames.size(); i++) {
-				std::cout << "\r[ processing frame " << std::to_string(i) << " of " << std::to_string(m_frames.size()) << " ]";
-				std::string colorFile = scColor.getNext();
-				std::string depthFile = scDepth.getNext();
-				std::string poseFile = scPose.getNext();
-				std::string depthPPMFile = scDepthPPM.getNext();
+			std::atomic<size_t> next(0);
+			std::atomic<size_t> numDone(0);
+			std::mutex mutex;
+			std::exception_ptr exception;
+			const auto worker = [&]() {
+				std::vector<unsigned short> depth((size_t)m_depthWidth*m_depthHeight);
+				try {
+					for (size_t k = next++; k < frameIndices.size(); k = next++) {
+						const size_t frameIdx = frameIndices[k];
+						const RGBDFrame& f = m_frames[frameIdx];
+						const std::string prefix = outputFolder + "/" + basename;
+
+						//color data
+						const std::string colorFile = StringCounter(prefix, "color." + colorFormatEnding, 6, (unsigned int)frameIdx).getCurrent();
+						if (m_colorCompressionType == TYPE_RAW) {
+							if (!stb::stbi_write_png(colorFile.c_str(), (int)m_colorWidth, (int)m_colorHeight, 3, f.getColorCompressed(), (int)(m_colorWidth * 3))) throw MLIB_EXCEPTION("cannot write file " + colorFile);
+						}
+						else {
+							writeFile(colorFile, f.getColorCompressed(), f.getColorSizeBytes());
+						}
 
-				const RGBDFrame& f = m_frames[i];
+						//depth data
+						decompressDepthInto(f, depth.data());
+						if (options.depthAsPNG) {
+							const std::string depthFile = StringCounter(prefix, "depth.png", 6, (unsigned int)frameIdx).getCurrent();
+							int sizeBytes = 0;
+							unsigned char* png = stb::stbi_write_png16_to_mem(depth.data(), (int)m_depthWidth, (int)m_depthHeight, &sizeBytes);
+							if (!png) throw MLIB_EXCEPTION("could not encode " + depthFile);
+							writeFile(depthFile, png, sizeBytes);
+							std::free(png);
+						}
+						else {
+							const std::string depthPGMFile = StringCounter(prefix, "depth.pgm", 6, (unsigned int)frameIdx).getCurrent();
+							saveAsPGM(depthPGMFile, m_depthWidth, m_depthHeight, depth.data(), true);	//warning this function switches the byte ordering of 'depth'
+						}
 
-				//color data
-				if (m_colorCompressionType == TYPE_RAW)
-				{
-					RGBDFrame frameCompressed((vec3uc*)f.getColorCompressed(), m_colorWidth, m_colorHeight, NULL, 0, 0, mat4f::identity(), TYPE_PNG);
-					FILE* file = fopen(colorFile.c_str(), "wb");
-					if (!file) throw MLIB_EXCEPTION("cannot open file " + colorFile);
-					fwrite(frameCompressed.getColorCompressed(), 1, frameCompressed.getColorSizeBytes(), file);
-					fclose(file);
-					frameCompressed.free();
-				}
-				else if (m_colorCompressionType == TYPE_PNG || m_colorCompressionType == TYPE_JPEG)
-				{
-					FILE* file = fopen(colorFile.c_str(), "wb");
-					if (!file) throw MLIB_EXCEPTION("cannot open file " + colorFile);
-					fwrite(f.getColorCompressed(), 1, f.getColorSizeBytes(), file);
-					fclose(file);
-				}
-				else {
-					throw MLIB_EXCEPTION("unknown format");
-				}
+						savePoseFile(StringCounter(prefix, ".pose.txt", 6, (unsigned int)frameIdx).getCurrent(), f.m_cameraToWorld);
 
-				//depth data
-				const bool writeDepthData = true;
-				if (writeDepthData)
-				{
-					unsigned short* depth = decompressDepthAlloc(f);
-					//DepthImage16 image(m_depthWidth, m_depthHeight, depth);
-					//FreeImageWrapper::saveImage(depthFile, image);
-					//stb::stbi_write_png(depthFile.c_str(), (int)m_depthWidth, (int)m_depthHeight, 2, depth, sizeof(unsigned short)*m_depthWidth);	//DOESN'T WORK BECAUE NO 16-bit write support
-					saveAsPGM(depthPPMFile, m_depthWidth, m_depthHeight, depth, true);	//warning this function switches the byte ordering of '*depth'
-					std::free(depth);
+						const size_t n = ++numDone;
+						std::lock_guard<std::mutex> lock(mutex);
+						std::cout << "\r[ processing frame " << std::to_string(n) << " of " << std::to_string(frameIndices.size()) << " ]";
+					}
+				}
+				catch (...) {
+					std::lock_guard<std::mutex> lock(mutex);
+					if (!exception) exception = std::current_exception();
+					next = frameIndices.size();
 				}
+			};
+			std::vector<std::thread> threads;
+			for (unsigned int t = 1; t < numThreads; t++) threads.push_back(std::thread(worker));
+			worker();
+			for (auto& t : threads) t.join();
+			if (exception) std::rethrow_exception(exception);
+		}
 
-				savePoseFile(poseFile, f.m_cameraToWorld);
-			}
+		static void writeFile(const std::string& filename, const void* data, UINT64 sizeBytes) {
+			FILE* file = fopen(filename.c_str(), "wb");
+			if (!file) throw MLIB_EXCEPTION("cannot open file " + filename);
+			const size_t written = fwrite(data, 1, (size_t)sizeBytes, file);
+			fclose(file);
+			if (written != sizeBytes) throw MLIB_EXCEPTION("cannot write file " + filename);
 		}
 #ifdef 	_FREEIMAGEWRAPPER_H_	//needs free image to write out data
 		//! 7-scenes format
@@ -1566,9 +3084,11 @@ namespace ml {
 			PointCloudf pc;
 
 			const mat4f intrinsicInv = m_calibrationDepth.m_intrinsic.getInverse();
+			FrameBufferPool buffers(*this);
 			for (unsigned int frame = frameFrom; frame < frameTo; frame++) {
-				vec3uc* color = decompressColorAlloc(frame);
-				unsigned short* depth = decompressDepthAlloc(frame);
+				buffers.decompress(*this, m_frames[frame]);
+				const vec3uc* color = buffers.getColor();
+				const unsigned short* depth = buffers.getDepth();
 				mat4f transform = m_frames[frame].getCameraToWorld(); if (transform[0] == -std::numeric_limits<float>::infinity() || transform[0] == 0) transform.setIdentity();
 				for (unsigned int i = 0; i < m_depthWidth*m_depthHeight; i++) {
 					unsigned int x = i % m_depthWidth, y =  i / m_depthWidth;
@@ -1595,32 +3115,29 @@ namespace ml {
 						//}
 					}
 				}
-				std::free(color);
-				std::free(depth);
 			}
 			PointCloudIOf::saveToFile(filename, pc);
 		}
 #endif
 
-		//! appends another SensorData object
+		//! appends the frames and IMU frames of another SensorData object (copies; see appendFile to append .sens files without loading them)
 		void append(const SensorData& second) {
-			if (m_colorWidth != second.m_colorWidth &&
-				m_colorHeight != second.m_colorHeight &&
-				m_depthWidth != second.m_depthWidth &&
-				m_depthHeight != second.m_depthHeight &&
-				m_colorCompressionType != second.m_colorCompressionType &&
-				m_depthCompressionType != second.m_depthCompressionType) {
+			if (!isCompatible(second)) {
 				throw MLIB_EXCEPTION("sensor data incompatible");
 			}
 
+			//RGBDFrame has no destructor and its move constructor is not noexcept, so a growing m_frames would copy (and leak) the
+			//existing frames; they are moved into a vector of the final size instead
+			std::vector<RGBDFrame> frames;
+			frames.reserve(m_frames.size() + second.m_frames.size());
+			for (size_t i = 0; i < m_frames.size(); i++) {
+				frames.push_back(std::move(m_frames[i]));
+			}
 			for (size_t i = 0; i < second.m_frames.size(); i++) {
-				m_frames.push_back(second.m_frames[i]);	//this is a bit of hack (relying on the fact that no copy-operator is implemented)
-				RGBDFrame& f = m_frames.back();
-				f.m_colorCompressed = (unsigned char*)std::malloc(f.m_colorSizeBytes);
-				f.m_depthCompressed = (unsigned char*)std::malloc(f.m_depthSizeBytes);
-				std::memcpy(f.m_colorCompressed, second.m_frames[i].m_colorCompressed, f.m_colorSizeBytes);
-				std::memcpy(f.m_depthCompressed, second.m_frames[i].m_depthCompressed, f.m_depthSizeBytes);
+				frames.push_back(second.m_frames[i]);	//the copy constructor copies the compressed data
 			}
+			m_frames.swap(frames);
+			m_IMUFrames.insert(m_IMUFrames.end(), second.m_IMUFrames.begin(), second.m_IMUFrames.end());
 		}
 
 		bool operator==(const SensorData& other) const {
@@ -1674,6 +3191,7 @@ namespace ml {
 
 		COMPRESSION_TYPE_COLOR m_colorCompressionType;
 		COMPRESSION_TYPE_DEPTH m_depthCompressionType;
+		unsigned int m_colorCompressionQuality;	//JPEG quality of newly compressed frames (not stored in the file)
 
 		unsigned int m_colorWidth;
 		unsigned int m_colorHeight;
@@ -1684,6 +3202,8 @@ namespace ml {
 		std::vector<RGBDFrame> m_frames;
 		std::vector<IMUFrame> m_IMUFrames;
 
+		std::shared_ptr<MemoryMappedFile> m_mappedFile;	//only set if loaded with loadFromFileMapped
+
 		/////////////////////////////
 		//MEMBER VARIABLES END HERE//
 		/////////////////////////////
@@ -1714,6 +3234,7 @@ namespace ml {
 		}
 
 
+		//! prefetches decompressed frames with a pool of worker threads; frames are delivered in order through getNext()
 		class RGBDFrameCacheRead {
 		public:
 			struct FrameState {
@@ -1723,6 +3244,7 @@ namespace ml {
 					m_depthFrame = NULL;
 					m_timeStampDepth = 0;
 					m_timeStampColor = 0;
+					m_frameIdx = (size_t)-1;
 				}
 				~FrameState() {
 					//NEEDS MANUAL FREE
@@ -1744,20 +3266,39 @@ namespace ml {
 				unsigned short*	m_depthFrame;
 				UINT64			m_timeStampDepth;
 				UINT64			m_timeStampColor;
+				size_t			m_frameIdx;		//index into m_frames
 			};
-			RGBDFrameCacheRead(SensorData* sensorData, unsigned int cacheSize) : m_decompThread() {
+
+			//! decodes the frames frameBegin, frameBegin+stride, ... < frameEnd; at most cacheSize decoded frames are held at a time (numThreads == 0 -> one worker per core)
+			RGBDFrameCacheRead(SensorData* sensorData, unsigned int cacheSize, unsigned int numThreads = 1, size_t frameBegin = 0, size_t frameEnd = (size_t)-1, size_t stride = 1) {
+				if (cacheSize == 0) throw MLIB_EXCEPTION("cache size must be > 0");
+				if (stride == 0) throw MLIB_EXCEPTION("stride must be > 0");
+				if (numThreads == 0) numThreads = std::max(1u, std::thread::hardware_concurrency());
+
 				m_sensorData = sensorData;
 				m_cacheSize = cacheSize;
+				m_frameBegin = frameBegin;
+				m_stride = stride;
+				frameEnd = std::min(frameEnd, sensorData->m_frames.size());
+				m_numFrames = frameBegin < frameEnd ? (frameEnd - frameBegin + stride - 1) / stride : 0;
+
 				m_bTerminateThread = false;
 				m_nextFromSensorCache = 0;
 				m_nextFromSensorData = 0;
-				startDecompBackgroundThread();
+				m_data.resize(m_cacheSize);
+				for (unsigned int i = 0; i < numThreads; i++) {
+					m_decompThreads.push_back(std::thread(decompFunc, this));
+				}
 			}
 
 			~RGBDFrameCacheRead() {
-				m_bTerminateThread = true;
-				if (m_decompThread.joinable()) {
-					m_decompThread.join();
+				{
+					std::lock_guard<std::mutex> lock(m_mutex);
+					m_bTerminateThread = true;
+				}
+				m_condFree.notify_all();
+				for (auto& t : m_decompThreads) {
+					if (t.joinable()) t.join();
 				}
 
 				for (auto& fs : m_data) {
@@ -1765,69 +3306,86 @@ namespace ml {
 				}
 			}
 
-			FrameState getNext() {
-				while (1) {
-					if (m_nextFromSensorCache >= m_sensorData->m_frames.size()) {
-						m_bTerminateThread = true;	// should be already true anyway
-						break; //we're done
-					}
-					if (m_data.size() > 0 && m_data.front().m_bIsReady) {
-						m_mutexList.lock();
-						FrameState fs = m_data.front();
-						m_data.pop_front();
-						m_mutexList.unlock();
-						m_nextFromSensorCache++;
-						return fs;
-					}
-					else {
-						#ifdef _WIN32
-						Sleep(0);
-						#endif
-					}
-				}
-				return FrameState();
+			//! number of frames that are delivered in total
+			size_t getNumFrames() const {
+				return m_numFrames;
 			}
 
-		private:
-			void startDecompBackgroundThread() {
-				m_decompThread = std::thread(decompFunc, this);
+			//! blocks until the next frame is decoded; returns an empty FrameState (m_bIsReady == false) when all frames were delivered; the caller frees the frame
+			FrameState getNext() {
+				std::unique_lock<std::mutex> lock(m_mutex);
+				if (m_nextFromSensorCache >= m_numFrames) return FrameState();	//we're done
+
+				FrameState& slot = m_data[m_nextFromSensorCache % m_cacheSize];
+				m_condReady.wait(lock, [&] { return slot.m_bIsReady || m_exception; });
+				if (!slot.m_bIsReady) std::rethrow_exception(m_exception);
+
+				FrameState fs = slot;
+				slot = FrameState();
+				m_nextFromSensorCache++;
+				lock.unlock();
+				m_condFree.notify_all();
+				return fs;
 			}
 
+		private:
 			static void decompFunc(RGBDFrameCacheRead* cache) {
+				SensorData* sensorData = cache->m_sensorData;
 				while (1) {
-					if (cache->m_bTerminateThread) break;
-					if (cache->m_nextFromSensorData >= cache->m_sensorData->m_frames.size()) break;	//we're done
-
-					if (cache->m_data.size() < cache->m_cacheSize) {	//need to fill the cache
-						cache->m_mutexList.lock();
-						cache->m_data.push_back(FrameState());
-						cache->m_mutexList.unlock();
-
-						SensorData* sensorData = cache->m_sensorData;
-						SensorData::RGBDFrame& frame = sensorData->m_frames[cache->m_nextFromSensorData];
-						FrameState& fs = cache->m_data.back();
+					size_t k;
+					{
+						//claim the next frame once its slot is free (i.e., frame k - cacheSize was delivered)
+						std::unique_lock<std::mutex> lock(cache->m_mutex);
+						if (cache->m_nextFromSensorData >= cache->m_numFrames) break;	//we're done
+						k = cache->m_nextFromSensorData++;
+						cache->m_condFree.wait(lock, [&] { return cache->m_bTerminateThread || k < cache->m_nextFromSensorCache + cache->m_cacheSize; });
+						if (cache->m_bTerminateThread) break;
+					}
 
-						//std::cout << "decompressing frame " << cache->m_nextFromSensorData << std::endl;
+					FrameState fs;
+					try {
+						fs.m_frameIdx = cache->m_frameBegin + k * cache->m_stride;
+						const SensorData::RGBDFrame& frame = sensorData->m_frames[fs.m_frameIdx];
 						fs.m_colorFrame = sensorData->decompressColorAlloc(frame);
 						fs.m_depthFrame = sensorData->decompressDepthAlloc(frame);
 						fs.m_timeStampDepth = frame.m_timeStampDepth;
 						fs.m_timeStampColor = frame.m_timeStampColor;
 						fs.m_bIsReady = true;
-						cache->m_nextFromSensorData++;
 					}
+					catch (...) {
+						fs.free();
+						std::lock_guard<std::mutex> lock(cache->m_mutex);
+						if (!cache->m_exception) cache->m_exception = std::current_exception();
+						cache->m_bTerminateThread = true;
+						cache->m_condReady.notify_all();
+						cache->m_condFree.notify_all();
+						break;
+					}
+
+					{
+						std::lock_guard<std::mutex> lock(cache->m_mutex);
+						cache->m_data[k % cache->m_cacheSize] = fs;
+					}
+					cache->m_condReady.notify_all();
 				}
 			}
 
 			SensorData* m_sensorData;
 			unsigned int m_cacheSize;
-
-			std::list<FrameState> m_data;
-			std::thread m_decompThread;
-			std::mutex m_mutexList;
-			std::atomic<bool> m_bTerminateThread;
-
-			unsigned int m_nextFromSensorData;
-			unsigned int m_nextFromSensorCache;
+			size_t m_frameBegin;
+			size_t m_stride;
+			size_t m_numFrames;
+
+			std::vector<FrameState> m_data;		//ring buffer: frame k is decoded into slot k % m_cacheSize
+			std::vector<std::thread> m_decompThreads;
+			std::mutex m_mutex;
+			std::condition_variable m_condReady;	//a frame was decoded
+			std::condition_variable m_condFree;		//a frame was delivered (i.e., a slot became free)
+			std::exception_ptr m_exception;			//first exception thrown by a worker; re-thrown in getNext()
+			bool m_bTerminateThread;
+
+			size_t m_nextFromSensorData;	//next frame to be claimed by a worker
+			size_t m_nextFromSensorCache;	//next frame to be delivered
 		};
 
 		class RGBDFrameCacheWrite {
@@ -1935,6 +3493,220 @@ namespace ml {
 		};
 	};
 
+	//! random access to single frames of a .sens file through its frame index (see SensorData::loadFrameIndex); only the requested records are read
+	class SensorDataRandomAccessReader {
+	public:
+		SensorDataRandomAccessReader(const std::string& filename) {
+			m_index = SensorData::loadFrameIndex(filename);
+			m_in.open(filename, std::ios::binary);
+			if (!m_in.is_open()) throw MLIB_EXCEPTION("could not open file " + filename);
+			m_header.readHeaderFromFile(m_in);
+		}
+
+		//! header information (calibration, image dimensions, compression types); contains no frames
+		const SensorData& getHeader() const {
+			return m_header;
+		}
+
+		size_t getNumFrames() const {
+			return m_index.m_frameOffsets.size();
+		}
+
+		const SensorData::FrameIndex& getFrameIndex() const {
+			return m_index;
+		}
+
+		//! reads the record of a single frame (thread-safe); decompress with getHeader().decompressColorAlloc(frame) etc.
+		void readFrame(size_t frameIdx, SensorData::RGBDFrame& frame) {
+			if (frameIdx >= getNumFrames()) throw MLIB_EXCEPTION("out of bounds");
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_in.clear();
+			m_in.seekg(m_index.m_frameOffsets[frameIdx]);
+			frame.loadFromFile(m_in);
+			if (!m_in) throw MLIB_EXCEPTION("unexpected end of file");
+		}
+
+		//! reads the IMU block (thread-safe)
+		void readIMUFrames(std::vector<SensorData::IMUFrame>& imuFrames) {
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_in.clear();
+			m_in.seekg(m_index.m_IMUOffset);
+			UINT64 numIMUFrames = 0;
+			m_in.read((char*)&numIMUFrames, sizeof(UINT64));
+			imuFrames.resize(numIMUFrames);
+			for (size_t i = 0; i < imuFrames.size(); i++) {
+				imuFrames[i].loadFromFile(m_in);
+			}
+			if (!m_in) throw MLIB_EXCEPTION("unexpected end of file");
+		}
+
+	private:
+		SensorData m_header;
+		SensorData::FrameIndex m_index;
+		std::ifstream m_in;
+		std::mutex m_mutex;
+	};
+
+	//! forward-only reader for .sens data from any std::istream (e.g., a pipe from a decompressor or stdin); holds at most windowSize frame records besides the one handed out
+	class SensorDataStreamReader {
+	public:
+		//! reads from in (which must outlive the reader); windowSize == 0 -> frames are read synchronously in readNext(), otherwise a background thread reads up to windowSize frames ahead
+		SensorDataStreamReader(std::istream& in, unsigned int windowSize = 4) : m_in(in) {
+			init(windowSize);
+		}
+
+		//! reads the file filename, or stdin if filename is "-"
+		SensorDataStreamReader(const std::string& filename, unsigned int windowSize = 4) : m_in(openStream(filename, m_file)) {
+			init(windowSize);
+		}
+
+		~SensorDataStreamReader() {
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_bTerminateThread = true;
+			}
+			m_condFree.notify_all();
+			if (m_readThread.joinable()) m_readThread.join();	//note: waits for a pending read on a blocking stream to return
+			for (auto& f : m_window) f.free();
+		}
+
+		//! header information (calibration, image dimensions, compression types); contains no frames; decompress with getHeader().decompressColorAlloc(frame) etc.
+		const SensorData& getHeader() const {
+			return m_header;
+		}
+
+		//! number of frames stored in the stream
+		size_t getNumFrames() const {
+			return (size_t)m_numFrames;
+		}
+
+		//! number of frames returned by readNext so far (i.e., index of the next frame)
+		size_t getNumFramesRead() const {
+			return (size_t)m_numFramesRead;
+		}
+
+		//! moves the next frame record into frame (previous content is freed); returns false after the last frame
+		bool readNext(SensorData::RGBDFrame& frame) {
+			frame.free();
+			if (m_numFramesRead >= m_numFrames) return false;
+
+			if (!m_readThread.joinable()) {
+				readFrame(frame);
+			}
+			else {
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_condReady.wait(lock, [&] { return !m_window.empty() || m_exception; });
+				if (m_window.empty()) std::rethrow_exception(m_exception);
+				frame = std::move(m_window.front());
+				m_window.pop_front();
+				lock.unlock();
+				m_condFree.notify_all();
+			}
+			m_numFramesRead++;
+			if (m_numFramesRead == m_numFrames && !m_readThread.joinable()) readIMUFrames();
+			return true;
+		}
+
+		//! the IMU block behind the frames; only available once all frames were read (returns false otherwise)
+		bool getIMUFrames(std::vector<SensorData::IMUFrame>& imuFrames) {
+			if (m_numFramesRead < m_numFrames) return false;
+			if (m_readThread.joinable()) {
+				m_readThread.join();
+				if (m_exception) std::rethrow_exception(m_exception);
+			}
+			imuFrames = m_IMUFrames;
+			return true;
+		}
+
+	private:
+		static std::istream& openStream(const std::string& filename, std::ifstream& file) {
+			if (filename == "-") {
+#ifdef WIN32
+				_setmode(_fileno(stdin), _O_BINARY);
+#endif
+				return std::cin;
+			}
+			file.open(filename, std::ios::binary);
+			if (!file.is_open()) throw MLIB_EXCEPTION("could not open file " + filename);
+			return file;
+		}
+
+		void init(unsigned int windowSize) {
+			m_windowSize = windowSize;
+			m_numFramesRead = 0;
+			m_bTerminateThread = false;
+
+			m_header.readHeaderFromFile(m_in);
+			m_numFrames = 0;
+			m_in.read((char*)&m_numFrames, sizeof(UINT64));
+			if (!m_in) throw MLIB_EXCEPTION("unexpected end of stream");
+
+			if (m_windowSize > 0 && m_numFrames > 0) m_readThread = std::thread(readFunc, this);
+			else if (m_numFrames == 0) readIMUFrames();
+		}
+
+		void readFrame(SensorData::RGBDFrame& frame) {
+			frame.loadFromFile(m_in);
+			if (!m_in) {
+				frame.free();
+				throw MLIB_EXCEPTION("unexpected end of stream");
+			}
+		}
+
+		void readIMUFrames() {
+			UINT64 numIMUFrames = 0;
+			m_in.read((char*)&numIMUFrames, sizeof(UINT64));
+			if (!m_in) return;	//older files may end without an IMU block
+			for (UINT64 i = 0; i < numIMUFrames; i++) {
+				SensorData::IMUFrame f;
+				f.loadFromFile(m_in);
+				if (!m_in) throw MLIB_EXCEPTION("unexpected end of stream");
+				m_IMUFrames.push_back(f);
+			}
+		}
+
+		static void readFunc(SensorDataStreamReader* reader) {
+			try {
+				for (UINT64 i = 0; i < reader->m_numFrames; i++) {
+					{
+						std::unique_lock<std::mutex> lock(reader->m_mutex);
+						reader->m_condFree.wait(lock, [&] { return reader->m_bTerminateThread || reader->m_window.size() < reader->m_windowSize; });
+						if (reader->m_bTerminateThread) return;
+					}
+					SensorData::RGBDFrame frame;
+					reader->readFrame(frame);
+					{
+						std::lock_guard<std::mutex> lock(reader->m_mutex);
+						reader->m_window.push_back(std::move(frame));
+					}
+					reader->m_condReady.notify_all();
+				}
+				reader->readIMUFrames();
+			}
+			catch (...) {
+				std::lock_guard<std::mutex> lock(reader->m_mutex);
+				reader->m_exception = std::current_exception();
+				reader->m_condReady.notify_all();
+			}
+		}
+
+		std::ifstream m_file;		//only used if not reading from stdin or a caller-provided stream
+		std::istream& m_in;
+		SensorData m_header;
+		UINT64 m_numFrames;
+		UINT64 m_numFramesRead;
+		std::vector<SensorData::IMUFrame> m_IMUFrames;
+
+		unsigned int m_windowSize;
+		std::list<SensorData::RGBDFrame> m_window;	//frames read ahead (at most m_windowSize)
+		std::thread m_readThread;
+		std::mutex m_mutex;
+		std::condition_variable m_condReady;	//a frame was read
+		std::condition_variable m_condFree;		//a frame was handed out
+		std::exception_ptr m_exception;			//first exception of the read thread; re-thrown in readNext()
+		bool m_bTerminateThread;
+	};
+
 #ifndef VAR_STR_LINE
 #define VAR_STR_LINE(x) '\t' << #x << '=' << x << '\n'
 #endif
@@ -0,0 +1,177 @@
+#pragma once
+
+//
+// Lossless depth codec of TYPE_RUNDELTA_USHORT (cf. RVL, A. D. Wilson, "Fast Lossless Depth Image Compression", ISS 2017):
+// the image is scanned as runs of zeros (invalid depth) and runs of valid values. The run lengths are stored as
+// varints; each valid value is predicted by the previous valid value and the zig-zag mapped residuals are bit-packed
+// in blocks of 32 with one bit width per block, so that a block decodes without any data-dependent branches.
+//
+// layout (little-endian):
+//	uint32 numRuns, uint32 numValues, uint32 runsSizeBytes
+//	runs:	{ varint(#zeros) varint(#values) } * numRuns
+//	blocks:	{ uint8 bitWidth, 4*bitWidth bytes (32 residuals, LSB first) } * ceil(numValues / 32)
+//	8 bytes padding
+//
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+
+namespace depthcodec {
+
+	static const unsigned int BLOCK_SIZE = 32;
+	static const unsigned int HEADER_SIZE_BYTES = 3 * sizeof(uint32_t);
+	static const unsigned int PADDING_BYTES = 8;
+
+	//! upper bound of the compressed size in bytes
+	inline size_t compressBound(size_t numValues) {
+		return HEADER_SIZE_BYTES + 10 * (numValues + 1) + (numValues / BLOCK_SIZE + 1) * (1 + 4 * 17) + PADDING_BYTES;
+	}
+
+	inline unsigned char* writeVarint(unsigned char* out, uint32_t value) {
+		while (value >= 0x80) {
+			*out++ = (unsigned char)(value | 0x80);
+			value >>= 7;
+		}
+		*out++ = (unsigned char)value;
+		return out;
+	}
+
+	//! returns NULL if the varint is truncated or too long
+	inline const unsigned char* readVarint(const unsigned char* in, const unsigned char* end, uint32_t& value) {
+		value = 0;
+		for (unsigned int shift = 0; shift < 35 && in != end; shift += 7) {
+			const unsigned char byte = *in++;
+			value |= (uint32_t)(byte & 0x7f) << shift;
+			if (!(byte & 0x80)) return in;
+		}
+		return NULL;
+	}
+
+	inline unsigned char* writeBlock(unsigned char* out, const uint32_t* residuals) {
+		uint32_t any = 0;
+		for (unsigned int j = 0; j < BLOCK_SIZE; j++) any |= residuals[j];
+		unsigned int bitWidth = 0;
+		while (any >> bitWidth) bitWidth++;
+
+		*out++ = (unsigned char)bitWidth;
+		uint64_t buffer = 0;
+		unsigned int numBits = 0;
+		for (unsigned int j = 0; j < BLOCK_SIZE; j++) {
+			buffer |= (uint64_t)residuals[j] << numBits;
+			numBits += bitWidth;
+			while (numBits >= 8) {
+				*out++ = (unsigned char)buffer;
+				buffer >>= 8;
+				numBits -= 8;
+			}
+		}
+		return out;	//32*bitWidth bits always end on a byte boundary
+	}
+
+	//! compresses numValues depth values into output (at least compressBound(numValues) bytes); returns the compressed size in bytes
+	inline size_t compress(const unsigned short* input, size_t numValues, unsigned char* output) {
+		//runs
+		unsigned char* out = output + HEADER_SIZE_BYTES;
+		uint32_t numRuns = 0, numNonZeros = 0;
+		for (size_t i = 0; i < numValues;) {
+			const size_t begin = i;
+			while (i < numValues && input[i] == 0) i++;
+			out = writeVarint(out, (uint32_t)(i - begin));
+			const size_t beginValues = i;
+			while (i < numValues && input[i] != 0) i++;
+			out = writeVarint(out, (uint32_t)(i - beginValues));
+			numNonZeros += (uint32_t)(i - beginValues);
+			numRuns++;
+		}
+		const uint32_t runsSizeBytes = (uint32_t)(out - output - HEADER_SIZE_BYTES);
+
+		//residual blocks
+		uint32_t residuals[BLOCK_SIZE];
+		unsigned int numResiduals = 0;
+		int previous = 0;
+		for (size_t i = 0; i < numValues; i++) {
+			if (input[i] == 0) continue;
+			const int delta = (int)input[i] - previous;
+			residuals[numResiduals++] = ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+			previous = input[i];
+			if (numResiduals == BLOCK_SIZE) {
+				out = writeBlock(out, residuals);
+				numResiduals = 0;
+			}
+		}
+		if (numResiduals > 0) {
+			for (unsigned int j = numResiduals; j < BLOCK_SIZE; j++) residuals[j] = 0;
+			out = writeBlock(out, residuals);
+		}
+		std::memset(out, 0, PADDING_BYTES);
+		out += PADDING_BYTES;
+
+		const uint32_t header[3] = { numRuns, numNonZeros, runsSizeBytes };
+		std::memcpy(output, header, HEADER_SIZE_BYTES);
+		return out - output;
+	}
+
+	//! decodes the next block of residuals and reconstructs the values; returns NULL if the data is corrupt
+	inline const unsigned char* readBlock(const unsigned char* in, const unsigned char* end, int& previous, unsigned short* values) {
+		if (in == end) return NULL;
+		const unsigned int bitWidth = *in++;
+		if (bitWidth > 17 || (size_t)(end - in) < 4 * bitWidth + PADDING_BYTES) return NULL;
+
+		const uint64_t mask = ((uint64_t)1 << bitWidth) - 1;
+		uint32_t residuals[BLOCK_SIZE];
+		for (unsigned int j = 0; j < BLOCK_SIZE; j++) {
+			const unsigned int bit = j * bitWidth;
+			uint64_t word;
+			std::memcpy(&word, in + (bit >> 3), sizeof(uint64_t));
+			residuals[j] = (uint32_t)((word >> (bit & 7)) & mask);
+		}
+		for (unsigned int j = 0; j < BLOCK_SIZE; j++) {
+			previous += (int)(residuals[j] >> 1) ^ -(int)(residuals[j] & 1);
+			values[j] = (unsigned short)previous;
+		}
+		return in + 4 * bitWidth;
+	}
+
+	//! decompresses exactly numValues depth values; returns false if the data is corrupt
+	inline bool decompress(const unsigned char* input, size_t sizeBytes, unsigned short* output, size_t numValues) {
+		if (sizeBytes < HEADER_SIZE_BYTES + PADDING_BYTES) return false;
+		uint32_t header[3];
+		std::memcpy(header, input, HEADER_SIZE_BYTES);
+		const uint32_t numRuns = header[0], numNonZeros = header[1], runsSizeBytes = header[2];
+		if (numNonZeros > numValues || runsSizeBytes > sizeBytes - HEADER_SIZE_BYTES) return false;
+
+		const unsigned char* runs = input + HEADER_SIZE_BYTES;
+		const unsigned char* runsEnd = runs + runsSizeBytes;
+		const unsigned char* blocks = runsEnd;
+		const unsigned char* end = input + sizeBytes;
+
+		unsigned short values[BLOCK_SIZE];
+		unsigned int valueIdx = BLOCK_SIZE;	//next value in 'values'
+		int previous = 0;
+		size_t i = 0;
+		for (uint32_t r = 0; r < numRuns; r++) {
+			uint32_t numZeros, numNonZerosRun;
+			if (!(runs = readVarint(runs, runsEnd, numZeros))) return false;
+			if (!(runs = readVarint(runs, runsEnd, numNonZerosRun))) return false;
+			if (numZeros > numValues - i || numNonZerosRun > numValues - i - numZeros) return false;
+
+			std::memset(output + i, 0, numZeros * sizeof(unsigned short));
+			i += numZeros;
+			while (numNonZerosRun > 0) {
+				if (valueIdx == BLOCK_SIZE) {
+					if (!(blocks = readBlock(blocks, end, previous, values))) return false;
+					valueIdx = 0;
+				}
+				const unsigned int n = (unsigned int)std::min<uint32_t>(numNonZerosRun, BLOCK_SIZE - valueIdx);
+				std::memcpy(output + i, values + valueIdx, n * sizeof(unsigned short));
+				valueIdx += n;
+				i += n;
+				numNonZerosRun -= n;
+			}
+		}
+		return i == numValues;
+	}
+
+}	// namespace depthcodec
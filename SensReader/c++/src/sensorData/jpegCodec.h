@@ -0,0 +1,340 @@
+#pragma once
+
+//
+// Baseline JPEG encoder of TYPE_JPEG color frames (after jo_jpeg by Jon Olick, public domain; the vendored stb_image_write.h
+// predates stb's JPEG writer). 4:2:0 chroma subsampling below quality 91, standard quantization and huffman tables.
+//
+// writeToFunc has the interface of stbi_write_jpg_to_func of newer stb_image_write.h versions, so that the encoder can be
+// replaced by stb's once the vendored header is updated; SensorData only calls it through RGBDFrame::compressColor.
+// All encoder state lives on the stack, so frames can be encoded on several threads at once.
+//
+
+#include <cstring>
+#include <stdint.h>
+
+namespace jpegcodec {
+
+	//! receives the encoded bytes in order (same as stbi_write_func)
+	typedef void write_func(void* context, void* data, int size);
+
+	static const unsigned char ZIGZAG[] = { 0,1,5,6,14,15,27,28,2,4,7,13,16,26,29,42,3,8,12,17,25,30,41,43,9,11,18,24,31,
+		40,44,53,10,19,23,32,39,45,52,54,20,22,33,38,46,51,55,60,21,34,37,47,50,56,59,61,35,36,48,49,57,58,62,63 };
+
+	static const unsigned char STD_DC_LUMINANCE_NRCODES[] = { 0,0,1,5,1,1,1,1,1,1,0,0,0,0,0,0,0 };
+	static const unsigned char STD_DC_LUMINANCE_VALUES[] = { 0,1,2,3,4,5,6,7,8,9,10,11 };
+	static const unsigned char STD_AC_LUMINANCE_NRCODES[] = { 0,0,2,1,3,3,2,4,3,5,5,4,4,0,0,1,0x7d };
+	static const unsigned char STD_AC_LUMINANCE_VALUES[] = {
+		0x01,0x02,0x03,0x00,0x04,0x11,0x05,0x12,0x21,0x31,0x41,0x06,0x13,0x51,0x61,0x07,0x22,0x71,0x14,0x32,0x81,0x91,0xa1,0x08,
+		0x23,0x42,0xb1,0xc1,0x15,0x52,0xd1,0xf0,0x24,0x33,0x62,0x72,0x82,0x09,0x0a,0x16,0x17,0x18,0x19,0x1a,0x25,0x26,0x27,0x28,
+		0x29,0x2a,0x34,0x35,0x36,0x37,0x38,0x39,0x3a,0x43,0x44,0x45,0x46,0x47,0x48,0x49,0x4a,0x53,0x54,0x55,0x56,0x57,0x58,0x59,
+		0x5a,0x63,0x64,0x65,0x66,0x67,0x68,0x69,0x6a,0x73,0x74,0x75,0x76,0x77,0x78,0x79,0x7a,0x83,0x84,0x85,0x86,0x87,0x88,0x89,
+		0x8a,0x92,0x93,0x94,0x95,0x96,0x97,0x98,0x99,0x9a,0xa2,0xa3,0xa4,0xa5,0xa6,0xa7,0xa8,0xa9,0xaa,0xb2,0xb3,0xb4,0xb5,0xb6,
+		0xb7,0xb8,0xb9,0xba,0xc2,0xc3,0xc4,0xc5,0xc6,0xc7,0xc8,0xc9,0xca,0xd2,0xd3,0xd4,0xd5,0xd6,0xd7,0xd8,0xd9,0xda,0xe1,0xe2,
+		0xe3,0xe4,0xe5,0xe6,0xe7,0xe8,0xe9,0xea,0xf1,0xf2,0xf3,0xf4,0xf5,0xf6,0xf7,0xf8,0xf9,0xfa
+	};
+	static const unsigned char STD_DC_CHROMINANCE_NRCODES[] = { 0,0,3,1,1,1,1,1,1,1,1,1,0,0,0,0,0 };
+	static const unsigned char STD_DC_CHROMINANCE_VALUES[] = { 0,1,2,3,4,5,6,7,8,9,10,11 };
+	static const unsigned char STD_AC_CHROMINANCE_NRCODES[] = { 0,0,2,1,2,4,4,3,4,7,5,4,4,0,1,2,0x77 };
+	static const unsigned char STD_AC_CHROMINANCE_VALUES[] = {
+		0x00,0x01,0x02,0x03,0x11,0x04,0x05,0x21,0x31,0x06,0x12,0x41,0x51,0x07,0x61,0x71,0x13,0x22,0x32,0x81,0x08,0x14,0x42,0x91,
+		0xa1,0xb1,0xc1,0x09,0x23,0x33,0x52,0xf0,0x15,0x62,0x72,0xd1,0x0a,0x16,0x24,0x34,0xe1,0x25,0xf1,0x17,0x18,0x19,0x1a,0x26,
+		0x27,0x28,0x29,0x2a,0x35,0x36,0x37,0x38,0x39,0x3a,0x43,0x44,0x45,0x46,0x47,0x48,0x49,0x4a,0x53,0x54,0x55,0x56,0x57,0x58,
+		0x59,0x5a,0x63,0x64,0x65,0x66,0x67,0x68,0x69,0x6a,0x73,0x74,0x75,0x76,0x77,0x78,0x79,0x7a,0x82,0x83,0x84,0x85,0x86,0x87,
+		0x88,0x89,0x8a,0x92,0x93,0x94,0x95,0x96,0x97,0x98,0x99,0x9a,0xa2,0xa3,0xa4,0xa5,0xa6,0xa7,0xa8,0xa9,0xaa,0xb2,0xb3,0xb4,
+		0xb5,0xb6,0xb7,0xb8,0xb9,0xba,0xc2,0xc3,0xc4,0xc5,0xc6,0xc7,0xc8,0xc9,0xca,0xd2,0xd3,0xd4,0xd5,0xd6,0xd7,0xd8,0xd9,0xda,
+		0xe2,0xe3,0xe4,0xe5,0xe6,0xe7,0xe8,0xe9,0xea,0xf2,0xf3,0xf4,0xf5,0xf6,0xf7,0xf8,0xf9,0xfa
+	};
+
+	//! bit writer; the bytes are handed to the write_func in chunks
+	struct Writer {
+		write_func* func;
+		void* context;
+		unsigned char buffer[256];
+		int size;
+		uint32_t bitBuf, bitCnt;	//!< pending bits, MSB-aligned at bit 23 (only the low 24 bits are kept)
+
+		void writeByte(unsigned char c) {
+			if (size == (int)sizeof(buffer)) flush();
+			buffer[size++] = c;
+		}
+		void write(const unsigned char* data, int len) {
+			for (int i = 0; i < len; i++) writeByte(data[i]);
+		}
+		void flush() {
+			if (size) func(context, buffer, size);
+			size = 0;
+		}
+		void writeBits(const unsigned short* bs) {
+			bitCnt += bs[1];
+			bitBuf |= (uint32_t)bs[0] << (24 - bitCnt);
+			while (bitCnt >= 8) {
+				unsigned char c = (bitBuf >> 16) & 255;
+				writeByte(c);
+				if (c == 255) writeByte(0);
+				bitBuf = (bitBuf << 8) & 0xffffff;
+				bitCnt -= 8;
+			}
+		}
+	};
+
+	//! AAN forward DCT of 8 values (scaled; the scale factors are folded into the quantization tables)
+	inline void DCT(float* d0p, float* d1p, float* d2p, float* d3p, float* d4p, float* d5p, float* d6p, float* d7p) {
+		float d0 = *d0p, d1 = *d1p, d2 = *d2p, d3 = *d3p, d4 = *d4p, d5 = *d5p, d6 = *d6p, d7 = *d7p;
+
+		float tmp0 = d0 + d7;
+		float tmp7 = d0 - d7;
+		float tmp1 = d1 + d6;
+		float tmp6 = d1 - d6;
+		float tmp2 = d2 + d5;
+		float tmp5 = d2 - d5;
+		float tmp3 = d3 + d4;
+		float tmp4 = d3 - d4;
+
+		//even part
+		float tmp10 = tmp0 + tmp3;
+		float tmp13 = tmp0 - tmp3;
+		float tmp11 = tmp1 + tmp2;
+		float tmp12 = tmp1 - tmp2;
+
+		d0 = tmp10 + tmp11;
+		d4 = tmp10 - tmp11;
+
+		float z1 = (tmp12 + tmp13) * 0.707106781f;	//c4
+		d2 = tmp13 + z1;
+		d6 = tmp13 - z1;
+
+		//odd part
+		tmp10 = tmp4 + tmp5;
+		tmp11 = tmp5 + tmp6;
+		tmp12 = tmp6 + tmp7;
+
+		float z5 = (tmp10 - tmp12) * 0.382683433f;	//c6
+		float z2 = tmp10 * 0.541196100f + z5;		//c2-c6
+		float z4 = tmp12 * 1.306562965f + z5;		//c2+c6
+		float z3 = tmp11 * 0.707106781f;			//c4
+
+		float z11 = tmp7 + z3;
+		float z13 = tmp7 - z3;
+
+		*d5p = z13 + z2;
+		*d3p = z13 - z2;
+		*d1p = z11 + z4;
+		*d7p = z11 - z4;
+
+		*d0p = d0;	*d2p = d2;	*d4p = d4;	*d6p = d6;
+	}
+
+	inline void calcBits(int val, unsigned short bits[2]) {
+		int tmp1 = val < 0 ? -val : val;
+		val = val < 0 ? val - 1 : val;
+		bits[1] = 1;
+		while (tmp1 >>= 1) ++bits[1];
+		bits[0] = (unsigned short)(val & ((1 << bits[1]) - 1));
+	}
+
+	//! transforms, quantizes and encodes one 8x8 block (duStride: row stride of CDU); returns the DC coefficient
+	inline int processDU(Writer& w, float* CDU, int duStride, const float* fdtbl, int DC, const unsigned short HTDC[256][2], const unsigned short HTAC[256][2]) {
+		const unsigned short EOB[2] = { HTAC[0x00][0], HTAC[0x00][1] };
+		const unsigned short M16zeroes[2] = { HTAC[0xF0][0], HTAC[0xF0][1] };
+		int DU[64];
+
+		//DCT rows
+		for (int dataOff = 0, n = duStride * 8; dataOff < n; dataOff += duStride) {
+			DCT(&CDU[dataOff], &CDU[dataOff + 1], &CDU[dataOff + 2], &CDU[dataOff + 3], &CDU[dataOff + 4], &CDU[dataOff + 5], &CDU[dataOff + 6], &CDU[dataOff + 7]);
+		}
+		//DCT columns
+		for (int dataOff = 0; dataOff < 8; dataOff++) {
+			DCT(&CDU[dataOff], &CDU[dataOff + duStride], &CDU[dataOff + duStride * 2], &CDU[dataOff + duStride * 3], &CDU[dataOff + duStride * 4],
+				&CDU[dataOff + duStride * 5], &CDU[dataOff + duStride * 6], &CDU[dataOff + duStride * 7]);
+		}
+		//quantize/descale/zigzag the coefficients
+		for (int y = 0, j = 0; y < 8; y++) {
+			for (int x = 0; x < 8; x++, j++) {
+				const float v = CDU[y * duStride + x] * fdtbl[j];
+				DU[ZIGZAG[j]] = (int)(v < 0 ? v - 0.5f : v + 0.5f);
+			}
+		}
+
+		//encode DC
+		const int diff = DU[0] - DC;
+		if (diff == 0) {
+			w.writeBits(HTDC[0]);
+		}
+		else {
+			unsigned short bits[2];
+			calcBits(diff, bits);
+			w.writeBits(HTDC[bits[1]]);
+			w.writeBits(bits);
+		}
+		//encode ACs
+		int end0pos = 63;
+		while (end0pos > 0 && DU[end0pos] == 0) end0pos--;
+		if (end0pos == 0) {
+			w.writeBits(EOB);
+			return DU[0];
+		}
+		for (int i = 1; i <= end0pos; i++) {
+			const int startpos = i;
+			while (DU[i] == 0 && i <= end0pos) i++;
+			int nrzeroes = i - startpos;
+			if (nrzeroes >= 16) {
+				const int lng = nrzeroes >> 4;
+				for (int nrmarker = 1; nrmarker <= lng; nrmarker++) w.writeBits(M16zeroes);
+				nrzeroes &= 15;
+			}
+			unsigned short bits[2];
+			calcBits(DU[i], bits);
+			w.writeBits(HTAC[(nrzeroes << 4) + bits[1]]);
+			w.writeBits(bits);
+		}
+		if (end0pos != 63) w.writeBits(EOB);
+		return DU[0];
+	}
+
+	//! canonical huffman codes from the code counts per length (1..16) and the symbols
+	inline void buildHT(const unsigned char* nrcodes, const unsigned char* values, unsigned short HT[256][2]) {
+		int code = 0, v = 0;
+		for (int len = 1; len <= 16; len++) {
+			for (int k = 0; k < nrcodes[len]; k++, v++, code++) {
+				HT[values[v]][0] = (unsigned short)code;
+				HT[values[v]][1] = (unsigned short)len;
+			}
+			code <<= 1;
+		}
+	}
+
+	//! RGB -> YCbCr of the pixel (clamped to the image), Y shifted by -128
+	inline void loadPixel(const unsigned char* pixels, int width, int height, int comp, int x, int y, float* Y, float* U, float* V) {
+		if (x >= width) x = width - 1;
+		if (y >= height) y = height - 1;
+		const unsigned char* p = pixels + (y * width + x) * comp;
+		const float r = p[0];
+		const float g = comp > 2 ? p[1] : p[0];
+		const float b = comp > 2 ? p[2] : p[0];
+		*Y = +0.29900f * r + 0.58700f * g + 0.11400f * b - 128;
+		*U = -0.16874f * r - 0.33126f * g + 0.50000f * b;
+		*V = +0.50000f * r - 0.41869f * g - 0.08131f * b;
+	}
+
+	//! encodes a width x height image with comp (1..4, alpha is ignored) interleaved 8-bit channels; quality in [1, 100] (0: 90);
+	//! returns 0 on invalid arguments
+	inline int writeToFunc(write_func* func, void* context, int width, int height, int comp, const void* data, int quality) {
+		static const int YQT[] = { 16,11,10,16,24,40,51,61,12,12,14,19,26,58,60,55,14,13,16,24,40,57,69,56,14,17,22,29,51,87,80,62,18,22,
+			37,56,68,109,103,77,24,35,55,64,81,104,113,92,49,64,78,87,103,121,120,101,72,92,95,98,112,100,103,99 };
+		static const int UVQT[] = { 17,18,24,47,99,99,99,99,18,21,26,66,99,99,99,99,24,26,56,99,99,99,99,99,47,66,99,99,99,99,99,99,
+			99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99 };
+		static const float aasf[] = { 1.0f * 2.828427125f, 1.387039845f * 2.828427125f, 1.306562965f * 2.828427125f, 1.175875602f * 2.828427125f,
+			1.0f * 2.828427125f, 0.785694958f * 2.828427125f, 0.541196100f * 2.828427125f, 0.275899379f * 2.828427125f };
+
+		const unsigned char* pixels = (const unsigned char*)data;
+		if (!func || !pixels || width <= 0 || height <= 0 || width > 0xffff || height > 0xffff || comp < 1 || comp > 4) return 0;
+
+		quality = quality ? quality : 90;
+		const bool subsample = quality <= 90;
+		quality = quality < 1 ? 1 : quality > 100 ? 100 : quality;
+		quality = quality < 50 ? 5000 / quality : 200 - quality * 2;
+
+		unsigned char YTable[64], UVTable[64];
+		for (int i = 0; i < 64; i++) {
+			const int yti = (YQT[i] * quality + 50) / 100;
+			YTable[ZIGZAG[i]] = (unsigned char)(yti < 1 ? 1 : yti > 255 ? 255 : yti);
+			const int uvti = (UVQT[i] * quality + 50) / 100;
+			UVTable[ZIGZAG[i]] = (unsigned char)(uvti < 1 ? 1 : uvti > 255 ? 255 : uvti);
+		}
+		float fdtbl_Y[64], fdtbl_UV[64];
+		for (int row = 0, k = 0; row < 8; row++) {
+			for (int col = 0; col < 8; col++, k++) {
+				fdtbl_Y[k] = 1 / (YTable[ZIGZAG[k]] * aasf[row] * aasf[col]);
+				fdtbl_UV[k] = 1 / (UVTable[ZIGZAG[k]] * aasf[row] * aasf[col]);
+			}
+		}
+		unsigned short YDC_HT[256][2], UVDC_HT[256][2], YAC_HT[256][2], UVAC_HT[256][2];
+		std::memset(YDC_HT, 0, sizeof(YDC_HT));	std::memset(UVDC_HT, 0, sizeof(UVDC_HT));
+		std::memset(YAC_HT, 0, sizeof(YAC_HT));	std::memset(UVAC_HT, 0, sizeof(UVAC_HT));
+		buildHT(STD_DC_LUMINANCE_NRCODES, STD_DC_LUMINANCE_VALUES, YDC_HT);
+		buildHT(STD_AC_LUMINANCE_NRCODES, STD_AC_LUMINANCE_VALUES, YAC_HT);
+		buildHT(STD_DC_CHROMINANCE_NRCODES, STD_DC_CHROMINANCE_VALUES, UVDC_HT);
+		buildHT(STD_AC_CHROMINANCE_NRCODES, STD_AC_CHROMINANCE_VALUES, UVAC_HT);
+
+		Writer w;
+		w.func = func;
+		w.context = context;
+		w.size = 0;
+		w.bitBuf = 0;
+		w.bitCnt = 0;
+
+		//headers
+		{
+			static const unsigned char head0[] = { 0xFF,0xD8,0xFF,0xE0,0,0x10,'J','F','I','F',0,1,1,0,0,1,0,1,0,0,0xFF,0xDB,0,0x84,0 };
+			static const unsigned char head2[] = { 0xFF,0xDA,0,0xC,3,1,0,2,0x11,3,0x11,0,0x3F,0 };
+			const unsigned char head1[] = { 0xFF,0xC0,0,0x11,8,(unsigned char)(height >> 8),(unsigned char)height,(unsigned char)(width >> 8),(unsigned char)width,
+				3,1,(unsigned char)(subsample ? 0x22 : 0x11),0,2,0x11,1,3,0x11,1,0xFF,0xC4,0x01,0xA2,0 };
+			w.write(head0, sizeof(head0));
+			w.write(YTable, sizeof(YTable));
+			w.writeByte(1);
+			w.write(UVTable, sizeof(UVTable));
+			w.write(head1, sizeof(head1));
+			w.write(STD_DC_LUMINANCE_NRCODES + 1, sizeof(STD_DC_LUMINANCE_NRCODES) - 1);
+			w.write(STD_DC_LUMINANCE_VALUES, sizeof(STD_DC_LUMINANCE_VALUES));
+			w.writeByte(0x10);	//HTYACinfo
+			w.write(STD_AC_LUMINANCE_NRCODES + 1, sizeof(STD_AC_LUMINANCE_NRCODES) - 1);
+			w.write(STD_AC_LUMINANCE_VALUES, sizeof(STD_AC_LUMINANCE_VALUES));
+			w.writeByte(1);		//HTUDCinfo
+			w.write(STD_DC_CHROMINANCE_NRCODES + 1, sizeof(STD_DC_CHROMINANCE_NRCODES) - 1);
+			w.write(STD_DC_CHROMINANCE_VALUES, sizeof(STD_DC_CHROMINANCE_VALUES));
+			w.writeByte(0x11);	//HTUACinfo
+			w.write(STD_AC_CHROMINANCE_NRCODES + 1, sizeof(STD_AC_CHROMINANCE_NRCODES) - 1);
+			w.write(STD_AC_CHROMINANCE_VALUES, sizeof(STD_AC_CHROMINANCE_VALUES));
+			w.write(head2, sizeof(head2));
+		}
+
+		//encode 8x8 macroblocks (16x16 with subsampled chroma)
+		int DCY = 0, DCU = 0, DCV = 0;
+		if (subsample) {
+			float Y[256], U[256], V[256], subU[64], subV[64];
+			for (int y = 0; y < height; y += 16) {
+				for (int x = 0; x < width; x += 16) {
+					for (int row = 0, pos = 0; row < 16; row++) {
+						for (int col = 0; col < 16; col++, pos++) loadPixel(pixels, width, height, comp, x + col, y + row, &Y[pos], &U[pos], &V[pos]);
+					}
+					DCY = processDU(w, Y + 0, 16, fdtbl_Y, DCY, YDC_HT, YAC_HT);
+					DCY = processDU(w, Y + 8, 16, fdtbl_Y, DCY, YDC_HT, YAC_HT);
+					DCY = processDU(w, Y + 128, 16, fdtbl_Y, DCY, YDC_HT, YAC_HT);
+					DCY = processDU(w, Y + 136, 16, fdtbl_Y, DCY, YDC_HT, YAC_HT);
+					for (int row = 0, pos = 0; row < 8; row++) {
+						for (int col = 0; col < 8; col++, pos++) {
+							const int j = row * 32 + col * 2;
+							subU[pos] = (U[j + 0] + U[j + 1] + U[j + 16] + U[j + 17]) * 0.25f;
+							subV[pos] = (V[j + 0] + V[j + 1] + V[j + 16] + V[j + 17]) * 0.25f;
+						}
+					}
+					DCU = processDU(w, subU, 8, fdtbl_UV, DCU, UVDC_HT, UVAC_HT);
+					DCV = processDU(w, subV, 8, fdtbl_UV, DCV, UVDC_HT, UVAC_HT);
+				}
+			}
+		}
+		else {
+			float Y[64], U[64], V[64];
+			for (int y = 0; y < height; y += 8) {
+				for (int x = 0; x < width; x += 8) {
+					for (int row = 0, pos = 0; row < 8; row++) {
+						for (int col = 0; col < 8; col++, pos++) loadPixel(pixels, width, height, comp, x + col, y + row, &Y[pos], &U[pos], &V[pos]);
+					}
+					DCY = processDU(w, Y, 8, fdtbl_Y, DCY, YDC_HT, YAC_HT);
+					DCU = processDU(w, U, 8, fdtbl_UV, DCU, UVDC_HT, UVAC_HT);
+					DCV = processDU(w, V, 8, fdtbl_UV, DCV, UVDC_HT, UVAC_HT);
+				}
+			}
+		}
+		//bit alignment of the EOI marker
+		static const unsigned short fillBits[] = { 0x7F, 7 };
+		w.writeBits(fillBits);
+
+		//EOI
+		w.writeByte(0xFF);
+		w.writeByte(0xD9);
+		w.flush();
+		return 1;
+	}
+
+}	// namespace jpegcodec
@@ -137,6 +137,7 @@ STBIWDEF int stbi_write_hdr_to_func(stbi_write_func *func, void *context, int w,
 
 STBIWDEF unsigned char *stbi_write_png_to_mem(unsigned char *pixels, int stride_bytes, int x, int y, int n, int *out_len);	//manual add
 STBIWDEF unsigned char * stbi_zlib_compress(unsigned char *data, int data_len, int *out_len, int quality); //manual add
+STBIWDEF unsigned char *stbi_write_png16_to_mem(const unsigned short *pixels, int x, int y, int *out_len);	//manual add (16-bit grayscale)
 
 #ifdef __cplusplus
 }
@@ -822,17 +823,24 @@ unsigned char * stbi_zlib_compress(unsigned char *data, int data_len, int *out_l
    return (unsigned char *) stbiw__sbraw(out);
 }
 
+// manual change: the table is built by a static initializer, so that pngs can be written from several threads
+struct stbiw__crc_table_t {
+   unsigned int t[256];
+   stbiw__crc_table_t() {
+      int i,j;
+      for(i=0; i < 256; i++)
+         for (t[i]=i, j=0; j < 8; ++j)
+            t[i] = (t[i] >> 1) ^ (t[i] & 1 ? 0xedb88320 : 0);
+   }
+};
+
 unsigned int stbiw__crc32(unsigned char *buffer, int len)
 {
-   static unsigned int crc_table[256];
+   static const stbiw__crc_table_t crc_table;
    unsigned int crc = ~0u;
-   int i,j;
-   if (crc_table[1] == 0)
-      for(i=0; i < 256; i++)
-         for (crc_table[i]=i, j=0; j < 8; ++j)
-            crc_table[i] = (crc_table[i] >> 1) ^ (crc_table[i] & 1 ? 0xedb88320 : 0);
+   int i;
    for (i=0; i < len; ++i)
-      crc = (crc >> 8) ^ crc_table[buffer[i] ^ (crc & 0xff)];
+      crc = (crc >> 8) ^ crc_table.t[buffer[i] ^ (crc & 0xff)];
    return ~crc;
 }
 
@@ -972,6 +980,30 @@ STBIWDEF int stbi_write_png_to_func(stbi_write_func *func, void *context, int x,
    return 1;
 }
 
+// manual add: 16-bit grayscale png. The big-endian samples have the byte layout of 8-bit gray+alpha,
+// so the 8-bit writer (filters with 2 bytes per pixel) is used and only bit depth and color type of the header are changed.
+STBIWDEF unsigned char *stbi_write_png16_to_mem(const unsigned short *pixels, int x, int y, int *out_len)
+{
+   unsigned char *be, *png;
+   int i;
+   be = (unsigned char *) STBIW_MALLOC(x*y*2); if (!be) return 0;
+   for (i=0; i < x*y; ++i) {
+      be[2*i+0] = (unsigned char) (pixels[i] >> 8);
+      be[2*i+1] = (unsigned char) pixels[i];
+   }
+   png = stbi_write_png_to_mem(be, x*2, x, y, 2, out_len);
+   STBIW_FREE(be);
+   if (!png) return 0;
+   {
+      unsigned char *o = png + 8 + 8 + 8; // signature, IHDR length and tag, width and height
+      *o++ = 16;  // bit depth
+      *o++ = 0;   // grayscale
+      o += 3;
+      stbiw__wpcrc(&o, 13);
+   }
+   return png;
+}
+
 #endif // STB_IMAGE_WRITE_IMPLEMENTATION
 
 /* Revision history
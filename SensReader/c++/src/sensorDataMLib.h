@@ -0,0 +1,17 @@
+
+#ifndef _SENSOR_DATA_MLIB_H_
+#define _SENSOR_DATA_MLIB_H_
+
+//! ml::SensorData for the mLib-based tools (Calibrate, Converter, Alignment, AnnotationTools).
+//! The sensorData.h in mLib's ext-depthcamera lags behind this one (no FrameBufferPool, decompress*Into,
+//! SensorDataStreamReader, threaded LiveSensorDataWriter, readFramePoses/writeFramePoses, ...).
+//! Include this after mLibCore.h and before mLibDepthCamera.h (in every translation unit, including the one that compiles
+//! mLibDepthCamera.cpp): both files use the _SENSOR_FILE_H_ guard, so mLib's copy is skipped.
+
+#ifndef _HAS_MLIB
+#define _HAS_MLIB
+#endif
+
+#include "sensorData.h"
+
+#endif //_SENSOR_DATA_MLIB_H_
@@ -1,29 +1,51 @@
 
+from __future__ import print_function
 import os, struct
 import numpy as np
 import zlib
 import imageio
 import cv2
 import png
+try:
+  import _sensreader # c++ reader (see setup.py); falls back to the python reader below if not built
+except ImportError:
+  _sensreader = None
 
 COMPRESSION_TYPE_COLOR = {-1:'unknown', 0:'raw', 1:'png', 2:'jpeg'}
-COMPRESSION_TYPE_DEPTH = {-1:'unknown', 0:'raw_ushort', 1:'zlib_ushort', 2:'occi_ushort'}
+COMPRESSION_TYPE_DEPTH = {-1:'unknown', 0:'raw_ushort', 1:'zlib_ushort', 2:'occi_ushort', 3:'rundelta_ushort'}
 
 class RGBDFrame():
 
+  # frame of a file opened with the c++ reader: color_data/depth_data are uint8 arrays over the memory-mapped file
+  def load_native(self, reader, index, camera_to_world, timestamps):
+    self._reader = reader
+    self._index = index
+    self.camera_to_world = camera_to_world
+    self.timestamp_color = int(timestamps[0])
+    self.timestamp_depth = int(timestamps[1])
+    self.color_data = reader.color_data(index)
+    self.depth_data = reader.depth_data(index)
+    self.color_size_bytes = len(self.color_data)
+    self.depth_size_bytes = len(self.depth_data)
+
+
   def load(self, file_handle):
     self.camera_to_world = np.asarray(struct.unpack('f'*16, file_handle.read(16*4)), dtype=np.float32).reshape(4, 4)
     self.timestamp_color = struct.unpack('Q', file_handle.read(8))[0]
     self.timestamp_depth = struct.unpack('Q', file_handle.read(8))[0]
     self.color_size_bytes = struct.unpack('Q', file_handle.read(8))[0]
     self.depth_size_bytes = struct.unpack('Q', file_handle.read(8))[0]
-    self.color_data = ''.join(struct.unpack('c'*self.color_size_bytes, file_handle.read(self.color_size_bytes)))
-    self.depth_data = ''.join(struct.unpack('c'*self.depth_size_bytes, file_handle.read(self.depth_size_bytes)))
+    self.color_data = file_handle.read(self.color_size_bytes)
+    self.depth_data = file_handle.read(self.depth_size_bytes)
 
 
-  def decompress_depth(self, compression_type):
+  def decompress_depth(self, compression_type, num_values=None):
+    if getattr(self, '_reader', None) is not None:
+      return self._reader.decode([self._index], color=False)[1].tobytes()
     if compression_type == 'zlib_ushort':
        return self.decompress_depth_zlib()
+    elif compression_type == 'rundelta_ushort':
+       return self.decompress_depth_rundelta(num_values)
     else:
        raise
 
@@ -32,7 +54,46 @@ class RGBDFrame():
     return zlib.decompress(self.depth_data)
 
 
+  # see sensorData/depthCodec.h (c++) for the format
+  def decompress_depth_rundelta(self, num_values):
+    data = self.depth_data
+    num_runs, num_nonzeros, runs_size = struct.unpack('III', data[:12])
+    mask = np.zeros(num_values, dtype=bool)
+    pos = 12
+    idx = 0
+    for r in range(num_runs):
+      run = [0, 0]
+      for k in range(2):
+        shift = 0
+        while True:
+          byte = struct.unpack('B', data[pos:pos+1])[0]
+          pos += 1
+          run[k] |= (byte & 0x7f) << shift
+          shift += 7
+          if byte < 0x80:
+            break
+      idx += run[0]
+      mask[idx:idx+run[1]] = True
+      idx += run[1]
+    num_blocks = (num_nonzeros + 31) // 32
+    residuals = np.zeros(num_blocks * 32, dtype=np.int64)
+    for b in range(num_blocks):
+      width = struct.unpack('B', data[pos:pos+1])[0]
+      pos += 1
+      if width > 0:
+        block = np.frombuffer(data[pos:pos+4*width], dtype=np.uint8)
+        bits = ((block[:, None] >> np.arange(8)) & 1).reshape(32, width).astype(np.int64)
+        residuals[b*32:(b+1)*32] = bits.dot(1 << np.arange(width))
+        pos += 4*width
+    values = np.cumsum((residuals >> 1) ^ -(residuals & 1))[:num_nonzeros]
+    depth = np.zeros(num_values, dtype=np.uint16)
+    depth[mask] = values.astype(np.uint16)
+    return depth.tobytes()
+
+
   def decompress_color(self, compression_type):
+    if getattr(self, '_reader', None) is not None:
+      return self._reader.decode([self._index], depth=False)[0][0]
     if compression_type == 'jpeg':
        return self.decompress_color_jpeg()
     else:
@@ -51,11 +112,15 @@ class SensorData:
 
 
   def load(self, filename):
+    if _sensreader is not None:
+      self.load_native(filename)
+      return
+    self._reader = None
     with open(filename, 'rb') as f:
       version = struct.unpack('I', f.read(4))[0]
       assert self.version == version
       strlen = struct.unpack('Q', f.read(8))[0]
-      self.sensor_name = ''.join(struct.unpack('c'*strlen, f.read(strlen)))
+      self.sensor_name = str(f.read(strlen).decode('utf-8'))
       self.intrinsic_color = np.asarray(struct.unpack('f'*16, f.read(16*4)), dtype=np.float32).reshape(4, 4)
       self.extrinsic_color = np.asarray(struct.unpack('f'*16, f.read(16*4)), dtype=np.float32).reshape(4, 4)
       self.intrinsic_depth = np.asarray(struct.unpack('f'*16, f.read(16*4)), dtype=np.float32).reshape(4, 4)
@@ -75,13 +140,66 @@ class SensorData:
         self.frames.append(frame)
 
 
+  # header and frame records through the c++ reader; the file is memory-mapped and only decoded frames are read
+  def load_native(self, filename):
+    self._reader = _sensreader.Reader(filename)
+    header = self._reader.header()
+    assert self.version == header['version']
+    self.sensor_name = header['sensor_name']
+    self.intrinsic_color = header['intrinsic_color']
+    self.extrinsic_color = header['extrinsic_color']
+    self.intrinsic_depth = header['intrinsic_depth']
+    self.extrinsic_depth = header['extrinsic_depth']
+    self.color_compression_type = COMPRESSION_TYPE_COLOR[header['color_compression_type']]
+    self.depth_compression_type = COMPRESSION_TYPE_DEPTH[header['depth_compression_type']]
+    self.color_width = header['color_width']
+    self.color_height = header['color_height']
+    self.depth_width = header['depth_width']
+    self.depth_height = header['depth_height']
+    self.depth_shift = header['depth_shift']
+    poses = self._reader.poses()
+    timestamps = self._reader.timestamps()
+    self.frames = []
+    for i in range(header['num_frames']):
+      frame = RGBDFrame()
+      frame.load_native(self._reader, i, poses[i], timestamps[i])
+      self.frames.append(frame)
+
+
+  # decodes the given frames (default: all) into color (K, color_height, color_width, 3) uint8 and depth (K, depth_height, depth_width) uint16 arrays;
+  # with the c++ reader the frames are decoded in parallel by num_threads threads (0: all cores) without holding the GIL
+  def decode_frames(self, frames=None, color=True, depth=True, num_threads=0):
+    if frames is None:
+      frames = range(len(self.frames))
+    frames = list(frames)
+    if self._reader is not None:
+      return self._reader.decode(frames, color=color, depth=depth, num_threads=num_threads)
+    colors = np.stack([self.frames[f].decompress_color(self.color_compression_type) for f in frames]) if color else None
+    depths = None
+    if depth:
+      depths = np.zeros((len(frames), self.depth_height, self.depth_width), dtype=np.uint16)
+      for k, f in enumerate(frames):
+        depth_data = self.frames[f].decompress_depth(self.depth_compression_type, self.depth_width*self.depth_height)
+        depths[k] = np.frombuffer(depth_data, dtype=np.uint16).reshape(self.depth_height, self.depth_width)
+    return colors, depths
+
+
+  # yields (frame index, decoded image) for every frame_skip-th frame, decoding batch_size frames at a time
+  def iterate_decoded(self, frame_skip=1, color=True, batch_size=64):
+    frames = list(range(0, len(self.frames), frame_skip))
+    for b in range(0, len(frames), batch_size):
+      batch = frames[b:b+batch_size]
+      colors, depths = self.decode_frames(batch, color=color, depth=not color)
+      images = colors if color else depths
+      for k, f in enumerate(batch):
+        yield f, images[k]
+
+
   def export_depth_images(self, output_path, image_size=None, frame_skip=1):
     if not os.path.exists(output_path):
       os.makedirs(output_path)
-    print 'exporting', len(self.frames)//frame_skip, ' depth frames to', output_path
-    for f in range(0, len(self.frames), frame_skip):
-      depth_data = self.frames[f].decompress_depth(self.depth_compression_type)
-      depth = np.fromstring(depth_data, dtype=np.uint16).reshape(self.depth_height, self.depth_width)
+    print('exporting', len(self.frames)//frame_skip, ' depth frames to', output_path)
+    for f, depth in self.iterate_decoded(frame_skip, color=False):
       if image_size is not None:
         depth = cv2.resize(depth, (image_size[1], image_size[0]), interpolation=cv2.INTER_NEAREST)
       #imageio.imwrite(os.path.join(output_path, str(f) + '.png'), depth)
@@ -93,9 +211,8 @@ class SensorData:
   def export_color_images(self, output_path, image_size=None, frame_skip=1):
     if not os.path.exists(output_path):
       os.makedirs(output_path)
-    print 'exporting', len(self.frames)//frame_skip, 'color frames to', output_path
-    for f in range(0, len(self.frames), frame_skip):
-      color = self.frames[f].decompress_color(self.color_compression_type)
+    print('exporting', len(self.frames)//frame_skip, 'color frames to', output_path)
+    for f, color in self.iterate_decoded(frame_skip, color=True):
       if image_size is not None:
         color = cv2.resize(color, (image_size[1], image_size[0]), interpolation=cv2.INTER_NEAREST)
       imageio.imwrite(os.path.join(output_path, str(f) + '.jpg'), color)
@@ -110,7 +227,7 @@ class SensorData:
   def export_poses(self, output_path, frame_skip=1):
     if not os.path.exists(output_path):
       os.makedirs(output_path)
-    print 'exporting', len(self.frames)//frame_skip, 'camera poses to', output_path
+    print('exporting', len(self.frames)//frame_skip, 'camera poses to', output_path)
     for f in range(0, len(self.frames), frame_skip):
       self.save_mat_to_file(self.frames[f].camera_to_world, os.path.join(output_path, str(f) + '.txt'))
 
@@ -118,7 +235,7 @@ class SensorData:
   def export_intrinsics(self, output_path):
     if not os.path.exists(output_path):
       os.makedirs(output_path)
-    print 'exporting camera intrinsics to', output_path
+    print('exporting camera intrinsics to', output_path)
     self.save_mat_to_file(self.intrinsic_color, os.path.join(output_path, 'intrinsic_color.txt'))
     self.save_mat_to_file(self.extrinsic_color, os.path.join(output_path, 'extrinsic_color.txt'))
     self.save_mat_to_file(self.intrinsic_depth, os.path.join(output_path, 'intrinsic_depth.txt'))
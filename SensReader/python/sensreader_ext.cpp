@@ -0,0 +1,291 @@
+
+//python extension (_sensreader) over the c++ reader (../c++/src/sensorData.h); build with: python setup.py build_ext --inplace
+//the .sens file is memory-mapped, i.e., only the pages of the requested frames are read from disk
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#define NPY_NO_DEPRECATED_API NPY_1_7_API_VERSION
+#include <numpy/arrayobject.h>
+
+#include "../c++/src/sensorData.h"
+
+typedef struct {
+	PyObject_HEAD
+	ml::SensorData* sd;
+} ReaderObject;
+
+static void setError(const std::exception& e) {
+	PyErr_SetString(PyExc_RuntimeError, e.what());
+}
+
+//! a reader opens a single file: arrays returned by color_data/depth_data point into its mapping, so it must not be replaced by a second __init__
+static int Reader_init(ReaderObject* self, PyObject* args, PyObject* kwds) {
+	const char* filename = NULL;
+	if (!PyArg_ParseTuple(args, "s", &filename)) return -1;
+	if (self->sd) {
+		PyErr_SetString(PyExc_RuntimeError, "reader is already open (create a new Reader for another file)");
+		return -1;
+	}
+	try {
+		self->sd = new ml::SensorData;
+		self->sd->loadFromFileMapped(filename);
+	}
+	catch (const std::exception& e) {
+		delete self->sd;
+		self->sd = NULL;
+		setError(e);
+		return -1;
+	}
+	return 0;
+}
+
+static void Reader_dealloc(ReaderObject* self) {
+	delete self->sd;
+	Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static bool checkOpen(ReaderObject* self) {
+	if (!self->sd) PyErr_SetString(PyExc_RuntimeError, "no file loaded");
+	return self->sd != NULL;
+}
+
+static PyObject* newMatrixArray(const ml::mat4f& m) {
+	npy_intp dims[2] = { 4, 4 };
+	PyObject* res = PyArray_SimpleNew(2, dims, NPY_FLOAT32);
+	if (res) std::memcpy(PyArray_DATA((PyArrayObject*)res), m.matrix, 16 * sizeof(float));
+	return res;
+}
+
+//! header as a dict (names as in SensorData.py)
+static PyObject* Reader_header(ReaderObject* self, PyObject*) {
+	if (!checkOpen(self)) return NULL;
+	const ml::SensorData& sd = *self->sd;
+	return Py_BuildValue("{s:I,s:s,s:N,s:N,s:N,s:N,s:i,s:i,s:I,s:I,s:I,s:I,s:f,s:n,s:n}",
+		"version", sd.m_versionNumber,
+		"sensor_name", sd.m_sensorName.c_str(),
+		"intrinsic_color", newMatrixArray(sd.m_calibrationColor.m_intrinsic),
+		"extrinsic_color", newMatrixArray(sd.m_calibrationColor.m_extrinsic),
+		"intrinsic_depth", newMatrixArray(sd.m_calibrationDepth.m_intrinsic),
+		"extrinsic_depth", newMatrixArray(sd.m_calibrationDepth.m_extrinsic),
+		"color_compression_type", (int)sd.m_colorCompressionType,
+		"depth_compression_type", (int)sd.m_depthCompressionType,
+		"color_width", sd.m_colorWidth,
+		"color_height", sd.m_colorHeight,
+		"depth_width", sd.m_depthWidth,
+		"depth_height", sd.m_depthHeight,
+		"depth_shift", sd.m_depthShift,
+		"num_frames", (Py_ssize_t)sd.m_frames.size(),
+		"num_imu_frames", (Py_ssize_t)sd.m_IMUFrames.size());
+}
+
+//! camera-to-world matrices of all frames, (N, 4, 4) float32
+static PyObject* Reader_poses(ReaderObject* self, PyObject*) {
+	if (!checkOpen(self)) return NULL;
+	npy_intp dims[3] = { (npy_intp)self->sd->m_frames.size(), 4, 4 };
+	PyObject* res = PyArray_SimpleNew(3, dims, NPY_FLOAT32);
+	if (!res) return NULL;
+	float* data = (float*)PyArray_DATA((PyArrayObject*)res);
+	for (size_t i = 0; i < self->sd->m_frames.size(); i++) {
+		std::memcpy(data + 16 * i, self->sd->m_frames[i].getCameraToWorld().matrix, 16 * sizeof(float));
+	}
+	return res;
+}
+
+//! color and depth time stamps of all frames, (N, 2) uint64
+static PyObject* Reader_timestamps(ReaderObject* self, PyObject*) {
+	if (!checkOpen(self)) return NULL;
+	npy_intp dims[2] = { (npy_intp)self->sd->m_frames.size(), 2 };
+	PyObject* res = PyArray_SimpleNew(2, dims, NPY_UINT64);
+	if (!res) return NULL;
+	npy_uint64* data = (npy_uint64*)PyArray_DATA((PyArrayObject*)res);
+	for (size_t i = 0; i < self->sd->m_frames.size(); i++) {
+		data[2 * i + 0] = self->sd->m_frames[i].getTimeStampColor();
+		data[2 * i + 1] = self->sd->m_frames[i].getTimeStampDepth();
+	}
+	return res;
+}
+
+static bool getFrameIndex(ReaderObject* self, PyObject* args, size_t& frameIdx) {
+	Py_ssize_t i = 0;
+	if (!checkOpen(self) || !PyArg_ParseTuple(args, "n", &i)) return false;
+	if (i < 0) i += (Py_ssize_t)self->sd->m_frames.size();
+	if (i < 0 || (size_t)i >= self->sd->m_frames.size()) {
+		PyErr_SetString(PyExc_IndexError, "frame index out of range");
+		return false;
+	}
+	frameIdx = (size_t)i;
+	return true;
+}
+
+//! read-only uint8 array over the mapped file (keeps the reader alive)
+static PyObject* newPayloadArray(ReaderObject* self, unsigned char* data, size_t sizeBytes) {
+	npy_intp dims[1] = { (npy_intp)sizeBytes };
+	PyObject* res = PyArray_New(&PyArray_Type, 1, dims, NPY_UINT8, NULL, data, 0, NPY_ARRAY_C_CONTIGUOUS, NULL);
+	if (!res) return NULL;
+	Py_INCREF(self);
+	if (PyArray_SetBaseObject((PyArrayObject*)res, (PyObject*)self) < 0) {
+		Py_DECREF(res);
+		return NULL;
+	}
+	return res;
+}
+
+//! compressed color payload of a frame (zero-copy)
+static PyObject* Reader_color_data(ReaderObject* self, PyObject* args) {
+	size_t i;
+	if (!getFrameIndex(self, args, i)) return NULL;
+	const ml::SensorData::RGBDFrame& f = self->sd->m_frames[i];
+	return newPayloadArray(self, f.getColorCompressed(), f.getColorSizeBytes());
+}
+
+//! compressed depth payload of a frame (zero-copy)
+static PyObject* Reader_depth_data(ReaderObject* self, PyObject* args) {
+	size_t i;
+	if (!getFrameIndex(self, args, i)) return NULL;
+	const ml::SensorData::RGBDFrame& f = self->sd->m_frames[i];
+	return newPayloadArray(self, f.getDepthCompressed(), f.getDepthSizeBytes());
+}
+
+//! decode(frames=None, color=True, depth=True, num_threads=0) -> (color (K, H, W, 3) uint8 or None, depth (K, h, w) uint16 or None)
+//! frames is a sequence of frame indices (None: all); the frames are decoded directly into the returned arrays by num_threads threads (0: all cores) without holding the GIL
+static PyObject* Reader_decode(ReaderObject* self, PyObject* args, PyObject* kwds) {
+	static const char* keywords[] = { "frames", "color", "depth", "num_threads", NULL };
+	PyObject* framesArg = Py_None;
+	int decodeColor = 1, decodeDepth = 1;
+	unsigned int numThreads = 0;
+	if (!checkOpen(self) || !PyArg_ParseTupleAndKeywords(args, kwds, "|OiiI", (char**)keywords, &framesArg, &decodeColor, &decodeDepth, &numThreads)) return NULL;
+	const ml::SensorData& sd = *self->sd;
+
+	std::vector<size_t> frames;
+	if (framesArg == Py_None) {
+		for (size_t i = 0; i < sd.m_frames.size(); i++) frames.push_back(i);
+	}
+	else {
+		PyObject* seq = PySequence_Fast(framesArg, "frames must be a sequence of frame indices");
+		if (!seq) return NULL;
+		const Py_ssize_t n = PySequence_Fast_GET_SIZE(seq);
+		for (Py_ssize_t k = 0; k < n; k++) {
+			Py_ssize_t i = PyNumber_AsSsize_t(PySequence_Fast_GET_ITEM(seq, k), PyExc_IndexError);
+			if (i == -1 && PyErr_Occurred()) {
+				Py_DECREF(seq);
+				return NULL;
+			}
+			if (i < 0) i += (Py_ssize_t)sd.m_frames.size();
+			if (i < 0 || (size_t)i >= sd.m_frames.size()) {
+				Py_DECREF(seq);
+				PyErr_SetString(PyExc_IndexError, "frame index out of range");
+				return NULL;
+			}
+			frames.push_back((size_t)i);
+		}
+		Py_DECREF(seq);
+	}
+
+	PyObject* color = Py_None;
+	PyObject* depth = Py_None;
+	Py_INCREF(Py_None);
+	Py_INCREF(Py_None);
+	if (decodeColor) {
+		npy_intp dims[4] = { (npy_intp)frames.size(), (npy_intp)sd.m_colorHeight, (npy_intp)sd.m_colorWidth, 3 };
+		Py_DECREF(color);
+		color = PyArray_SimpleNew(4, dims, NPY_UINT8);
+	}
+	if (decodeDepth && color) {
+		npy_intp dims[3] = { (npy_intp)frames.size(), (npy_intp)sd.m_depthHeight, (npy_intp)sd.m_depthWidth };
+		Py_DECREF(depth);
+		depth = PyArray_SimpleNew(3, dims, NPY_UINT16);
+	}
+	if (!color || !depth) {
+		Py_XDECREF(color);
+		Py_XDECREF(depth);
+		return NULL;
+	}
+	unsigned char* colorData = decodeColor ? (unsigned char*)PyArray_DATA((PyArrayObject*)color) : NULL;
+	unsigned short* depthData = decodeDepth ? (unsigned short*)PyArray_DATA((PyArrayObject*)depth) : NULL;
+	const size_t colorSize = (size_t)sd.m_colorWidth * sd.m_colorHeight * 3;
+	const size_t depthSize = (size_t)sd.m_depthWidth * sd.m_depthHeight;
+
+	if (numThreads == 0) numThreads = std::max(1u, std::thread::hardware_concurrency());
+	numThreads = (unsigned int)std::min((size_t)numThreads, std::max(frames.size(), (size_t)1));
+	std::atomic<size_t> next(0);
+	std::mutex mutex;
+	std::string error;
+	const auto worker = [&]() {
+		try {
+			for (size_t k = next++; k < frames.size(); k = next++) {
+				const ml::SensorData::RGBDFrame& f = sd.m_frames[frames[k]];
+				if (colorData) sd.decompressColorInto(f, (ml::vec3uc*)(colorData + k * colorSize));
+				if (depthData) sd.decompressDepthInto(f, depthData + k * depthSize);
+			}
+		}
+		catch (const std::exception& e) {
+			std::lock_guard<std::mutex> lock(mutex);
+			if (error.empty()) error = e.what();
+			next = frames.size();
+		}
+	};
+	Py_BEGIN_ALLOW_THREADS
+	std::vector<std::thread> threads;
+	for (unsigned int t = 1; t < numThreads; t++) threads.push_back(std::thread(worker));
+	worker();
+	for (auto& t : threads) t.join();
+	Py_END_ALLOW_THREADS
+
+	if (!error.empty()) {
+		Py_DECREF(color);
+		Py_DECREF(depth);
+		PyErr_SetString(PyExc_RuntimeError, error.c_str());
+		return NULL;
+	}
+	return Py_BuildValue("(NN)", color, depth);
+}
+
+static PyMethodDef Reader_methods[] = {
+	{ "header", (PyCFunction)Reader_header, METH_NOARGS, "header fields as a dict" },
+	{ "poses", (PyCFunction)Reader_poses, METH_NOARGS, "camera-to-world matrices of all frames, (N, 4, 4) float32" },
+	{ "timestamps", (PyCFunction)Reader_timestamps, METH_NOARGS, "color and depth time stamps of all frames, (N, 2) uint64" },
+	{ "color_data", (PyCFunction)Reader_color_data, METH_VARARGS, "color_data(i): compressed color payload of frame i (read-only uint8 array over the mapped file)" },
+	{ "depth_data", (PyCFunction)Reader_depth_data, METH_VARARGS, "depth_data(i): compressed depth payload of frame i (read-only uint8 array over the mapped file)" },
+	{ "decode", (PyCFunction)Reader_decode, METH_VARARGS | METH_KEYWORDS, "decode(frames=None, color=True, depth=True, num_threads=0) -> (color (K, H, W, 3) uint8, depth (K, h, w) uint16)" },
+	{ NULL, NULL, 0, NULL }
+};
+
+static PyTypeObject ReaderType = { PyVarObject_HEAD_INIT(NULL, 0) };
+
+static PyMethodDef module_methods[] = {
+	{ NULL, NULL, 0, NULL }
+};
+
+#if PY_MAJOR_VERSION >= 3
+static struct PyModuleDef moduledef = { PyModuleDef_HEAD_INIT, "_sensreader", "reads .sens files through the c++ SensorData reader", -1, module_methods };
+#define MODULE_INIT_ERROR NULL
+PyMODINIT_FUNC PyInit__sensreader(void)
+#else
+#define MODULE_INIT_ERROR
+PyMODINIT_FUNC init_sensreader(void)
+#endif
+{
+	import_array1(MODULE_INIT_ERROR);
+
+	ReaderType.tp_name = "_sensreader.Reader";
+	ReaderType.tp_basicsize = sizeof(ReaderObject);
+	ReaderType.tp_flags = Py_TPFLAGS_DEFAULT;
+	ReaderType.tp_doc = "Reader(filename): memory-mapped .sens file";
+	ReaderType.tp_init = (initproc)Reader_init;
+	ReaderType.tp_dealloc = (destructor)Reader_dealloc;
+	ReaderType.tp_methods = Reader_methods;
+	ReaderType.tp_new = PyType_GenericNew;
+	if (PyType_Ready(&ReaderType) < 0) return MODULE_INIT_ERROR;
+
+#if PY_MAJOR_VERSION >= 3
+	PyObject* m = PyModule_Create(&moduledef);
+#else
+	PyObject* m = Py_InitModule3("_sensreader", module_methods, "reads .sens files through the c++ SensorData reader");
+#endif
+	if (!m) return MODULE_INIT_ERROR;
+	Py_INCREF(&ReaderType);
+	PyModule_AddObject(m, "Reader", (PyObject*)&ReaderType);
+#if PY_MAJOR_VERSION >= 3
+	return m;
+#endif
+}
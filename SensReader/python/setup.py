@@ -0,0 +1,21 @@
+# builds the _sensreader extension (c++ reader, see sensreader_ext.cpp) used by SensorData.py:
+#   python setup.py build_ext --inplace
+import sys
+try:
+  from setuptools import setup, Extension
+except ImportError:
+  from distutils.core import setup, Extension
+import numpy as np
+
+if sys.platform == 'win32':
+  compile_args = ['/O2', '/EHsc']
+  link_args = []
+else:
+  compile_args = ['-std=c++11', '-O2', '-pthread']
+  link_args = ['-pthread']
+
+setup(name='sensreader',
+      ext_modules=[Extension('_sensreader', ['sensreader_ext.cpp'],
+                             include_dirs=[np.get_include()],
+                             extra_compile_args=compile_args,
+                             extra_link_args=link_args)])
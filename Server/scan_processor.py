@@ -38,6 +38,8 @@ MESHPROC_DIR = os.path.join(cfg.TOOLS_DIR, 'meshclean')
 # exe for segmentation
 SEGMENT_DIR = os.path.join(cfg.TOOLS_DIR, 'segmentor')
 SEGMENT_BIN = os.path.join(SEGMENT_DIR, 'Segmentator.exe')
+# segmentation thresholds (kThresh), all computed in one run (see segment outputs in config/scan_stages.json)
+SEGMENT_KTHRESH = '0.0001,0.001,0.01'
 # exe for rendering
 RENDER_DIR = cfg.SCRIPT_DIR
 RENDER_BIN = 'python ' + os.path.join(RENDER_DIR, 'mts_render.py')
@@ -153,7 +155,7 @@ def process_scan_dir_basic(path, name, config):
 
     # Segment
     if config.get('segment'):
-        ret = util.call(SEGMENT_BIN + ' ' + decimated_mesh, log, SEGMENT_DIR, desc='segment')
+        ret = util.call(SEGMENT_BIN + ' ' + decimated_mesh + ' ' + SEGMENT_KTHRESH, log, SEGMENT_DIR, desc='segment')
 
     # Generate images
     if config.get('render'):
@@ -100,6 +100,30 @@ function createVideoPreview(scan, imgurl) {
   }
 }
 
+function createSegmentsLink(scan) {
+  return $('<a href="#"></a>').attr('class', 'loadSegsBtn')
+    .attr('data-urls', JSON.stringify(scan.segsUrls))
+    .attr('title', 'Load segmentation').text('load');
+}
+
+// Replaces the load link with the number of segments (.segs.bin if there is one, otherwise .segs.json)
+function initSegmentsLinks(row) {
+  $(row).find('a.loadSegsBtn:not([data-segs-bound])').attr('data-segs-bound', true).click(function(event) {
+    event.preventDefault();
+    var link = $(this);
+    var urls = JSON.parse(link.attr('data-urls'));
+    link.text('loading...');
+    new SegsReader().loadFirst(urls, function(err, segmentation, url) {
+      if (err) {
+        link.replaceWith($('<span class="text-danger"/>').attr('title', err.message).text('n/a'));
+      } else {
+        link.replaceWith($('<span/>').attr('title', url + '\nkThresh ' + segmentation.params.kThresh +
+          ', segMinVerts ' + segmentation.params.segMinVerts).text(segmentation.numSegments));
+      }
+    });
+  });
+}
+
 function createProgressStatusBars(scan) {
   var stages = scan.stages;
   if (scan.lastOkStage && stages && stages.length) {
@@ -356,6 +380,16 @@ function initResultTable(params) {
           "aggregation":    "average",
           "defaultContent": ""
         },
+        { "data": "segsUrls",
+          "orderable":      false,
+          "searchable":     false,
+          "defaultContent": "",
+          "render": function ( data, type, full, meta ) {
+            if (full.segsUrls) {
+              return getHtml(createSegmentsLink(full));
+            }
+          }
+        },
         { // Action buttons
           "orderable":      false,
           "searchable":     false,
@@ -386,6 +420,7 @@ function initResultTable(params) {
           img.attr('data-video-bound', true);
         }
       });
+      initSegmentsLinks(row);
       processQueue.initProcessButtons(row);
       if (auth) {
         auth.addCheck($(row));
@@ -0,0 +1,154 @@
+// Reader for mesh segmentations: .segs.json and the binary .segs.bin (format in Segmentator/segsIO.h)
+
+'use strict';
+
+var SEGS_BINARY_MAGIC = 0x42474553;  // 'SEGB'
+var SEGS_BINARY_FLAG_SEGMENT_TABLE = 1;
+
+function SegsReader() {
+}
+
+// Parses a .segs.bin ArrayBuffer into
+// { sceneId, params: { kThresh, segMinVerts }, segIndices: Uint32Array, numSegments,
+//   segments: { ids, offsets, vertIds } (Uint32Arrays, only if stored in the file) }
+SegsReader.prototype.parseBinary = function(buffer) {
+  var view = new DataView(buffer);
+  if (buffer.byteLength < 40 || view.getUint32(0, true) !== SEGS_BINARY_MAGIC) {
+    throw new Error('Not a binary segmentation');
+  }
+  var flags = view.getUint32(8, true);
+  var numVertices = view.getUint32(12, true);
+  var numSegments = view.getUint32(16, true);
+  var numRuns = view.getUint32(20, true);
+  var runBytes = view.getUint32(24, true);
+  var sceneIdBytes = view.getUint32(36, true);
+  var bytes = new Uint8Array(buffer);
+  var sceneId = new TextDecoder('utf-8').decode(bytes.subarray(40, 40 + sceneIdBytes));
+  var runsBegin = Math.ceil((40 + sceneIdBytes) / 4) * 4;
+  var tableBegin = Math.ceil((runsBegin + runBytes) / 4) * 4;
+  var tableBytes = (flags & SEGS_BINARY_FLAG_SEGMENT_TABLE) ? 4 * (2 * numSegments + 1 + numVertices) : 0;
+  if (tableBegin + tableBytes > buffer.byteLength) {
+    throw new Error('Truncated binary segmentation');
+  }
+
+  var segIndices = new Uint32Array(numVertices);
+  var pos = runsBegin;
+  var runsEnd = runsBegin + runBytes;
+  function varint() {
+    // LEB128; plain arithmetic since values can exceed 31 bits
+    var v = 0, scale = 1, b;
+    do {
+      if (pos >= runsEnd) {
+        throw new Error('Truncated binary segmentation');
+      }
+      b = bytes[pos++];
+      v += (b & 0x7f) * scale;
+      scale *= 128;
+    } while (b >= 0x80);
+    return v;
+  }
+  var id = 0, v = 0;
+  for (var r = 0; r < numRuns; r++) {
+    var zigzag = varint();
+    id += (zigzag % 2) ? -(zigzag + 1) / 2 : zigzag / 2;
+    var end = v + varint() + 1;
+    if (end > numVertices) {
+      throw new Error('Invalid binary segmentation');
+    }
+    segIndices.fill(id, v, end);
+    v = end;
+  }
+  if (v !== numVertices) {
+    throw new Error('Invalid binary segmentation');
+  }
+
+  var segments = null;
+  if (flags & SEGS_BINARY_FLAG_SEGMENT_TABLE) {
+    // the table is 4-byte aligned, so it can be used in place
+    segments = {
+      ids: new Uint32Array(buffer, tableBegin, numSegments),
+      offsets: new Uint32Array(buffer, tableBegin + 4 * numSegments, numSegments + 1),
+      vertIds: new Uint32Array(buffer, tableBegin + 4 * (2 * numSegments + 1), numVertices)
+    };
+  }
+  return {
+    sceneId: sceneId,
+    params: { kThresh: view.getFloat32(28, true), segMinVerts: view.getUint32(32, true) },
+    segIndices: segIndices,
+    numSegments: numSegments,
+    segments: segments
+  };
+};
+
+// Parses .segs.json text into the same layout as parseBinary (without the segment table)
+SegsReader.prototype.parseJSON = function(text) {
+  var json = JSON.parse(text);
+  var segIndices = Uint32Array.from(json.segIndices);
+  var ids = {};
+  var numSegments = 0;
+  for (var i = 0; i < segIndices.length; i++) {
+    if (!ids[segIndices[i]]) {
+      ids[segIndices[i]] = true;
+      numSegments++;
+    }
+  }
+  var params = json.params || {};
+  return {
+    sceneId: json.sceneId,
+    params: { kThresh: parseFloat(params.kThresh), segMinVerts: parseInt(params.segMinVerts) },
+    segIndices: segIndices,
+    numSegments: numSegments,
+    segments: null
+  };
+};
+
+// Loads a .segs.bin or .segs.json url; callback(err, segmentation)
+SegsReader.prototype.load = function(url, callback) {
+  var self = this;
+  var xhr = new XMLHttpRequest();
+  xhr.open('GET', url);
+  xhr.responseType = 'arraybuffer';
+  xhr.onload = function() {
+    if (xhr.status !== 200) {
+      return callback(new Error('Error loading ' + url + ': ' + xhr.status));
+    }
+    var segmentation;
+    try {
+      var buffer = xhr.response;
+      if (buffer.byteLength >= 4 && new DataView(buffer).getUint32(0, true) === SEGS_BINARY_MAGIC) {
+        segmentation = self.parseBinary(buffer);
+      } else {
+        segmentation = self.parseJSON(new TextDecoder('utf-8').decode(buffer));
+      }
+    } catch (err) {
+      return callback(err);
+    }
+    callback(null, segmentation);
+  };
+  xhr.onerror = function() {
+    callback(new Error('Error loading ' + url));
+  };
+  xhr.send();
+};
+
+// Loads the first of the urls that can be read, e.g., [.segs.bin, .segs.json] to fall back to the json;
+// callback(err, segmentation, url)
+SegsReader.prototype.loadFirst = function(urls, callback) {
+  var self = this;
+  function next(i, lastErr) {
+    if (i >= urls.length) {
+      return callback(lastErr || new Error('No segmentation to load'));
+    }
+    self.load(urls[i], function(err, segmentation) {
+      if (err) {
+        return next(i + 1, err);
+      }
+      callback(null, segmentation, urls[i]);
+    });
+  }
+  next(0);
+};
+
+if (typeof module !== 'undefined' && module.exports) {
+  module.exports = SegsReader;
+}
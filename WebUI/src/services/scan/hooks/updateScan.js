@@ -45,6 +45,12 @@ module.exports = function(options) {
       if (scan.hasThumbnail) {
         scan.previewUrl = scanPath + scan.id + '_vh_clean_2_thumb.png';
       }
+
+      // Segmentation used for annotation (see segment stage): .segs.bin, falling back to .segs.json (read with public/js/segs.js)
+      if (scan.stages && scan.stages.some(stage => stage.name === 'segment' && stage.ok)) {
+        var segsBase = scanPath + scan.id + '_vh_clean_2.0.010000';
+        scan.segsUrls = [segsBase + '.segs.bin', segsBase + '.segs.json'];
+      }
     }
 
     const isPaginated = (hook.method === 'find' && hook.result.data);